@@ -1,6 +1,7 @@
 #include <libfdisk.h>
 #include <libsmartcols.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "c.h"
 #include "xalloc.h"
@@ -360,16 +361,11 @@ char *next_proc_partition(FILE **f)
 	return NULL;
 }
 
-int print_device_pt(struct fdisk_context *cxt, char *device, int warnme,
-		    int verify, int separator)
+static int print_assigned_pt(struct fdisk_context *cxt, size_t idx, void *data)
 {
-	if (fdisk_assign_device(cxt, device, 1) != 0) {	/* read-only */
-		if (warnme || errno == EACCES)
-			warn(_("cannot open %s"), device);
-		return -1;
-	}
+	int verify = *((int *) data);
 
-	if (separator)
+	if (idx)
 		fputs("\n\n", stdout);
 
 	list_disk_geometry(cxt);
@@ -379,6 +375,19 @@ int print_device_pt(struct fdisk_context *cxt, char *device, int warnme,
 		if (verify)
 			fdisk_verify_disklabel(cxt);
 	}
+	return 0;
+}
+
+int print_device_pt(struct fdisk_context *cxt, char *device, int warnme,
+		    int verify, int separator)
+{
+	if (fdisk_assign_device(cxt, device, 1) != 0) {	/* read-only */
+		if (warnme || errno == EACCES)
+			warn(_("cannot open %s"), device);
+		return -1;
+	}
+
+	print_assigned_pt(cxt, separator ? 1 : 0, &verify);
 	fdisk_deassign_device(cxt, 1);
 	return 0;
 }
@@ -400,17 +409,289 @@ int print_device_freespace(struct fdisk_context *cxt, char *device, int warnme,
 	return 0;
 }
 
-void print_all_devices_pt(struct fdisk_context *cxt, int verify)
+/*
+ * Lists more devices.
+ *
+ * Opening and probing devices one by one is slow on hosts with many devices
+ * or on devices with high latency. The devices are assigned (opened and
+ * probed) by a pool of threads, every thread with its own context. The
+ * messages from probing are buffered and @fn is called for all devices by
+ * the main thread in the original order, so the output is the same as for
+ * serial listing. The threads are at most LIST_AHEAD devices ahead of the
+ * output to keep the memory use bounded.
+ */
+#define LIST_MAX_THREADS	16
+#define LIST_AHEAD		(2 * LIST_MAX_THREADS)
+
+struct list_msg {
+	int		type;		/* FDISK_ASKTYPE_{INFO,WARN,WARNX} */
+	int		errnum;
+	char		*mesg;
+	struct list_msg	*next;
+};
+
+struct list_dev {
+	char			*devname;
+	struct fdisk_context	*cxt;		/* assigned context or NULL */
+	struct fdisk_context	*main;		/* where to forward messages */
+	struct list_msg		*msgs;		/* buffered messages */
+	struct list_msg		*last;
+	int			errnum;		/* assign errno */
+
+	unsigned int		ready : 1,	/* done by thread */
+				forward : 1;	/* print messages to main */
+};
+
+struct list_pool {
+	struct fdisk_context	*cxt;		/* main context */
+	struct list_dev		*devs;
+	size_t			ndevs;
+	size_t			next;		/* next device to assign */
+	size_t			done;		/* number of printed devices */
+
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;
+};
+
+static void forward_msg(struct fdisk_context *cxt, int type, int errnum,
+			const char *mesg)
 {
-	FILE *f = NULL;
-	int sep = 0;
-	char *dev;
+	switch (type) {
+	case FDISK_ASKTYPE_INFO:
+		fdisk_info(cxt, "%s", mesg);
+		break;
+	case FDISK_ASKTYPE_WARNX:
+		fdisk_warnx(cxt, "%s", mesg);
+		break;
+	case FDISK_ASKTYPE_WARN:
+		errno = errnum;
+		fdisk_warn(cxt, "%s", mesg);
+		break;
+	}
+}
 
-	while ((dev = next_proc_partition(&f))) {
-		print_device_pt(cxt, dev, 0, verify, sep);
-		free(dev);
-		sep = 1;
+static int list_ask_callback(struct fdisk_context *cxt __attribute__((__unused__)),
+			     struct fdisk_ask *ask, void *data)
+{
+	struct list_dev *ld = (struct list_dev *) data;
+	int type = fdisk_ask_get_type(ask);
+	struct list_msg *msg;
+
+	if (type != FDISK_ASKTYPE_INFO && type != FDISK_ASKTYPE_WARNX
+	    && type != FDISK_ASKTYPE_WARN)
+		return -EINVAL;
+
+	if (ld->forward) {
+		forward_msg(ld->main, type, fdisk_ask_print_get_errno(ask),
+			    fdisk_ask_print_get_mesg(ask));
+		return 0;
+	}
+
+	msg = xcalloc(1, sizeof(*msg));
+	msg->type = type;
+	msg->errnum = fdisk_ask_print_get_errno(ask);
+	msg->mesg = xstrdup(fdisk_ask_print_get_mesg(ask));
+
+	if (ld->last)
+		ld->last->next = msg;
+	else
+		ld->msgs = msg;
+	ld->last = msg;
+	return 0;
+}
+
+/* new context with the same list settings as @cxt */
+static struct fdisk_context *new_list_context(struct fdisk_context *cxt,
+					      struct list_dev *ld)
+{
+	struct fdisk_context *x = fdisk_new_context();
+
+	if (!x)
+		return NULL;
+
+	fdisk_set_ask(x, list_ask_callback, ld);
+	fdisk_enable_listonly(x, fdisk_is_listonly(cxt));
+	fdisk_enable_details(x, fdisk_is_details(cxt));
+	fdisk_enable_bootbits_protection(x, fdisk_has_protected_bootbits(cxt));
+	fdisk_set_size_unit(x, fdisk_get_size_unit(cxt));
+	if (fdisk_use_cylinders(cxt))
+		fdisk_set_unit(x, "cylinder");
+	return x;
+}
+
+static void *list_worker(void *data)
+{
+	struct list_pool *pool = (struct list_pool *) data;
+
+	do {
+		struct list_dev *ld = NULL;
+		struct fdisk_context *x;
+
+		pthread_mutex_lock(&pool->lock);
+		while (pool->next < pool->ndevs
+		       && pool->next >= pool->done + LIST_AHEAD)
+			pthread_cond_wait(&pool->cond, &pool->lock);
+		if (pool->next < pool->ndevs)
+			ld = &pool->devs[pool->next++];
+		pthread_mutex_unlock(&pool->lock);
+
+		if (!ld)
+			break;
+
+		x = new_list_context(pool->cxt, ld);
+		if (!x)
+			ld->errnum = ENOMEM;
+		else if (fdisk_assign_device(x, ld->devname, 1) != 0) {	/* read-only */
+			ld->errnum = errno;
+			fdisk_unref_context(x);
+		} else
+			ld->cxt = x;
+
+		pthread_mutex_lock(&pool->lock);
+		ld->ready = 1;
+		pthread_cond_broadcast(&pool->cond);
+		pthread_mutex_unlock(&pool->lock);
+	} while (1);
+
+	return NULL;
+}
+
+static size_t list_nthreads(struct fdisk_context *cxt, size_t ndevs)
+{
+	/* the device properties are not copied to the thread contexts */
+	if (fdisk_has_user_device_properties(cxt))
+		return 0;
+
+	return ndevs > 1 ? min(ndevs, (size_t) LIST_MAX_THREADS) : 0;
+}
+
+/*
+ * Calls @fn for all the devices assigned read-only, @idx is the device index.
+ * If @devs is NULL then all devices from /proc/partitions are used.
+ *
+ * Returns: number of devices which cannot be opened.
+ */
+int list_devices(struct fdisk_context *cxt, char **devs, size_t ndevs, int warnme,
+		 int (*fn)(struct fdisk_context *, size_t, void *), void *data)
+{
+	struct list_pool pool = { .cxt = cxt };
+	pthread_t *threads = NULL;
+	size_t i, nthreads;
+	char **all = NULL;
+	int fails = 0;
+
+	if (!devs) {
+		FILE *f = NULL;
+		char *dev;
+		size_t sz = 0;
+
+		while ((dev = next_proc_partition(&f))) {
+			if (ndevs == sz) {
+				sz = sz ? sz * 2 : 32;
+				all = xrealloc(all, sz * sizeof(char *));
+			}
+			all[ndevs++] = dev;
+		}
+		devs = all;
+	}
+
+	nthreads = list_nthreads(cxt, ndevs);
+	if (nthreads) {
+		pool.ndevs = ndevs;
+		pool.devs = xcalloc(ndevs, sizeof(struct list_dev));
+		for (i = 0; i < ndevs; i++) {
+			pool.devs[i].devname = devs[i];
+			pool.devs[i].main = cxt;
+		}
+
+		pthread_mutex_init(&pool.lock, NULL);
+		pthread_cond_init(&pool.cond, NULL);
+
+		threads = xcalloc(nthreads, sizeof(pthread_t));
+		for (i = 0; i < nthreads; i++) {
+			int rc = pthread_create(&threads[i], NULL, list_worker, &pool);
+			if (rc) {
+				errno = rc;
+				err(EXIT_FAILURE, _("failed to create thread"));
+			}
+		}
+	}
+
+	for (i = 0; i < ndevs; i++) {
+		struct fdisk_context *x = cxt;
+		int errnum = 0;
+
+		if (nthreads) {
+			struct list_dev *ld = &pool.devs[i];
+			struct list_msg *msg;
+
+			pthread_mutex_lock(&pool.lock);
+			while (!ld->ready)
+				pthread_cond_wait(&pool.cond, &pool.lock);
+			pthread_mutex_unlock(&pool.lock);
+
+			for (msg = ld->msgs; msg; ) {
+				struct list_msg *next = msg->next;
+
+				forward_msg(cxt, msg->type, msg->errnum, msg->mesg);
+				free(msg->mesg);
+				free(msg);
+				msg = next;
+			}
+			ld->forward = 1;
+			x = ld->cxt;
+			errnum = ld->errnum;
+
+		} else if (fdisk_assign_device(cxt, devs[i], 1) != 0)	/* read-only */
+			x = NULL, errnum = errno;
+
+		if (!x) {
+			if (warnme || errnum == EACCES) {
+				errno = errnum;
+				warn(_("cannot open %s"), devs[i]);
+			}
+			fails++;
+		} else {
+			fn(x, i, data);
+			fdisk_deassign_device(x, 1);
+			if (x != cxt)
+				fdisk_unref_context(x);
+		}
+
+		if (nthreads) {
+			pthread_mutex_lock(&pool.lock);
+			pool.done++;
+			pthread_cond_broadcast(&pool.cond);
+			pthread_mutex_unlock(&pool.lock);
+		}
 	}
+
+	if (nthreads) {
+		for (i = 0; i < nthreads; i++)
+			pthread_join(threads[i], NULL);
+		pthread_mutex_destroy(&pool.lock);
+		pthread_cond_destroy(&pool.cond);
+		free(threads);
+		free(pool.devs);
+	}
+
+	if (all) {
+		for (i = 0; i < ndevs; i++)
+			free(all[i]);
+		free(all);
+	}
+	return fails;
+}
+
+int print_devices_pt(struct fdisk_context *cxt, char **devs, size_t ndevs,
+		     int warnme, int verify)
+{
+	return list_devices(cxt, devs, ndevs, warnme, print_assigned_pt, &verify);
+}
+
+void print_all_devices_pt(struct fdisk_context *cxt, int verify)
+{
+	print_devices_pt(cxt, NULL, 0, 0, verify);
 }
 
 void print_all_devices_freespace(struct fdisk_context *cxt)
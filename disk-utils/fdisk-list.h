@@ -10,6 +10,10 @@ extern char *next_proc_partition(FILE **f);
 extern int print_device_pt(struct fdisk_context *cxt, char *device, int warnme, int verify, int separator);
 extern int print_device_freespace(struct fdisk_context *cxt, char *device, int warnme, int separator);
 
+extern int list_devices(struct fdisk_context *cxt, char **devs, size_t ndevs, int warnme,
+		int (*fn)(struct fdisk_context *, size_t, void *), void *data);
+extern int print_devices_pt(struct fdisk_context *cxt, char **devs, size_t ndevs,
+		int warnme, int verify);
 extern void print_all_devices_pt(struct fdisk_context *cxt, int verify);
 extern void print_all_devices_freespace(struct fdisk_context *cxt);
 
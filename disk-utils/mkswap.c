@@ -20,6 +20,7 @@
 #include <errno.h>
 #include <getopt.h>
 #include <assert.h>
+#include <pthread.h>
 #ifdef HAVE_LIBSELINUX
 # include <selinux/selinux.h>
 # include <selinux/context.h>
@@ -42,6 +43,7 @@
 #include "closestream.h"
 #include "ismounted.h"
 #include "optutils.h"
+#include "monotonic.h"
 
 #ifdef HAVE_LIBUUID
 # include <uuid.h>
@@ -53,6 +55,13 @@
 
 #define MIN_GOODPAGES	10
 
+#define CHECK_BUFSZ	(1024 * 1024)	/* --check read size */
+#define CHECK_MAX_THREADS	64	/* --threads maximum */
+
+#ifndef BLKDISCARD
+# define BLKDISCARD	_IO(0x12,119)
+#endif
+
 #define SELINUX_SWAPFILE_TYPE	"swapfile_t"
 
 struct mkswap_control {
@@ -74,8 +83,11 @@ struct mkswap_control {
 	unsigned char		*uuid;		/* UUID parsed by libbuuid */
 
 	size_t			nbad_extents;
+	size_t			nthreads;	/* --threads */
 
 	unsigned int		check:1,	/* --check */
+				direct:1,	/* --direct */
+				discard:1,	/* --discard */
 				verbose:1,      /* --verbose */
 				quiet:1,        /* --quiet */
 				force:1;	/* --force */
@@ -166,6 +178,9 @@ static void __attribute__((__noreturn__)) usage(void)
 
 	fputs(USAGE_OPTIONS, out);
 	fputs(_(" -c, --check               check bad blocks before creating the swap area\n"), out);
+	fputs(_("     --threads <num>       number of threads for --check\n"), out);
+	fputs(_("     --direct              use direct I/O for --check\n"), out);
+	fputs(_("     --discard             discard the device before creating the swap area\n"), out);
 	fputs(_(" -f, --force               allow swap size area be larger than device\n"), out);
 	fputs(_(" -q, --quiet               suppress output and warning messages\n"), out);
 	fputs(_(" -p, --pagesize SIZE       specify page size in bytes\n"), out);
@@ -195,33 +210,170 @@ static void page_bad(struct mkswap_control *ctl, unsigned int page)
 	ctl->nbadpages++;
 }
 
+/*
+ * --check: the pages are read in CHECK_BUFSZ blocks, only a block with a
+ * read error is re-read page by page. The area is split into ranges
+ * for --threads, every thread collects bad pages in its range.
+ */
+struct check_range {
+	struct mkswap_control	*ctl;
+	struct check_progress	*progress;
+	int			fd;
+
+	unsigned int		first;		/* first page */
+	unsigned int		last;		/* behind the last page */
+
+	unsigned int		*bad;		/* bad pages */
+	size_t			nbad;
+
+	pthread_t		thread;
+};
+
+struct check_progress {
+	pthread_mutex_t		lock;
+	unsigned long long	done;		/* checked pages */
+	struct timeval		last;		/* last report */
+	unsigned int		enabled : 1;
+};
+
+static void print_progress(struct mkswap_control *ctl, unsigned long long done)
+{
+	printf(_("\rchecked %llu of %llu MiB"),
+		done * ctl->pagesize / (1024 * 1024),
+		ctl->npages * ctl->pagesize / (1024 * 1024));
+	fflush(stdout);
+}
+
+static void check_progress(struct check_range *rg, unsigned int npages)
+{
+	struct check_progress *pr = rg->progress;
+	struct timeval now;
+
+	pthread_mutex_lock(&pr->lock);
+	pr->done += npages;
+	if (pr->enabled) {
+		gettime_monotonic(&now);
+		if (now.tv_sec > pr->last.tv_sec) {
+			print_progress(rg->ctl, pr->done);
+			pr->last = now;
+		}
+	}
+	pthread_mutex_unlock(&pr->lock);
+}
+
+static void *check_range_thread(void *data)
+{
+	struct check_range *rg = data;
+	struct mkswap_control *ctl = rg->ctl;
+	const unsigned long max_badpages =
+		(ctl->pagesize - 1024 - 128 * sizeof(int) - 10) / sizeof(int);
+	size_t bufsz = max((size_t) ctl->pagesize, (size_t) CHECK_BUFSZ);
+	unsigned int page = rg->first;
+	void *buffer;
+
+	/* O_DIRECT needs aligned buffer */
+	if (posix_memalign(&buffer, getpagesize(), bufsz))
+		err(EXIT_FAILURE, _("cannot allocate memory"));
+
+	while (page < rg->last) {
+		unsigned int i, npages = min(rg->last - page,
+					     (unsigned int) (bufsz / ctl->pagesize));
+		off_t offset = (off_t) page * ctl->pagesize;
+		size_t sz = (size_t) npages * ctl->pagesize;
+
+		if (pread(rg->fd, buffer, sz, offset) != (ssize_t) sz) {
+			/* read error, check page by page */
+			for (i = 0; i < npages; i++) {
+				off_t off = (off_t) (page + i) * ctl->pagesize;
+
+				if (pread(rg->fd, buffer, ctl->pagesize, off) == ctl->pagesize)
+					continue;
+				if (rg->nbad > max_badpages)
+					break;		/* too many, page_bad() fails */
+				rg->bad = xrealloc(rg->bad, (rg->nbad + 1) * sizeof(*rg->bad));
+				rg->bad[rg->nbad++] = page + i;
+			}
+		}
+		page += npages;
+		check_progress(rg, npages);
+	}
+
+	free(buffer);
+	return NULL;
+}
+
 static void check_blocks(struct mkswap_control *ctl)
 {
-	unsigned int current_page = 0;
-	int do_seek = 1;
-	char *buffer;
+	struct check_progress progress = { .enabled = 0 };
+	struct check_range *rgs;
+	size_t i, j, nthreads = ctl->nthreads ? ctl->nthreads : 1;
+	unsigned int rgsz;
+	int fd = ctl->fd;
 
 	assert(ctl);
 	assert(ctl->fd > -1);
 
-	buffer = xmalloc(ctl->pagesize);
-	while (current_page < ctl->npages) {
-		ssize_t rc;
-		off_t offset = (off_t) current_page * ctl->pagesize;
+	if (ctl->direct) {
+		fd = open(ctl->devname, O_RDONLY | O_DIRECT | O_CLOEXEC);
+		if (fd < 0) {
+			warn(_("cannot open %s for direct I/O"), ctl->devname);
+			fd = ctl->fd;
+		}
+	}
+
+	if (nthreads > ctl->npages)
+		nthreads = ctl->npages;
+	rgsz = (ctl->npages + nthreads - 1) / nthreads;
+
+	pthread_mutex_init(&progress.lock, NULL);
+	progress.enabled = !ctl->quiet && isatty(STDOUT_FILENO);
+	gettime_monotonic(&progress.last);
+
+	rgs = xcalloc(nthreads, sizeof(*rgs));
+	for (i = 0; i < nthreads; i++) {
+		struct check_range *rg = &rgs[i];
 
-		if (do_seek && lseek(ctl->fd, offset, SEEK_SET) != offset)
-			errx(EXIT_FAILURE, _("seek failed in check_blocks"));
+		rg->ctl = ctl;
+		rg->progress = &progress;
+		rg->fd = fd;
+		rg->first = i * rgsz;
+		rg->last = min((unsigned long long) rg->first + rgsz, ctl->npages);
+	}
+
+	if (nthreads == 1)
+		check_range_thread(&rgs[0]);
+	else {
+		for (i = 0; i < nthreads; i++) {
+			int rc = pthread_create(&rgs[i].thread, NULL,
+						check_range_thread, &rgs[i]);
+			if (rc) {
+				errno = rc;
+				err(EXIT_FAILURE, _("failed to create thread"));
+			}
+		}
+		for (i = 0; i < nthreads; i++)
+			pthread_join(rgs[i].thread, NULL);
+	}
 
-		rc = read(ctl->fd, buffer, ctl->pagesize);
-		do_seek = (rc < 0 || rc != ctl->pagesize);
-		if (do_seek)
-			page_bad(ctl, current_page);
-		current_page++;
+	if (progress.enabled) {
+		print_progress(ctl, progress.done);
+		fputc('\n', stdout);
 	}
+	pthread_mutex_destroy(&progress.lock);
+
+	/* ranges are sorted, so bad pages are in ascending order */
+	for (i = 0; i < nthreads; i++) {
+		for (j = 0; j < rgs[i].nbad; j++)
+			page_bad(ctl, rgs[i].bad[j]);
+		free(rgs[i].bad);
+	}
+	free(rgs);
+
+	if (fd != ctl->fd)
+		close(fd);
 
 	if (!ctl->quiet)
 		printf(P_("%lu bad page\n", "%lu bad pages\n", ctl->nbadpages), ctl->nbadpages);
-	free(buffer);
 }
 
 
@@ -342,6 +494,49 @@ static blkid_probe new_prober(const struct mkswap_control *ctl)
 }
 #endif
 
+/*
+ * --discard: it's faster to discard whole device than to overwrite old data
+ */
+static void discard_device(struct mkswap_control *ctl)
+{
+	uint64_t range[2];
+
+	if (!S_ISBLK(ctl->devstat.st_mode)) {
+		if (!ctl->quiet)
+			warnx(_("warning: discard is supported for block devices only: %s"),
+				ctl->devname);
+		return;
+	}
+
+#ifdef HAVE_LIBBLKID
+	/* the partition table is kept by wipe_device(), but the partitions
+	 * would be discarded */
+	if (!ctl->force) {
+		blkid_probe pr = new_prober(ctl);
+		const char *type = NULL;
+
+		blkid_probe_enable_partitions(pr, 1);
+		blkid_probe_enable_superblocks(pr, 0);
+
+		if (blkid_do_fullprobe(pr) == 0 &&
+		    blkid_probe_lookup_value(pr, "PTTYPE", &type, NULL) == 0 && type)
+			errx(EXIT_FAILURE, _("error: %s contains a %s partition table; "
+					     "will not discard it (use -f to force)"),
+					ctl->devname, type);
+		blkid_free_probe(pr);
+	}
+#endif
+	/* keep the first page, wipe_device() cares about bootbits */
+	range[0] = ctl->pagesize;
+	range[1] = (uint64_t) (ctl->npages - 1) * ctl->pagesize;
+
+	if (ioctl(ctl->fd, BLKDISCARD, &range) != 0) {
+		if (!ctl->quiet)
+			warn(_("%s: BLKDISCARD ioctl failed"), ctl->devname);
+	} else if (ctl->verbose)
+		printf(_("%s: discarded %"PRIu64" bytes\n"), ctl->devname, range[1]);
+}
+
 static void open_device(struct mkswap_control *ctl)
 {
 	assert(ctl);
@@ -469,7 +664,10 @@ int main(int argc, char **argv)
 #endif
 	enum {
 		OPT_LOCK = CHAR_MAX + 1,
-		OPT_VERBOSE
+		OPT_VERBOSE,
+		OPT_THREADS,
+		OPT_DIRECT,
+		OPT_DISCARD
 	};
 	static const struct option longopts[] = {
 		{ "check",       no_argument,       NULL, 'c' },
@@ -483,6 +681,9 @@ int main(int argc, char **argv)
 		{ "help",        no_argument,       NULL, 'h' },
 		{ "lock",        optional_argument, NULL, OPT_LOCK },
 		{ "verbose",    no_argument,        NULL, OPT_VERBOSE },
+		{ "threads",     required_argument, NULL, OPT_THREADS },
+		{ "direct",      no_argument,       NULL, OPT_DIRECT },
+		{ "discard",     no_argument,       NULL, OPT_DISCARD },
 		{ NULL,          0, NULL, 0 }
 	};
 
@@ -545,6 +746,19 @@ int main(int argc, char **argv)
 		case OPT_VERBOSE:
 			ctl.verbose = 1;
 			break;
+		case OPT_THREADS:
+			ctl.nthreads = strtou32_or_err(optarg, _("invalid threads argument"));
+			if (!ctl.nthreads || ctl.nthreads > CHECK_MAX_THREADS)
+				errx(EXIT_FAILURE,
+				     _("number of threads must be in the range 1..%d"),
+				     CHECK_MAX_THREADS);
+			break;
+		case OPT_DIRECT:
+			ctl.direct = 1;
+			break;
+		case OPT_DISCARD:
+			ctl.discard = 1;
+			break;
 		case 'h':
 			usage();
 		default:
@@ -552,6 +766,9 @@ int main(int argc, char **argv)
 		}
 	}
 
+	if (!ctl.check && (ctl.nthreads || ctl.direct))
+		errx(EXIT_FAILURE, _("--threads and --direct require --check"));
+
 	if (optind < argc)
 		ctl.devname = argv[optind++];
 	if (optind < argc)
@@ -627,6 +844,8 @@ int main(int argc, char **argv)
 			ctl.devname, ctl.devstat.st_uid, ctl.devname);
 
 
+	if (ctl.discard)
+		discard_device(&ctl);
 	if (ctl.check)
 		check_blocks(&ctl);
 #ifdef HAVE_LINUX_FIEMAP_H
@@ -38,6 +38,7 @@
 #endif
 #include <libgen.h>
 #include <sys/time.h>
+#include <pthread.h>
 
 #include "c.h"
 #include "xalloc.h"
@@ -51,6 +52,7 @@
 #include "rpmatch.h"
 #include "optutils.h"
 #include "ttyutils.h"
+#include "jsonwrt.h"
 
 #include "libfdisk.h"
 #include "fdisk-list.h"
@@ -90,6 +92,7 @@ enum {
 	ACT_DISKID,
 	ACT_DELETE,
 	ACT_BACKUP_SECTORS,
+	ACT_APPLY_TO,
 };
 
 struct sfdisk {
@@ -120,7 +123,8 @@ struct sfdisk {
 		     movedata: 1,	/* move data after resize */
 		     movefsync: 1,	/* use fsync() after each write() */
 		     notell : 1,	/* don't tell kernel aout new PT */
-		     noact  : 1;	/* do not write to device */
+		     noact  : 1,	/* do not write to device */
+		     applyto : 1;	/* --apply-to, one script for many devices */
 };
 
 #define SFDISK_PROMPT	">>> "
@@ -392,18 +396,133 @@ static int assign_device(struct sfdisk *sf, const char *devname, int rdonly)
 }
 
 
+/*
+ * --move-data copy engine. A reader thread fills MOVE_NBUFS buffers ahead of
+ * the writer (the main thread), so reads and writes overlap. Both sides
+ * process the steps in order and a buffer is reused only after it has been
+ * written, so the copy is as safe for overlapping areas as a sequential copy
+ * in the same direction.
+ */
+#define MOVE_NBUFS	4
+#define MOVE_MAXSTEP	(16 * 1024 * 1024)
+
+struct move_buf {
+	char		*data;
+	int		err;		/* read error (-errno) or 0 */
+};
+
+struct move_ctl {
+	int		fd;
+	uintmax_t	from;		/* source offset in bytes */
+	uintmax_t	to;		/* target offset in bytes */
+	uintmax_t	nbytes;		/* area size in bytes */
+	size_t		step;		/* step size in bytes */
+	size_t		nsteps;
+
+	pthread_mutex_t	lock;
+	pthread_cond_t	cond;
+	size_t		nread;		/* steps read by reader */
+	size_t		nwritten;	/* steps finished by writer */
+
+	struct move_buf	bufs[MOVE_NBUFS];
+
+	unsigned int	backward : 1;
+};
+
+/* returns source and target offsets and length of the step @n */
+static size_t move_get_step(struct move_ctl *mv, size_t n,
+			    uintmax_t *src, uintmax_t *dst)
+{
+	uintmax_t off = (uintmax_t) n * mv->step;
+	size_t len = min((uintmax_t) mv->step, mv->nbytes - off);
+
+	if (mv->backward)
+		off = mv->nbytes - off - len;
+	*src = mv->from + off;
+	*dst = mv->to + off;
+	return len;
+}
+
+static int move_pread(int fd, char *buf, size_t len, uintmax_t off)
+{
+	while (len) {
+		ssize_t ret = pread(fd, buf, len, off);
+
+		if (ret < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			return -errno;
+		}
+		if (ret == 0)
+			return -EIO;
+		buf += ret;
+		len -= ret;
+		off += ret;
+	}
+	return 0;
+}
+
+static int move_pwrite(int fd, const char *buf, size_t len, uintmax_t off)
+{
+	while (len) {
+		ssize_t ret = pwrite(fd, buf, len, off);
+
+		if (ret < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			return -errno;
+		}
+		if (ret == 0)
+			return -EIO;
+		buf += ret;
+		len -= ret;
+		off += ret;
+	}
+	return 0;
+}
+
+static void *move_reader(void *data)
+{
+	struct move_ctl *mv = data;
+	size_t n;
+
+	for (n = 0; n < mv->nsteps; n++) {
+		struct move_buf *b = &mv->bufs[n % MOVE_NBUFS];
+		uintmax_t src, dst;
+		size_t len;
+
+		/* wait until the writer has released the buffer */
+		pthread_mutex_lock(&mv->lock);
+		while (n - mv->nwritten >= MOVE_NBUFS)
+			pthread_cond_wait(&mv->cond, &mv->lock);
+		pthread_mutex_unlock(&mv->lock);
+
+		len = move_get_step(mv, n, &src, &dst);
+		b->err = move_pread(mv->fd, b->data, len, src);
+
+		pthread_mutex_lock(&mv->lock);
+		mv->nread = n + 1;
+		pthread_cond_broadcast(&mv->cond);
+		pthread_mutex_unlock(&mv->lock);
+	}
+	return NULL;
+}
+
 static int move_partition_data(struct sfdisk *sf, size_t partno, struct fdisk_partition *orig_pa)
 {
 	struct fdisk_partition *pa = get_partition(sf->cxt, partno);
-	char *devname = NULL, *typescript = NULL, *buf = NULL;
+	char *devname = NULL, *typescript = NULL;
 	FILE *f = NULL;
-	int ok = 0, fd, backward = 0;
+	int ok = 0, fd, backward = 0, fdflags = -1;
 	fdisk_sector_t nsectors, from, to, step, i, prev;
-	size_t io, ss, step_bytes, cc, ioerr = 0;
-	uintmax_t src, dst, nbytes;
+	size_t io, ss, step_bytes, cc, n, ioerr = 0;
+	uintmax_t nbytes;
 	int progress = 0, rc = 0;
 	struct timeval prev_time;
 	uint64_t bytes_per_sec = 0;
+	struct move_ctl mv = { .fd = -1 };
+	pthread_t reader;
+	int has_reader = 0;
 
 	assert(sf->movedata);
 
@@ -455,15 +574,16 @@ static int move_partition_data(struct sfdisk *sf, size_t partno, struct fdisk_pa
 	else
 		step_bytes = io;
 
-	step = step_bytes / ss;
 	nbytes = nsectors * ss;
 
+	/* use larger steps for large areas, but keep at least ~1024 steps */
+	while (step_bytes * 2 <= MOVE_MAXSTEP && step_bytes * 2 * 1024 <= nbytes)
+		step_bytes *= 2;
+
+	step = step_bytes / ss;
+
 	DBG(MISC, ul_debug(" step: %ju (%zu bytes)", (uintmax_t)step, step_bytes));
 
-#if defined(POSIX_FADV_SEQUENTIAL) && defined(HAVE_POSIX_FADVISE)
-	if (!backward)
-		posix_fadvise(fd, from * ss, nsectors * ss, POSIX_FADV_SEQUENTIAL);
-#endif
 	devname = fdisk_partname(fdisk_get_devname(sf->cxt), partno+1);
 	if (sf->move_typescript)
 		typescript = mk_backup_filename_tpl(sf->move_typescript, devname, ".move");
@@ -521,33 +641,72 @@ static int move_partition_data(struct sfdisk *sf, size_t partno, struct fdisk_pa
 		fprintf(f, "# <step>: <from> <to> (step offsets in bytes)\n");
 	}
 
-	src = (backward ? from + nsectors : from) * ss;
-	dst = (backward ? to + nsectors : to) * ss;
-	buf = xmalloc(step_bytes);
+	mv.fd = fd;
+	mv.from = (uintmax_t) from * ss;
+	mv.to = (uintmax_t) to * ss;
+	mv.nbytes = nbytes;
+	mv.step = step_bytes;
+	mv.nsteps = (nbytes + step_bytes - 1) / step_bytes;
+	mv.backward = backward;
+
+	if (!sf->noact) {
+		struct stat st;
+
+		/* bypass page cache on block devices; the whole area is read
+		 * and written exactly once */
+		if (fstat(fd, &st) == 0 && S_ISBLK(st.st_mode)) {
+			fdflags = fcntl(fd, F_GETFL);
+			if (fdflags != -1 && fcntl(fd, F_SETFL, fdflags | O_DIRECT) != 0)
+				fdflags = -1;
+		}
+		DBG(MISC, ul_debug(" direct I/O: %s", fdflags != -1 ? "yes" : "no"));
+#if defined(POSIX_FADV_SEQUENTIAL) && defined(HAVE_POSIX_FADVISE)
+		if (fdflags == -1 && !backward)
+			posix_fadvise(fd, from * ss, nsectors * ss, POSIX_FADV_SEQUENTIAL);
+#endif
+		for (n = 0; n < MOVE_NBUFS; n++) {
+			void *p;
+
+			if (posix_memalign(&p, max((size_t) getpagesize(), ss), step_bytes))
+				err(EXIT_FAILURE, _("cannot allocate %zu bytes"), step_bytes);
+			mv.bufs[n].data = p;
+		}
+
+		pthread_mutex_init(&mv.lock, NULL);
+		pthread_cond_init(&mv.cond, NULL);
+
+		rc = pthread_create(&reader, NULL, move_reader, &mv);
+		if (rc) {
+			errno = rc;
+			err(EXIT_FAILURE, _("failed to create thread"));
+		}
+		has_reader = 1;
+	}
 
-	DBG(MISC, ul_debug(" initial: src=%ju dst=%ju", src, dst));
+	DBG(MISC, ul_debug(" initial: src=%ju dst=%ju steps=%zu",
+				mv.from, mv.to, mv.nsteps));
 
 	gettimeofday(&prev_time, NULL);
 	prev = 0;
 
-	for (cc = 1, i = 0; i < nsectors && nbytes > 0; i += step, cc++) {
-
-		if (nbytes < step_bytes) {
-			DBG(MISC, ul_debug("aligning step #%05zu from %ju to %ju",
-						cc, step_bytes, nbytes));
-			step_bytes = nbytes;
-		}
-		nbytes -= step_bytes;
+	for (cc = 1, n = 0; n < mv.nsteps; n++, cc++) {
+		struct move_buf *b = &mv.bufs[n % MOVE_NBUFS];
+		uintmax_t src, dst;
+		size_t len;
 
-		if (backward)
-			src -= step_bytes, dst -= step_bytes;
+		i = (fdisk_sector_t) n * step;
+		len = move_get_step(&mv, n, &src, &dst);
 
-		DBG(MISC, ul_debug("#%05zu: src=%ju dst=%ju", cc, src, dst));
+		DBG(MISC, ul_debug("#%05zu: src=%ju dst=%ju len=%zu", cc, src, dst, len));
 
 		if (!sf->noact) {
-			/* read source */
-			if (lseek(fd, src, SEEK_SET) == (off_t) -1 ||
-			    read_all(fd, buf, step_bytes) != (ssize_t) step_bytes) {
+			/* wait for the reader */
+			pthread_mutex_lock(&mv.lock);
+			while (mv.nread <= n)
+				pthread_cond_wait(&mv.cond, &mv.lock);
+			pthread_mutex_unlock(&mv.lock);
+
+			if (b->err) {
 				if (f)
 					fprintf(f, "%05zu: read error %12ju %12ju\n", cc, src, dst);
 				fdisk_warn(sf->cxt,
@@ -557,8 +716,7 @@ static int move_partition_data(struct sfdisk *sf, size_t partno, struct fdisk_pa
 			}
 
 			/* write target */
-			if (lseek(fd, dst, SEEK_SET) == (off_t) -1 ||
-			    write_all(fd, buf, step_bytes) != 0) {
+			if (move_pwrite(fd, b->data, len, dst) != 0) {
 				if (f)
 					fprintf(f, "%05zu: write error %12ju %12ju\n", cc, src, dst);
 				fdisk_warn(sf->cxt,
@@ -604,8 +762,21 @@ static int move_partition_data(struct sfdisk *sf, size_t partno, struct fdisk_pa
 
 		}
 next:
-		if (!backward)
-			src += step_bytes, dst += step_bytes;
+		if (has_reader) {
+			/* release the buffer */
+			pthread_mutex_lock(&mv.lock);
+			mv.nwritten = n + 1;
+			pthread_cond_broadcast(&mv.cond);
+			pthread_mutex_unlock(&mv.lock);
+		}
+	}
+
+	if (has_reader) {
+		pthread_join(reader, NULL);
+		if (fdflags != -1)
+			fcntl(fd, F_SETFL, fdflags);
+		if (fsync(fd) != 0 && !ioerr)
+			rc = -errno;
 	}
 
 	if (progress) {
@@ -615,21 +786,22 @@ next:
 		fflush(stdout);
 		fputc('\r', stdout);
 
-		if (i > nsectors)
-			/* see for() above; @i has to be greater than @nsectors
-			 * on success due to i += step */
-			i = nsectors;
+		i = nsectors;
 
 		fprintf(stdout, _("Moved %ju from %ju sectors (%.0f%%)."),
 				i, nsectors,
 				100.0 / ((double) nsectors/(i+1)));
 		fputc('\n', stdout);
 	}
-	rc = 0;
 done:
 	if (f)
 		fclose(f);
-	free(buf);
+	if (has_reader) {
+		pthread_mutex_destroy(&mv.lock);
+		pthread_cond_destroy(&mv.cond);
+	}
+	for (n = 0; n < MOVE_NBUFS; n++)
+		free(mv.bufs[n].data);
 	free(typescript);
 
 	if (sf->noact)
@@ -676,24 +848,63 @@ static int write_changes(struct sfdisk *sf)
 	return rc;
 }
 
+/* --list --json, print the device dump as an item of the "partitiontables" array */
+static int list_json_device(struct fdisk_context *cxt,
+			    size_t idx __attribute__((__unused__)),
+			    void *data)
+{
+	struct ul_jsonwrt *json = (struct ul_jsonwrt *) data;
+	struct fdisk_script *dp;
+
+	if (!fdisk_has_label(cxt))
+		return 0;
+
+	dp = fdisk_new_script(cxt);
+	if (!dp)
+		err(EXIT_FAILURE, _("failed to allocate dump struct"));
+
+	if (fdisk_script_read_context(dp, NULL) != 0) {
+		warnx(_("%s: failed to dump partition table"), fdisk_get_devname(cxt));
+		fdisk_unref_script(dp);
+		return -1;
+	}
+	fdisk_script_enable_json(dp, 1);
+
+	ul_jsonwrt_object_open(json, NULL);
+	fdisk_script_set_json_indent(dp, json->indent);
+	fdisk_script_write_file(dp, stdout);
+	ul_jsonwrt_object_close(json);
+
+	fdisk_unref_script(dp);
+	return 0;
+}
+
 /*
  * sfdisk --list [<device ..]
  */
 static int command_list_partitions(struct sfdisk *sf, int argc, char **argv)
 {
-	int fail = 0;
-	fdisk_enable_listonly(sf->cxt, 1);
+	int fail;
 
-	if (argc) {
-		int i;
+	fdisk_enable_listonly(sf->cxt, 1);
 
-		for (i = 0; i < argc; i++)
-			if (print_device_pt(sf->cxt, argv[i], 1, sf->verify, i) != 0)
-				fail++;
-	} else
-		print_all_devices_pt(sf->cxt, sf->verify);
+	if (!sf->json)
+		fail = print_devices_pt(sf->cxt, argc ? argv : NULL, argc,
+					argc > 0, sf->verify);
+	else {
+		struct ul_jsonwrt json;
+
+		ul_jsonwrt_init(&json, stdout, 0);
+		ul_jsonwrt_root_open(&json);
+		ul_jsonwrt_array_open(&json, "partitiontables");
+		fail = list_devices(sf->cxt, argc ? argv : NULL, argc, argc > 0,
+				    list_json_device, &json);
+		ul_jsonwrt_array_close(&json);
+		ul_jsonwrt_root_close(&json);
+	}
 
-	return fail;
+	/* ignore devices from /proc/partitions we cannot open */
+	return argc ? fail : 0;
 }
 
 /*
@@ -2030,6 +2241,319 @@ static int command_fdisk(struct sfdisk *sf, int argc, char **argv)
 	return rc;
 }
 
+/*
+ * sfdisk --apply-to <dev> [<dev> ...]
+ *
+ * The script is read from stdin only once, then every device is partitioned
+ * by a worker thread with its own libfdisk context. Every worker parses the
+ * in-memory copy of the script for its device -- sizes are converted to
+ * sectors according to the device sector size, and libfdisk script objects
+ * are not thread-safe.
+ */
+#define APPLY_MAX_THREADS	32
+
+struct apply_dev {
+	const char	*devname;
+	int		rc;		/* 0 or -errno */
+	const char	*errmsg;	/* failed operation */
+	char		*label;		/* new disklabel type */
+	char		*id;		/* new disklabel identifier */
+	size_t		nparts;		/* partitions in the new disklabel */
+	const char	*reread;	/* how the kernel has been informed */
+};
+
+struct apply_ctl {
+	struct sfdisk	*sf;
+	char		*script;	/* script text from stdin */
+	size_t		scriptsz;
+
+	struct apply_dev *devs;
+	size_t		ndevs;
+	size_t		next;		/* next device to process */
+	pthread_mutex_t	lock;
+};
+
+static void apply_to_device(struct apply_ctl *ap, struct apply_dev *ad)
+{
+	struct sfdisk *sf = ap->sf;
+	struct fdisk_context *cxt;
+	struct fdisk_script *dp = NULL;
+	struct fdisk_table *org = NULL, *tb = NULL;
+	struct fdisk_partition *pa;
+	struct fdisk_iter *itr = NULL;
+	FILE *f = NULL;
+	int rc, used = 0, dowipe;
+
+	cxt = fdisk_new_context();
+	if (!cxt) {
+		rc = -ENOMEM;
+		ad->errmsg = _("failed to allocate libfdisk context");
+		goto done;
+	}
+
+	rc = fdisk_assign_device(cxt, ad->devname, 0);
+	if (rc) {
+		ad->errmsg = _("cannot open device");
+		goto done;
+	}
+	if (blkdev_lock(fdisk_get_devfd(cxt), ad->devname, sf->lockmode) != 0) {
+		rc = -EBUSY;
+		ad->errmsg = _("cannot lock device");
+		goto done;
+	}
+	if (!sf->noact && !sf->noreread && fdisk_device_is_used(cxt)) {
+		used = 1;
+		if (!sf->force) {
+			rc = -EBUSY;
+			ad->errmsg = _("device is in use");
+			goto done;
+		}
+	}
+
+	/* the old layout, used to update the kernel by BLKPG ioctls */
+	if (fdisk_has_label(cxt))
+		rc = fdisk_get_partitions(cxt, &org);
+	else {
+		org = fdisk_new_table();
+		rc = org ? 0 : -ENOMEM;
+	}
+	if (rc) {
+		ad->errmsg = _("cannot read partition table");
+		goto done;
+	}
+
+	f = fmemopen(ap->script, ap->scriptsz, "r");
+	dp = fdisk_new_script(cxt);
+	if (!f || !dp) {
+		rc = -ENOMEM;
+		ad->errmsg = _("failed to allocate script handler");
+		goto done;
+	}
+	rc = fdisk_script_read_file(dp, f);
+	if (rc) {
+		ad->errmsg = _("failed to parse script");
+		goto done;
+	}
+
+	if (sf->label)
+		rc = fdisk_script_set_header(dp, "label", sf->label);
+	else if (!fdisk_script_get_header(dp, "label"))
+		rc = fdisk_script_set_header(dp, "label", fdisk_has_label(cxt) ?
+				fdisk_label_get_name(fdisk_get_label(cxt, NULL)) :
+				"dos");
+	if (rc) {
+		ad->errmsg = _("failed to set script header");
+		goto done;
+	}
+
+	/* identifiers have to be unique, generate new ones for every device */
+	fdisk_script_set_header(dp, "label-id", NULL);
+	itr = fdisk_new_iter(FDISK_ITER_FORWARD);
+	while (itr && fdisk_table_next_partition(fdisk_script_get_table(dp), itr, &pa) == 0)
+		fdisk_partition_set_uuid(pa, NULL);
+
+	dowipe = sf->wipemode == WIPEMODE_ALWAYS ||
+		 (fdisk_is_ptcollision(cxt) && sf->wipemode != WIPEMODE_NEVER);
+	fdisk_enable_wipe(cxt, dowipe);
+
+	rc = fdisk_apply_script(cxt, dp);
+	if (rc) {
+		ad->errmsg = _("failed to apply script");
+		goto done;
+	}
+
+	if (fdisk_get_label(cxt, NULL))
+		ad->label = xstrdup(fdisk_label_get_name(fdisk_get_label(cxt, NULL)));
+	fdisk_get_disklabel_id(cxt, &ad->id);
+	if (fdisk_get_partitions(cxt, &tb) == 0)
+		ad->nparts = fdisk_table_get_nents(tb);
+
+	if (!sf->noact) {
+		rc = fdisk_write_disklabel(cxt);
+		if (rc) {
+			ad->errmsg = _("failed to write disklabel");
+			goto done;
+		}
+		if (!sf->notell && !fdisk_is_regfile(cxt)) {
+			/* BLKRRPART does not work for used devices, update
+			 * the changed partitions only (like partx(8)) */
+			if (!used && fdisk_reread_partition_table(cxt) == 0)
+				ad->reread = "ioctl";
+			else if (fdisk_reread_changes(cxt, org) == 0)
+				ad->reread = "blkpg";
+			else
+				ad->reread = "failed";
+		}
+	}
+
+	rc = fdisk_deassign_device(cxt, sf->noact || sf->notell);
+	if (rc)
+		ad->errmsg = _("failed to close device");
+done:
+	if (f)
+		fclose(f);
+	fdisk_free_iter(itr);
+	fdisk_unref_table(tb);
+	fdisk_unref_table(org);
+	if (dp) {
+		fdisk_set_script(cxt, NULL);
+		fdisk_unref_script(dp);
+	}
+	fdisk_unref_context(cxt);
+	ad->rc = rc;
+}
+
+static void *apply_worker(void *data)
+{
+	struct apply_ctl *ap = data;
+
+	do {
+		struct apply_dev *ad = NULL;
+
+		pthread_mutex_lock(&ap->lock);
+		if (ap->next < ap->ndevs)
+			ad = &ap->devs[ap->next++];
+		pthread_mutex_unlock(&ap->lock);
+
+		if (!ad)
+			break;
+		DBG(MISC, ul_debug("applying script to %s", ad->devname));
+		apply_to_device(ap, ad);
+	} while (1);
+
+	return NULL;
+}
+
+static void apply_print_json(struct apply_ctl *ap)
+{
+	struct ul_jsonwrt json;
+	size_t i;
+
+	ul_jsonwrt_init(&json, stdout, 0);
+	ul_jsonwrt_root_open(&json);
+	ul_jsonwrt_array_open(&json, "devices");
+
+	for (i = 0; i < ap->ndevs; i++) {
+		struct apply_dev *ad = &ap->devs[i];
+
+		ul_jsonwrt_object_open(&json, NULL);
+		ul_jsonwrt_value_s(&json, "device", ad->devname);
+		ul_jsonwrt_value_s(&json, "status", ad->rc ? "failed" : "ok");
+		if (ad->rc) {
+			char *msg = NULL;
+
+			xasprintf(&msg, "%s: %s", ad->errmsg, strerror(-ad->rc));
+			ul_jsonwrt_value_s(&json, "error", msg);
+			free(msg);
+		} else
+			ul_jsonwrt_value_null(&json, "error");
+		ul_jsonwrt_value_s(&json, "label", ad->label);
+		ul_jsonwrt_value_s(&json, "id", ad->id);
+		ul_jsonwrt_value_u64(&json, "partitions", ad->nparts);
+		ul_jsonwrt_value_s(&json, "reread", ad->reread);
+		ul_jsonwrt_object_close(&json);
+	}
+
+	ul_jsonwrt_array_close(&json);
+	ul_jsonwrt_root_close(&json);
+}
+
+static int command_apply_to(struct sfdisk *sf, int argc, char **argv)
+{
+	struct apply_ctl ap = { .sf = sf };
+	pthread_t *threads;
+	size_t i, nthreads, bufsz = 0;
+	int rc, nfails = 0;
+
+	if (!argc)
+		errx(EXIT_FAILURE, _("no disk device specified"));
+	if (sf->partno >= 0 || sf->append || sf->backup || sf->label_nested)
+		errx(EXIT_FAILURE, _("--apply-to cannot be used with -N, --append, "
+				     "--backup or --label-nested"));
+	if (isatty(STDIN_FILENO))
+		errx(EXIT_FAILURE, _("--apply-to requires a script on standard input"));
+
+	/* read the script */
+	do {
+		size_t n;
+
+		if (ap.scriptsz + BUFSIZ > bufsz) {
+			bufsz += BUFSIZ * 4;
+			ap.script = xrealloc(ap.script, bufsz);
+		}
+		n = fread(ap.script + ap.scriptsz, 1, bufsz - ap.scriptsz, stdin);
+		ap.scriptsz += n;
+		if (n == 0)
+			break;
+	} while (1);
+
+	if (ferror(stdin))
+		err(EXIT_FAILURE, _("cannot read script"));
+	if (!ap.scriptsz)
+		errx(EXIT_FAILURE, _("empty script"));
+
+	ap.ndevs = argc;
+	ap.devs = xcalloc(ap.ndevs, sizeof(struct apply_dev));
+	for (i = 0; i < ap.ndevs; i++)
+		ap.devs[i].devname = argv[i];
+
+	nthreads = min(ap.ndevs, (size_t) APPLY_MAX_THREADS);
+	threads = xcalloc(nthreads, sizeof(pthread_t));
+	pthread_mutex_init(&ap.lock, NULL);
+
+	for (i = 0; i < nthreads; i++) {
+		rc = pthread_create(&threads[i], NULL, apply_worker, &ap);
+		if (rc) {
+			errno = rc;
+			err(EXIT_FAILURE, _("failed to create thread"));
+		}
+	}
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+
+	pthread_mutex_destroy(&ap.lock);
+	free(threads);
+
+	for (i = 0; i < ap.ndevs; i++) {
+		if (ap.devs[i].rc)
+			nfails++;
+	}
+
+	if (sf->json)
+		apply_print_json(&ap);
+	else {
+		for (i = 0; i < ap.ndevs; i++) {
+			struct apply_dev *ad = &ap.devs[i];
+
+			if (ad->rc)
+				warnx("%s: %s: %s", ad->devname, ad->errmsg, strerror(-ad->rc));
+			else if (sf->quiet)
+				;
+			else if (sf->noact)
+				printf(P_("%s: would create %s disklabel with %zu partition\n",
+					  "%s: would create %s disklabel with %zu partitions\n",
+					  ad->nparts),
+					ad->devname, ad->label, ad->nparts);
+			else
+				printf(P_("%s: created %s disklabel with %zu partition\n",
+					  "%s: created %s disklabel with %zu partitions\n",
+					  ad->nparts),
+					ad->devname, ad->label, ad->nparts);
+		}
+		if (sf->noact && !sf->quiet)
+			fdisk_info(sf->cxt, _("The partition tables are unchanged (--no-act)."));
+	}
+
+	for (i = 0; i < ap.ndevs; i++) {
+		free(ap.devs[i].label);
+		free(ap.devs[i].id);
+	}
+	free(ap.devs);
+	free(ap.script);
+
+	return nfails ? -EIO : 0;
+}
+
 static void __attribute__((__noreturn__)) usage(void)
 {
 	FILE *out = stdout;
@@ -2065,6 +2589,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(USAGE_SEPARATOR, out);
 	fputs(_(" --disk-id <dev> [<str>]           print or change disk label ID (UUID)\n"), out);
 	fputs(_(" --relocate <oper> <dev>           move partition header\n"), out);
+	fputs(_(" --apply-to <dev> [<dev> ...]      apply script from stdin to all devices in parallel\n"), out);
 
 	fputs(USAGE_ARGUMENTS, out);
 	fputs(_(" <dev>                     device (usually disk) path\n"), out);
@@ -2144,11 +2669,13 @@ int main(int argc, char *argv[])
 		OPT_NOTELL,
 		OPT_RELOCATE,
 		OPT_LOCK,
+		OPT_APPLYTO,
 	};
 
 	static const struct option longopts[] = {
 		{ "activate",no_argument,	NULL, 'A' },
 		{ "append",  no_argument,       NULL, 'a' },
+		{ "apply-to", no_argument,	NULL, OPT_APPLYTO },
 		{ "backup-pt-sectors", no_argument,   NULL, 'B' },
 		{ "backup",  no_argument,       NULL, 'b' },
 		{ "backup-file", required_argument, NULL, 'O' },
@@ -2245,6 +2772,8 @@ int main(int argc, char *argv[])
 			break;
 		case 'J':
 			sf->json = 1;
+			if (sf->act == ACT_LIST)
+				break;		/* --list --json */
 			/* fallthrough */
 		case 'd':
 			sf->act = ACT_DUMP;
@@ -2364,6 +2893,9 @@ int main(int argc, char *argv[])
 		case OPT_RELOCATE:
 			sf->act = ACT_RELOCATE;
 			break;
+		case OPT_APPLYTO:
+			sf->applyto = 1;
+			break;
 		case OPT_LOCK:
 			sf->lockmode = "1";
 			if (optarg) {
@@ -2386,7 +2918,12 @@ int main(int argc, char *argv[])
 	if (outarg)
 		init_fields(NULL, outarg, NULL);
 
-	if (sf->verify && !sf->act)
+	if (sf->applyto) {
+		/* -J means JSON output here */
+		if (sf->act && !(sf->act == ACT_DUMP && sf->json))
+			errx(EXIT_FAILURE, _("--apply-to cannot be combined with another command"));
+		sf->act = ACT_APPLY_TO;
+	} else if (sf->verify && !sf->act)
 		sf->act = ACT_VERIFY;	/* --verify make be used with --list too */
 	else if (!sf->act)
 		sf->act = ACT_FDISK;	/* default */
@@ -2423,6 +2960,10 @@ int main(int argc, char *argv[])
 		rc = command_fdisk(sf, argc - optind, argv + optind);
 		break;
 
+	case ACT_APPLY_TO:
+		rc = command_apply_to(sf, argc - optind, argv + optind);
+		break;
+
 	case ACT_DUMP:
 		rc = command_dump(sf, argc - optind, argv + optind);
 		break;
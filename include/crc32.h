@@ -8,5 +8,8 @@ extern uint32_t ul_crc32(uint32_t seed, const unsigned char *buf, size_t len);
 extern uint32_t ul_crc32_exclude_offset(uint32_t seed, const unsigned char *buf, size_t len,
 		                              size_t exclude_off, size_t exclude_len);
 
+/* table-driven implementation without CPU dispatch, for tests */
+extern uint32_t ul_crc32_portable(uint32_t seed, const unsigned char *buf, size_t len);
+
 #endif
 
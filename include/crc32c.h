@@ -6,4 +6,7 @@
 
 extern uint32_t crc32c(uint32_t crc, const void *buf, size_t size);
 
+/* table-driven implementation without CPU dispatch, for tests */
+extern uint32_t crc32c_portable(uint32_t crc, const void *buf, size_t size);
+
 #endif /* UL_NG_CRC32C_H */
@@ -101,6 +101,11 @@ enum {
 	LOOPITER_FL_USED	= (1 << 1)
 };
 
+/*
+ * index of the used loop devices (see loopdev_new_index())
+ */
+struct loopdev_index;
+
 /*
  * handler for work with loop devices
  */
@@ -108,6 +113,7 @@ struct loopdev_cxt {
 	char		device[128];	/* device path (e.g. /dev/loop<N>) */
 	char		*filename;	/* backing file for loopcxt_set_... */
 	int		fd;		/* open(/dev/looo<N>) */
+	int		ctl_fd;		/* open(/dev/loop-control), kept open */
 	int		mode;		/* fd mode O_{RDONLY,RDWR} */
 	uint64_t	blocksize;	/* used by loopcxt_setup_device() */
 
@@ -120,9 +126,10 @@ struct loopdev_cxt {
 	struct path_cxt		*sysfs; /* pointer to /sys/dev/block/<maj:min>/ */
 	struct loop_config 	config;	/* for GET/SET ioctl */
 	struct loopdev_iter	iter;	/* scans /sys or /dev for used/free devices */
+	struct loopdev_index	*index;	/* used devices, see loopcxt_set_index() */
 };
 
-#define UL_LOOPDEVCXT_EMPTY { .fd = -1  }
+#define UL_LOOPDEVCXT_EMPTY { .fd = -1, .ctl_fd = -1 }
 
 /*
  * loopdev_cxt.flags
@@ -156,6 +163,10 @@ extern int loopcxt_find_unused(struct loopdev_cxt *lc);
 extern int loopdev_delete(const char *device);
 extern int loopdev_count_by_backing_file(const char *filename, char **loopdev);
 
+extern struct loopdev_index *loopdev_new_index(void);
+extern void loopdev_ref_index(struct loopdev_index *idx);
+extern void loopdev_unref_index(struct loopdev_index *idx);
+
 /*
  * Low-level
  */
@@ -173,6 +184,7 @@ extern struct loop_info64 *loopcxt_get_info(struct loopdev_cxt *lc);
 
 extern int loopcxt_get_fd(struct loopdev_cxt *lc);
 extern int loopcxt_set_fd(struct loopdev_cxt *lc, int fd, int mode);
+extern int loopcxt_set_index(struct loopdev_cxt *lc, struct loopdev_index *idx);
 
 extern int loopcxt_init_iterator(struct loopdev_cxt *lc, int flags);
 extern int loopcxt_deinit_iterator(struct loopdev_cxt *lc);
@@ -211,6 +223,8 @@ extern int loopcxt_find_by_backing_file(struct loopdev_cxt *lc,
 extern int loopcxt_find_overlap(struct loopdev_cxt *lc,
 				const char *filename,
 				uint64_t offset, uint64_t sizelimit);
+extern int loopcxt_count_by_backing_file(struct loopdev_cxt *lc,
+				const char *filename, char **loopdev);
 
 extern int loopcxt_is_used(struct loopdev_cxt *lc,
                     struct stat *st,
@@ -21,6 +21,8 @@ struct path_cxt {
 	void	*dialect;
 	void	(*free_dialect)(struct path_cxt *);
 	int	(*redirect_on_enoent)(struct path_cxt *, const char *, int *);
+
+	struct path_cache *cache;	/* see ul_path_enable_cache() */
 };
 
 struct path_cxt *ul_new_path(const char *dir, ...)
@@ -40,6 +42,7 @@ int ul_path_set_dialect(struct path_cxt *pc, void *data, void free_data(struct p
 void *ul_path_get_dialect(struct path_cxt *pc);
 
 int ul_path_set_enoent_redirect(struct path_cxt *pc, int (*func)(struct path_cxt *, const char *, int *));
+int ul_path_enable_cache(struct path_cxt *pc, int enable);
 int ul_path_get_dirfd(struct path_cxt *pc);
 void ul_path_close_dirfd(struct path_cxt *pc);
 int ul_path_isopen_dirfd(struct path_cxt *pc);
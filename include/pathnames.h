@@ -84,6 +84,9 @@
 
 #define _PATH_SD_UNITSLOAD	_PATH_RUNSTATEDIR "/systemd/systemd-units-load"
 
+#define _PATH_LSBLK_CACHE	_PATH_RUNSTATEDIR "/lsblk-cache"
+#define _PATH_UDEV_DATADIR	_PATH_RUNSTATEDIR "/udev/data"
+
 /* misc paths */
 #define _PATH_WORDS             "/usr/share/dict/words"
 #define _PATH_WORDS_ALT         "/usr/share/dict/web2"
@@ -122,6 +125,7 @@
 
 #define _PATH_SYS_SELINUX	"/sys/fs/selinux"
 #define _PATH_SYS_APPARMOR	"/sys/kernel/security/apparmor"
+#define _PATH_SYS_UEVENT_SEQNUM	"/sys/kernel/uevent_seqnum"
 
 #ifndef _PATH_MOUNTED
 # ifdef MOUNTED					/* deprecated */
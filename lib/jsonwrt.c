@@ -107,6 +107,16 @@ void ul_jsonwrt_init(struct ul_jsonwrt *fmt, FILE *out, int indent)
 	fmt->out = out;
 	fmt->indent = indent;
 	fmt->after_close = 0;
+	fmt->compact = 0;
+}
+
+/*
+ * Compact mode writes the whole root object on one line terminated by '\n',
+ * it's usable for JSON Lines (one object per record) output.
+ */
+void ul_jsonwrt_set_compact(struct ul_jsonwrt *fmt, int enable)
+{
+	fmt->compact = enable ? 1 : 0;
 }
 
 int ul_jsonwrt_is_ready(struct ul_jsonwrt *fmt)
@@ -118,6 +128,8 @@ void ul_jsonwrt_indent(struct ul_jsonwrt *fmt)
 {
 	int i;
 
+	if (fmt->compact)
+		return;
 	for (i = 0; i < fmt->indent; i++)
 		fputs("   ", fmt->out);
 }
@@ -126,7 +138,7 @@ void ul_jsonwrt_open(struct ul_jsonwrt *fmt, const char *name, int type)
 {
 	if (name) {
 		if (fmt->after_close)
-			fputs(",\n", fmt->out);
+			fputs(fmt->compact ? "," : ",\n", fmt->out);
 		ul_jsonwrt_indent(fmt);
 		fputs_quoted_json_lower(name, fmt->out);
 	} else {
@@ -136,6 +148,25 @@ void ul_jsonwrt_open(struct ul_jsonwrt *fmt, const char *name, int type)
 			ul_jsonwrt_indent(fmt);
 	}
 
+	if (fmt->compact) {
+		switch (type) {
+		case UL_JSON_OBJECT:
+			fputs(name ? ":{" : "{", fmt->out);
+			fmt->indent++;
+			break;
+		case UL_JSON_ARRAY:
+			fputs(name ? ":[" : "[", fmt->out);
+			fmt->indent++;
+			break;
+		case UL_JSON_VALUE:
+			if (name)
+				fputc(':', fmt->out);
+			break;
+		}
+		fmt->after_close = 0;
+		return;
+	}
+
 	switch (type) {
 	case UL_JSON_OBJECT:
 		fputs(name ? ": {\n" : "{\n", fmt->out);
@@ -154,8 +185,9 @@ void ul_jsonwrt_open(struct ul_jsonwrt *fmt, const char *name, int type)
 
 void ul_jsonwrt_close(struct ul_jsonwrt *fmt, int type)
 {
-	if (fmt->indent == 1) {
-		fputs("\n}\n", fmt->out);
+	/* in compact mode, values directly in the root object do not close it */
+	if (fmt->indent == 1 && !(fmt->compact && type == UL_JSON_VALUE)) {
+		fputs(fmt->compact ? "}\n" : "\n}\n", fmt->out);
 		fmt->indent--;
 		fmt->after_close = 1;
 		return;
@@ -165,13 +197,15 @@ void ul_jsonwrt_close(struct ul_jsonwrt *fmt, int type)
 	switch (type) {
 	case UL_JSON_OBJECT:
 		fmt->indent--;
-		fputc('\n', fmt->out);
+		if (!fmt->compact)
+			fputc('\n', fmt->out);
 		ul_jsonwrt_indent(fmt);
 		fputs("}", fmt->out);
 		break;
 	case UL_JSON_ARRAY:
 		fmt->indent--;
-		fputc('\n', fmt->out);
+		if (!fmt->compact)
+			fputc('\n', fmt->out);
 		ul_jsonwrt_indent(fmt);
 		fputs("]", fmt->out);
 		break;
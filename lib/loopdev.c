@@ -235,6 +235,13 @@ void loopcxt_deinit(struct loopdev_cxt *lc)
 	ignore_result( loopcxt_set_device(lc, NULL) );
 	loopcxt_deinit_iterator(lc);
 
+	if (lc->ctl_fd >= 0)
+		close(lc->ctl_fd);
+	lc->ctl_fd = -1;
+
+	loopdev_unref_index(lc->index);
+	lc->index = NULL;
+
 	errno = errsv;
 }
 
@@ -1569,6 +1576,20 @@ int loopcxt_delete_device(struct loopdev_cxt *lc)
 	return 0;
 }
 
+/*
+ * Returns file descriptor for /dev/loop-control. The descriptor is kept open
+ * in the context (until loopcxt_deinit()), so callers that set up many devices
+ * do not need to re-open the control device for each of them.
+ */
+static int loopcxt_get_ctl_fd(struct loopdev_cxt *lc)
+{
+	if (lc->ctl_fd < 0) {
+		lc->ctl_fd = open(_PATH_DEV_LOOPCTL, O_RDWR|O_CLOEXEC);
+		DBG(CXT, ul_debugobj(lc, "open loop-control [fd=%d]", lc->ctl_fd));
+	}
+	return lc->ctl_fd;
+}
+
 int loopcxt_add_device(struct loopdev_cxt *lc)
 {
 	int rc = -EINVAL;
@@ -1588,11 +1609,10 @@ int loopcxt_add_device(struct loopdev_cxt *lc)
 	       || nr < 0)
 		goto done;
 
-	ctl = open(_PATH_DEV_LOOPCTL, O_RDWR|O_CLOEXEC);
+	ctl = loopcxt_get_ctl_fd(lc);
 	if (ctl >= 0) {
 		DBG(CXT, ul_debugobj(lc, "add_device %d", nr));
 		rc = ioctl(ctl, LOOP_CTL_ADD, nr);
-		close(ctl);
 	}
 	lc->control_ok = rc >= 0 ? 1 : 0;
 done:
@@ -1617,7 +1637,7 @@ int loopcxt_find_unused(struct loopdev_cxt *lc)
 
 		DBG(CXT, ul_debugobj(lc, "using loop-control"));
 
-		ctl = open(_PATH_DEV_LOOPCTL, O_RDWR|O_CLOEXEC);
+		ctl = loopcxt_get_ctl_fd(lc);
 		if (ctl >= 0)
 			rc = ioctl(ctl, LOOP_CTL_GET_FREE);
 		if (rc >= 0) {
@@ -1627,8 +1647,6 @@ int loopcxt_find_unused(struct loopdev_cxt *lc)
 			rc = loopiter_set_device(lc, name);
 		}
 		lc->control_ok = ctl >= 0 && rc == 0 ? 1 : 0;
-		if (ctl >= 0)
-			close(ctl);
 		DBG(CXT, ul_debugobj(lc, "find_unused by loop-control [rc=%d]", rc));
 	}
 
@@ -1738,12 +1756,251 @@ int loopdev_delete(const char *device)
 	return rc;
 }
 
+/*
+ * Index of the used loop devices
+ *
+ * The index is built by one scan of the used loop devices and it is used by
+ * loopcxt_find_by_backing_file(), loopcxt_find_overlap() and
+ * loopcxt_count_by_backing_file(). The scan reads the backing file, offset
+ * and sizelimit from /sys and it does not open the devices. The backing file
+ * inode is compared by stat() of the file name from /sys; LOOP_GET_STATUS64
+ * (and so open of the device) is used only if the name is not accessible,
+ * for example for deleted files or files from another mount namespace.
+ *
+ * The contexts without index (see loopcxt_set_index()) use a temporary index
+ * for one lookup. The index set by loopcxt_set_index() is shared by all the
+ * lookups in the context. The kernel generates uevent when a loop device is
+ * attached, detached or resized, so the index is re-scanned when the uevent
+ * sequence number is changed. Without the sequence number the index is
+ * re-scanned on each use.
+ *
+ * The index lives in the process memory only, other processes scan the
+ * devices again.
+ */
+struct loopdev_entry {
+	char		*device;	/* /dev/loop<N> */
+	char		*backing_file;
+	dev_t		backing_devno;
+	ino_t		backing_ino;
+	uint64_t	offset;
+	uint64_t	sizelimit;
+
+	unsigned int	has_inode : 1,	/* backing_{devno,ino} are valid */
+			inode_read : 1,	/* LOOP_GET_STATUS64 already used */
+			has_offset : 1,
+			has_sizelimit : 1;
+};
+
+struct loopdev_index {
+	int		refcount;
+	uint64_t	seqnum;		/* uevent sequence number of the scan */
+
+	struct loopdev_entry *ents;
+	size_t		nents;
+
+	unsigned int	scanned : 1;	/* ents[] are valid */
+};
+
+/*
+ * Returns a new empty index, the devices are scanned on the first use.
+ */
+struct loopdev_index *loopdev_new_index(void)
+{
+	struct loopdev_index *idx = calloc(1, sizeof(*idx));
+
+	if (!idx)
+		return NULL;
+
+	loopdev_init_debug();
+	DBG(CXT, ul_debugobj(idx, "alloc index"));
+	idx->refcount = 1;
+	return idx;
+}
+
+static void reset_index(struct loopdev_index *idx)
+{
+	size_t i;
+
+	for (i = 0; i < idx->nents; i++) {
+		free(idx->ents[i].device);
+		free(idx->ents[i].backing_file);
+	}
+	free(idx->ents);
+	idx->ents = NULL;
+	idx->nents = 0;
+	idx->scanned = 0;
+}
+
+void loopdev_ref_index(struct loopdev_index *idx)
+{
+	if (idx)
+		idx->refcount++;
+}
+
+void loopdev_unref_index(struct loopdev_index *idx)
+{
+	if (idx) {
+		idx->refcount--;
+		if (idx->refcount <= 0) {
+			DBG(CXT, ul_debugobj(idx, "free index"));
+			reset_index(idx);
+			free(idx);
+		}
+	}
+}
+
+/*
+ * @lc: context
+ * @idx: index or NULL
+ *
+ * Use (and reference) the index for the find and count functions.
+ *
+ * Returns: <0 on error, 0 on success
+ */
+int loopcxt_set_index(struct loopdev_cxt *lc, struct loopdev_index *idx)
+{
+	if (!lc)
+		return -EINVAL;
+
+	loopdev_ref_index(idx);
+	loopdev_unref_index(lc->index);
+	lc->index = idx;
+	return 0;
+}
+
+static int update_index(struct loopdev_index *idx)
+{
+	struct loopdev_cxt lc;
+	uint64_t seqnum = 0;
+	size_t nalloc = 0;
+	int rc;
+
+	if (ul_path_read_u64(NULL, &seqnum, _PATH_SYS_UEVENT_SEQNUM) != 0)
+		seqnum = 0;
+	if (idx->scanned && seqnum && seqnum == idx->seqnum) {
+		DBG(CXT, ul_debugobj(idx, "index is up to date"));
+		return 0;
+	}
+
+	reset_index(idx);
+
+	rc = loopcxt_init(&lc, 0);
+	if (!rc)
+		rc = loopcxt_init_iterator(&lc, LOOPITER_FL_USED);
+
+	while (rc == 0 && loopcxt_next(&lc) == 0) {
+		struct loopdev_entry *e;
+
+		if (idx->nents == nalloc) {
+			nalloc = nalloc ? nalloc * 2 : 16;
+			e = realloc(idx->ents, nalloc * sizeof(*e));
+			if (!e) {
+				rc = -ENOMEM;
+				break;
+			}
+			idx->ents = e;
+		}
+		e = &idx->ents[idx->nents];
+		memset(e, 0, sizeof(*e));
+
+		e->device = strdup(loopcxt_get_device(&lc));
+		if (!e->device) {
+			rc = -ENOMEM;
+			break;
+		}
+		idx->nents++;
+
+		e->backing_file = loopcxt_get_backing_file(&lc);
+		e->has_offset = loopcxt_get_offset(&lc, &e->offset) == 0;
+		e->has_sizelimit = loopcxt_get_sizelimit(&lc, &e->sizelimit) == 0;
+	}
+	loopcxt_deinit(&lc);
+
+	if (rc) {
+		reset_index(idx);
+		return rc;
+	}
+
+	idx->seqnum = seqnum;
+	idx->scanned = 1;
+	DBG(CXT, ul_debugobj(idx, "index scanned [seqnum=%"PRIu64", devices=%zu]",
+				seqnum, idx->nents));
+	return 0;
+}
+
+/*
+ * Returns: 1 = the entry is backed by @st, 0 = not backed, -1 = unknown
+ */
+static int entry_cmp_inode(struct loopdev_entry *e, struct stat *st)
+{
+	struct stat bst;
+
+	if (e->backing_file && stat(e->backing_file, &bst) == 0)
+		return bst.st_ino == st->st_ino && bst.st_dev == st->st_dev;
+
+	if (!e->inode_read) {
+		struct loopdev_cxt lc;
+
+		e->inode_read = 1;
+		if (loopcxt_init(&lc, 0) == 0) {
+			if (loopcxt_set_device(&lc, e->device) == 0)
+				e->has_inode =
+				    loopcxt_get_backing_inode(&lc, &e->backing_ino) == 0
+				 && loopcxt_get_backing_devno(&lc, &e->backing_devno) == 0;
+			loopcxt_deinit(&lc);
+		}
+	}
+	if (!e->has_inode)
+		return -1;
+	return e->backing_ino == st->st_ino && e->backing_devno == st->st_dev;
+}
+
+/* the same as loopcxt_is_used(), but for the index entry */
+static int entry_is_used(struct loopdev_entry *e,
+			 struct stat *st,
+			 const char *backing_file,
+			 uint64_t offset,
+			 uint64_t sizelimit,
+			 int flags)
+{
+	int rc = st ? entry_cmp_inode(e, st) : -1;
+
+	if (rc == 0)
+		return 0;
+
+	/* poor man's solution */
+	if (rc < 0 && (!backing_file || !e->backing_file
+		       || strcmp(e->backing_file, backing_file) != 0))
+		return 0;
+
+	if (flags & LOOPDEV_FL_OFFSET) {
+		if (!e->has_offset || e->offset != offset)
+			return 0;
+		if (flags & LOOPDEV_FL_SIZELIMIT)
+			return e->has_sizelimit && e->sizelimit == sizelimit;
+	}
+	return 1;
+}
+
+/*
+ * Returns referenced index of the context or a new temporary index.
+ */
+static struct loopdev_index *get_index(struct loopdev_cxt *lc)
+{
+	if (lc->index) {
+		loopdev_ref_index(lc->index);
+		return lc->index;
+	}
+	return loopdev_new_index();
+}
+
 /*
  * Returns: 0 = success, < 0 error, 1 not found
  */
 int loopcxt_find_by_backing_file(struct loopdev_cxt *lc, const char *filename,
 				 uint64_t offset, uint64_t sizelimit, int flags)
 {
+	struct loopdev_index *idx;
 	int rc, hasst;
 	struct stat st;
 
@@ -1752,6 +2009,23 @@ int loopcxt_find_by_backing_file(struct loopdev_cxt *lc, const char *filename,
 
 	hasst = !stat(filename, &st);
 
+	idx = get_index(lc);
+	if (idx && update_index(idx) == 0) {
+		size_t i;
+
+		rc = 1;
+		for (i = 0; i < idx->nents; i++) {
+			if (entry_is_used(&idx->ents[i], hasst ? &st : NULL,
+					  filename, offset, sizelimit, flags)) {
+				rc = loopcxt_set_device(lc, idx->ents[i].device);
+				break;
+			}
+		}
+		loopdev_unref_index(idx);
+		return rc;
+	}
+	loopdev_unref_index(idx);
+
 	rc = loopcxt_init_iterator(lc, LOOPITER_FL_USED);
 	if (rc)
 		return rc;
@@ -1767,12 +2041,28 @@ int loopcxt_find_by_backing_file(struct loopdev_cxt *lc, const char *filename,
 	return rc;
 }
 
+/*
+ * Returns: 0 = no overlap, 1 overlap, 2 full size and offset match
+ */
+static int get_overlap(uint64_t lc_offset, uint64_t lc_sizelimit,
+		       uint64_t offset, uint64_t sizelimit)
+{
+	if (lc_sizelimit == sizelimit && lc_offset == offset)
+		return 2;
+	if (lc_sizelimit != 0 && offset >= lc_offset + lc_sizelimit)
+		return 0;
+	if (sizelimit != 0 && offset + sizelimit <= lc_offset)
+		return 0;
+	return 1;
+}
+
 /*
  * Returns: 0 = not found, < 0 error, 1 found, 2 found full size and offset match
  */
 int loopcxt_find_overlap(struct loopdev_cxt *lc, const char *filename,
 			   uint64_t offset, uint64_t sizelimit)
 {
+	struct loopdev_index *idx;
 	int rc, hasst;
 	struct stat st;
 
@@ -1782,6 +2072,35 @@ int loopcxt_find_overlap(struct loopdev_cxt *lc, const char *filename,
 	DBG(CXT, ul_debugobj(lc, "find_overlap requested"));
 	hasst = !stat(filename, &st);
 
+	idx = get_index(lc);
+	if (idx && update_index(idx) == 0) {
+		size_t i;
+
+		rc = 0;
+		for (i = 0; i < idx->nents; i++) {
+			struct loopdev_entry *e = &idx->ents[i];
+
+			if (!e->has_offset || !e->has_sizelimit
+			    || !entry_is_used(e, hasst ? &st : NULL,
+					      filename, offset, sizelimit, 0))
+				continue;
+
+			rc = get_overlap(e->offset, e->sizelimit, offset, sizelimit);
+			if (!rc)
+				continue;
+
+			DBG(CXT, ul_debugobj(lc, "overlapping loop device %s%s (index)",
+					e->device, rc == 2 ? " (full match)" : ""));
+			if (loopcxt_set_device(lc, e->device))
+				rc = -errno;
+			break;
+		}
+		loopdev_unref_index(idx);
+		DBG(CXT, ul_debugobj(lc, "find_overlap done by index [rc=%d]", rc));
+		return rc;
+	}
+	loopdev_unref_index(idx);
+
 	rc = loopcxt_init_iterator(lc, LOOPITER_FL_USED);
 	if (rc)
 		return rc;
@@ -1815,24 +2134,13 @@ int loopcxt_find_overlap(struct loopdev_cxt *lc, const char *filename,
 			continue;
 		}
 
-		/* full match */
-		if (lc_sizelimit == sizelimit && lc_offset == offset) {
-			DBG(CXT, ul_debugobj(lc, "overlapping loop device %s (full match)",
-						loopcxt_get_device(lc)));
-			rc = 2;
-			goto found;
-		}
-
-		/* overlap */
-		if (lc_sizelimit != 0 && offset >= lc_offset + lc_sizelimit)
-			continue;
-		if (sizelimit != 0 && offset + sizelimit <= lc_offset)
+		rc = get_overlap(lc_offset, lc_sizelimit, offset, sizelimit);
+		if (!rc)
 			continue;
 
-		DBG(CXT, ul_debugobj(lc, "overlapping loop device %s",
-			loopcxt_get_device(lc)));
-			rc = 1;
-			goto found;
+		DBG(CXT, ul_debugobj(lc, "overlapping loop device %s%s",
+			loopcxt_get_device(lc), rc == 2 ? " (full match)" : ""));
+		goto found;
 	}
 
 	if (rc == 1)
@@ -1868,35 +2176,47 @@ char *loopdev_find_by_backing_file(const char *filename, uint64_t offset, uint64
  * device is associated with the given @filename and @loopdev is not NULL then
  * @loopdev returns name of the device.
  */
-int loopdev_count_by_backing_file(const char *filename, char **loopdev)
+int loopcxt_count_by_backing_file(struct loopdev_cxt *lc, const char *filename,
+				  char **loopdev)
 {
-	struct loopdev_cxt lc;
-	int count = 0, rc;
+	struct loopdev_index *idx;
+	int count = 0;
 
-	if (!filename)
+	if (!lc || !filename)
 		return -1;
 
-	rc = loopcxt_init(&lc, 0);
-	if (rc)
-		return rc;
-	if (loopcxt_init_iterator(&lc, LOOPITER_FL_USED))
-		return -1;
+	idx = get_index(lc);
+	if (idx && update_index(idx) == 0) {
+		size_t i;
 
-	while(loopcxt_next(&lc) == 0) {
-		char *backing = loopcxt_get_backing_file(&lc);
+		for (i = 0; i < idx->nents; i++) {
+			struct loopdev_entry *e = &idx->ents[i];
 
-		if (!backing || strcmp(backing, filename) != 0) {
-			free(backing);
-			continue;
+			if (!e->backing_file || strcmp(e->backing_file, filename) != 0)
+				continue;
+			if (loopdev && count == 0)
+				*loopdev = strdup(e->device);
+			count++;
 		}
+	} else {
+		if (loopcxt_init_iterator(lc, LOOPITER_FL_USED))
+			return -1;
 
-		free(backing);
-		if (loopdev && count == 0)
-			*loopdev = loopcxt_strdup_device(&lc);
-		count++;
-	}
+		while (loopcxt_next(lc) == 0) {
+			char *backing = loopcxt_get_backing_file(lc);
 
-	loopcxt_deinit(&lc);
+			if (!backing || strcmp(backing, filename) != 0) {
+				free(backing);
+				continue;
+			}
+
+			free(backing);
+			if (loopdev && count == 0)
+				*loopdev = loopcxt_strdup_device(lc);
+			count++;
+		}
+	}
+	loopdev_unref_index(idx);
 
 	if (loopdev && count > 1) {
 		free(*loopdev);
@@ -1905,6 +2225,23 @@ int loopdev_count_by_backing_file(const char *filename, char **loopdev)
 	return count;
 }
 
+int loopdev_count_by_backing_file(const char *filename, char **loopdev)
+{
+	struct loopdev_cxt lc;
+	int rc;
+
+	if (!filename)
+		return -1;
+
+	rc = loopcxt_init(&lc, 0);
+	if (rc)
+		return rc;
+
+	rc = loopcxt_count_by_backing_file(&lc, filename, loopdev);
+	loopcxt_deinit(&lc);
+	return rc;
+}
+
 #ifdef TEST_PROGRAM_LOOPDEV
 int main(int argc, char *argv[])
 {
@@ -26,15 +26,26 @@
 #include "path.h"
 #include "debug.h"
 #include "strutils.h"
+#include "list.h"
 
 /*
  * Debug stuff (based on include/debug.h)
  */
 static UL_DEBUG_DEFINE_MASK(ulpath);
-UL_DEBUG_DEFINE_MASKNAMES(ulpath) = UL_DEBUG_EMPTY_MASKNAMES;
 
 #define ULPATH_DEBUG_INIT	(1 << 1)
 #define ULPATH_DEBUG_CXT	(1 << 2)
+#define ULPATH_DEBUG_CACHE	(1 << 3)
+#define ULPATH_DEBUG_ALL	0xFFFF
+
+UL_DEBUG_DEFINE_MASKNAMES(ulpath) =
+{
+	{ "all",	ULPATH_DEBUG_ALL,	"info about all subsystems" },
+	{ "cache",	ULPATH_DEBUG_CACHE,	"attributes cache" },
+	{ "cxt",	ULPATH_DEBUG_CXT,	"path context (handler)" },
+	{ "init",	ULPATH_DEBUG_INIT,	"library initialization" },
+	{ NULL, 0, NULL }
+};
 
 #define DBG(m, x)       __UL_DBG(ulpath, ULPATH_DEBUG_, m, x)
 #define ON_DBG(m, x)    __UL_DBG_CALL(ulpath, ULPATH_DEBUG_, m, x)
@@ -42,6 +53,8 @@ UL_DEBUG_DEFINE_MASKNAMES(ulpath) = UL_DEBUG_EMPTY_MASKNAMES;
 #define UL_DEBUG_CURRENT_MASK	UL_DEBUG_MASK(ulpath)
 #include "debugobj.h"
 
+static void path_cache_flush(struct path_cxt *pc);
+
 void ul_path_init_debug(void)
 {
 	if (ulpath_debug_mask)
@@ -95,6 +108,7 @@ void ul_unref_path(struct path_cxt *pc)
 		DBG(CXT, ul_debugobj(pc, "dealloc"));
 		if (pc->dialect)
 			pc->free_dialect(pc);
+		ul_path_enable_cache(pc, 0);
 		ul_path_close_dirfd(pc);
 		free(pc->dir_path);
 		free(pc->prefix);
@@ -116,6 +130,7 @@ int ul_path_set_prefix(struct path_cxt *pc, const char *prefix)
 
 	free(pc->prefix);
 	pc->prefix = p;
+	path_cache_flush(pc);
 	DBG(CXT, ul_debugobj(pc, "new prefix: '%s'", p));
 	return 0;
 }
@@ -142,6 +157,7 @@ int ul_path_set_dir(struct path_cxt *pc, const char *dir)
 
 	free(pc->dir_path);
 	pc->dir_path = p;
+	path_cache_flush(pc);
 	DBG(CXT, ul_debugobj(pc, "new dir: '%s'", p));
 	return 0;
 }
@@ -170,6 +186,171 @@ int ul_path_set_enoent_redirect(struct path_cxt *pc, int (*func)(struct path_cxt
 	return 0;
 }
 
+/*
+ * Attributes cache -- the content of small files read by ul_path_read() (and
+ * by all ul_path_read_<number>() functions) is kept in memory, so the next
+ * read of the same file is only a lookup. It is useful for sysfs and procfs
+ * readers which ask for the same attributes again and again. The cache is
+ * flushed on write, and when the directory or prefix is changed.
+ *
+ * Don't enable it if the files are expected to be modified by something else
+ * during the life of the context.
+ */
+#define PATH_CACHE_NBUCKETS	64
+#define PATH_CACHE_MAXSZ	BUFSIZ		/* larger files are not cached */
+
+struct path_cache_entry {
+	struct list_head	entries;	/* hash bucket */
+	char			*path;
+	char			*data;
+	int			rc;		/* read() size or -errno */
+};
+
+struct path_cache {
+	struct list_head	buckets[PATH_CACHE_NBUCKETS];
+	size_t			nhits;
+	size_t			nmisses;
+};
+
+static void path_cache_flush(struct path_cxt *pc)
+{
+	size_t i;
+
+	if (!pc->cache)
+		return;
+
+	for (i = 0; i < PATH_CACHE_NBUCKETS; i++) {
+		struct list_head *head = &pc->cache->buckets[i];
+
+		while (!list_empty(head)) {
+			struct path_cache_entry *ent = list_entry(head->next,
+						struct path_cache_entry, entries);
+			list_del(&ent->entries);
+			free(ent->path);
+			free(ent->data);
+			free(ent);
+		}
+	}
+}
+
+/*
+ * Enables or disables (and deallocates) the attributes cache.
+ *
+ * Returns: 0 or negative number in case of error.
+ */
+int ul_path_enable_cache(struct path_cxt *pc, int enable)
+{
+	if (enable && !pc->cache) {
+		size_t i;
+
+		pc->cache = calloc(1, sizeof(*pc->cache));
+		if (!pc->cache)
+			return -ENOMEM;
+		for (i = 0; i < PATH_CACHE_NBUCKETS; i++)
+			INIT_LIST_HEAD(&pc->cache->buckets[i]);
+		DBG(CACHE, ul_debugobj(pc, "cache enabled"));
+
+	} else if (!enable && pc->cache) {
+		DBG(CACHE, ul_debugobj(pc, "cache disabled [%zu hits, %zu misses]",
+					pc->cache->nhits, pc->cache->nmisses));
+		path_cache_flush(pc);
+		free(pc->cache);
+		pc->cache = NULL;
+	}
+	return 0;
+}
+
+static struct list_head *path_cache_bucket(struct path_cxt *pc, const char *path)
+{
+	unsigned int h = 5381;
+
+	while (*path)
+		h = (h << 5) + h + (unsigned char) *path++;
+
+	return &pc->cache->buckets[h % PATH_CACHE_NBUCKETS];
+}
+
+static int path_cache_read(struct path_cxt *pc, char *buf, size_t len, const char *path)
+{
+	struct path_cache *ca = pc->cache;
+	struct path_cache_entry *ent;
+	struct list_head *p, *bucket;
+	char data[PATH_CACHE_MAXSZ], *key;
+	int rc, fd;
+
+	if (*path == '/')
+		path++;
+	bucket = path_cache_bucket(pc, path);
+
+	list_for_each(p, bucket) {
+		ent = list_entry(p, struct path_cache_entry, entries);
+		if (strcmp(ent->path, path) != 0)
+			continue;
+
+		ca->nhits++;
+		DBG(CACHE, ul_debugobj(pc, " cached '%s' [rc=%d]", path, ent->rc));
+		if (ent->rc < 0) {
+			errno = -ent->rc;
+			return ent->rc;
+		}
+		rc = min((size_t) ent->rc, len);
+		memset(buf, 0, len);
+		memcpy(buf, ent->data, rc);
+		return rc;
+	}
+
+	ca->nmisses++;
+
+	/* the path is usually in pc->path_buffer, make a copy before open */
+	key = strdup(path);
+	if (!key)
+		return -ENOMEM;
+
+	fd = ul_path_open(pc, O_RDONLY|O_CLOEXEC, path);
+	if (fd < 0)
+		rc = -errno;
+	else {
+		int errsv;
+
+		DBG(CXT, ul_debug(" reading '%s'", key));
+		rc = read_all(fd, data, sizeof(data));
+		errsv = errno;
+		close(fd);
+		errno = errsv;
+
+		if (rc >= 0) {
+			memset(buf, 0, len);
+			memcpy(buf, data, min((size_t) rc, len));
+		}
+		/* read error or too large file */
+		if (rc < 0 || (size_t) rc == sizeof(data)) {
+			free(key);
+			return rc < 0 ? rc : (int) len;
+		}
+	}
+
+	ent = calloc(1, sizeof(*ent));
+	if (ent && rc > 0)
+		ent->data = malloc(rc);
+	if (!ent || (rc > 0 && !ent->data)) {
+		free(ent);
+		free(key);
+		return rc < 0 ? rc : (int) min((size_t) rc, len);
+	}
+
+	ent->path = key;
+	ent->rc = rc;
+	if (rc > 0)
+		memcpy(ent->data, data, rc);
+	list_add(&ent->entries, bucket);
+
+	if (rc < 0) {
+		errno = -rc;
+		return rc;
+	}
+	return min((size_t) rc, len);
+}
+
 static const char *get_absdir(struct path_cxt *pc)
 {
 	int rc;
@@ -591,6 +772,9 @@ int ul_path_read(struct path_cxt *pc, char *buf, size_t len, const char *path)
 	int rc, errsv;
 	int fd;
 
+	if (pc && pc->cache && path && len <= PATH_CACHE_MAXSZ)
+		return path_cache_read(pc, buf, len, path);
+
 	fd = ul_path_open(pc, O_RDONLY|O_CLOEXEC, path);
 	if (fd < 0)
 		return -errno;
@@ -738,12 +922,34 @@ int ul_path_scanff(struct path_cxt *pc, const char *path, va_list ap, const char
 }
 
 
+/*
+ * Like ul_path_scanf(), but for small files with numbers. It does not use
+ * stdio (and it's possible to read it from the cache).
+ */
+static int ul_path_scan_number(struct path_cxt *pc, const char *path, const char *fmt, ...)
+{
+	char buf[64];
+	va_list ap;
+	int rc;
+
+	rc = ul_path_read(pc, buf, sizeof(buf) - 1, path);
+	if (rc < 0)
+		return rc;
+	buf[rc] = '\0';
+
+	va_start(ap, fmt);
+	rc = vsscanf(buf, fmt, ap);
+	va_end(ap);
+
+	return rc;
+}
+
 int ul_path_read_s64(struct path_cxt *pc, int64_t *res, const char *path)
 {
 	int64_t x = 0;
 	int rc;
 
-	rc = ul_path_scanf(pc, path, "%"SCNd64, &x);
+	rc = ul_path_scan_number(pc, path, "%"SCNd64, &x);
 	if (rc != 1)
 		return -1;
 	if (res)
@@ -768,7 +974,7 @@ int ul_path_read_u64(struct path_cxt *pc, uint64_t *res, const char *path)
 	uint64_t x = 0;
 	int rc;
 
-	rc = ul_path_scanf(pc, path, "%"SCNu64, &x);
+	rc = ul_path_scan_number(pc, path, "%"SCNu64, &x);
 	if (rc != 1)
 		return -1;
 	if (res)
@@ -792,7 +998,7 @@ int ul_path_read_s32(struct path_cxt *pc, int *res, const char *path)
 {
 	int rc, x = 0;
 
-	rc = ul_path_scanf(pc, path, "%d", &x);
+	rc = ul_path_scan_number(pc, path, "%d", &x);
 	if (rc != 1)
 		return -1;
 	if (res)
@@ -817,7 +1023,7 @@ int ul_path_read_u32(struct path_cxt *pc, unsigned int *res, const char *path)
 	int rc;
 	unsigned int x = 0;
 
-	rc = ul_path_scanf(pc, path, "%u", &x);
+	rc = ul_path_scan_number(pc, path, "%u", &x);
 	if (rc != 1)
 		return -1;
 	if (res)
@@ -841,7 +1047,7 @@ int ul_path_read_majmin(struct path_cxt *pc, dev_t *res, const char *path)
 {
 	int rc, maj = 0, min = 0;
 
-	rc = ul_path_scanf(pc, path, "%d:%d", &maj, &min);
+	rc = ul_path_scan_number(pc, path, "%d:%d", &maj, &min);
 	if (rc != 2)
 		return -1;
 	if (res)
@@ -866,6 +1072,9 @@ int ul_path_write_string(struct path_cxt *pc, const char *str, const char *path)
 	int rc, errsv;
 	int fd;
 
+	if (pc)
+		path_cache_flush(pc);
+
 	fd = ul_path_open(pc, O_WRONLY|O_CLOEXEC, path);
 	if (fd < 0)
 		return -errno;
@@ -896,6 +1105,9 @@ int ul_path_write_s64(struct path_cxt *pc, int64_t num, const char *path)
 	int rc, errsv;
 	int fd, len;
 
+	if (pc)
+		path_cache_flush(pc);
+
 	fd = ul_path_open(pc, O_WRONLY|O_CLOEXEC, path);
 	if (fd < 0)
 		return -errno;
@@ -918,6 +1130,9 @@ int ul_path_write_u64(struct path_cxt *pc, uint64_t num, const char *path)
 	int rc, errsv;
 	int fd, len;
 
+	if (pc)
+		path_cache_flush(pc);
+
 	fd = ul_path_open(pc, O_WRONLY|O_CLOEXEC, path);
 	if (fd < 0)
 		return -errno;
@@ -1090,6 +1305,7 @@ static void __attribute__((__noreturn__)) usage(void)
 {
 	fprintf(stdout, " %s [options] <dir> <command>\n\n", program_invocation_short_name);
 	fputs(" -p, --prefix <dir>      redirect hardcoded paths to <dir>\n", stdout);
+	fputs(" -c, --cache             enable attributes cache\n", stdout);
 
 	fputs(" Commands:\n", stdout);
 	fputs(" read-u64 <file>            read uint64_t from file\n", stdout);
@@ -1107,18 +1323,22 @@ static void __attribute__((__noreturn__)) usage(void)
 
 int main(int argc, char *argv[])
 {
-	int c;
+	int c, cache = 0;
 	const char *prefix = NULL, *dir, *file, *command;
 	struct path_cxt *pc = NULL;
 
 	static const struct option longopts[] = {
 		{ "prefix",	1, NULL, 'p' },
+		{ "cache",	0, NULL, 'c' },
 		{ "help",       0, NULL, 'h' },
 		{ NULL, 0, NULL, 0 },
 	};
 
-	while((c = getopt_long(argc, argv, "p:h", longopts, NULL)) != -1) {
+	while((c = getopt_long(argc, argv, "cp:h", longopts, NULL)) != -1) {
 		switch(c) {
+		case 'c':
+			cache = 1;
+			break;
 		case 'p':
 			prefix = optarg;
 			break;
@@ -1141,6 +1361,8 @@ int main(int argc, char *argv[])
 		err(EXIT_FAILURE, "failed to initialize path context");
 	if (prefix)
 		ul_path_set_prefix(pc, prefix);
+	if (cache)
+		ul_path_enable_cache(pc, 1);
 
 	if (optind == argc)
 		errx(EXIT_FAILURE, "<command> not defined");
@@ -1265,19 +1487,30 @@ int main(int argc, char *argv[])
 			err(EXIT_FAILURE, "writef string failed");
 
 	} else if (strcmp(command, "write-u64") == 0) {
-		uint64_t num;
+		uint64_t num, res;
 
 		if (optind + 1 == argc)
 			errx(EXIT_FAILURE, "<file> <num> not defined");
 		file = argv[optind++];
 		num = strtoumax(argv[optind++], NULL, 0);
 
+		/* fill the cache, the write has to flush it */
+		ignore_result( ul_path_read_u64(pc, &res, file) );
+
 		if (ul_path_write_u64(pc, num, file) != 0)
 			err(EXIT_FAILURE, "write u64 failed");
 		if (ul_path_writef_u64(pc, num, "%s", file) != 0)
 			err(EXIT_FAILURE, "writef u64 failed");
+
+		if (ul_path_read_u64(pc, &res, file) != 0)
+			err(EXIT_FAILURE, "read u64 failed");
+		printf("read:  %s: %" PRIu64 "\n", file, res);
 	}
 
+	if (pc->cache)
+		printf("cache: %zu hits, %zu misses\n",
+				pc->cache->nhits, pc->cache->nmisses);
+
 	ul_unref_path(pc);
 	return EXIT_SUCCESS;
 }
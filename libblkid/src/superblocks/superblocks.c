@@ -81,6 +81,7 @@
 
 static int superblocks_probe(blkid_probe pr, struct blkid_chain *chn);
 static int superblocks_safeprobe(blkid_probe pr, struct blkid_chain *chn);
+static void superblocks_free_data(blkid_probe pr, void *data);
 
 static int blkid_probe_set_usage(blkid_probe pr, int usage);
 
@@ -186,6 +187,7 @@ const struct blkid_chaindrv superblocks_drv = {
 	.has_fltr     = TRUE,
 	.probe        = superblocks_probe,
 	.safeprobe    = superblocks_safeprobe,
+	.free_data    = superblocks_free_data
 };
 
 /**
@@ -340,8 +342,181 @@ int blkid_superblocks_get_name(size_t idx, const char **name, int *usage)
 /*
  * The blkid_do_probe() backend.
  */
+/*
+ * Magic dispatch index
+ *
+ * Most of the probers are detected by magic strings on fixed offsets. The
+ * index (allocated on the first probe) maps the 1KiB blocks with the fixed
+ * magic strings to the probers. superblocks_probe() reads the low blocks by
+ * one read, compares all the fixed magic strings block by block, and then
+ * calls blkid_probe_get_idmag() and the probing function only for the probers
+ * with a matching magic, with a magic on variable offset (hint or zone) and
+ * for the probers without a magic.
+ */
+#define SUBLKS_PREFETCH_MAX	(128 * 1024)
+
+struct sublks_magic {
+	uint64_t			kboff;	/* 1KiB block with the magic */
+	const struct blkid_idmag	*mag;
+	size_t				idx;	/* prober index in idinfos[] */
+};
+
+struct sublks_index {
+	struct sublks_magic	*magics;	/* fixed magics sorted by block */
+	size_t			nmagics;
+	unsigned long		*always;	/* probers without a fixed magic */
+	unsigned long		*cands;		/* probers to call */
+};
+
+static int cmp_sublks_magic(const void *a, const void *b)
+{
+	const struct sublks_magic *x = a, *y = b;
+
+	if (x->kboff != y->kboff)
+		return x->kboff < y->kboff ? -1 : 1;
+	return x->idx < y->idx ? -1 : x->idx > y->idx;
+}
+
+static void superblocks_free_data(blkid_probe pr __attribute__((__unused__)),
+				  void *data)
+{
+	struct sublks_index *sx = (struct sublks_index *) data;
+
+	if (!sx)
+		return;
+	free(sx->magics);
+	free(sx->always);
+	free(sx->cands);
+	free(sx);
+}
+
+static struct sublks_index *sublks_new_index(void)
+{
+	struct sublks_index *sx;
+	const struct blkid_idmag *mag;
+	size_t i, n = 0;
+
+	for (i = 0; i < ARRAY_SIZE(idinfos); i++) {
+		for (mag = &idinfos[i]->magics[0]; mag->magic; mag++)
+			n++;
+	}
+
+	sx = calloc(1, sizeof(*sx));
+	if (!sx)
+		return NULL;
+	sx->magics = calloc(n, sizeof(struct sublks_magic));
+	sx->always = calloc(1, blkid_bmp_nbytes(ARRAY_SIZE(idinfos)));
+	sx->cands = calloc(1, blkid_bmp_nbytes(ARRAY_SIZE(idinfos)));
+	if (!sx->magics || !sx->always || !sx->cands) {
+		superblocks_free_data(NULL, sx);
+		return NULL;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(idinfos); i++) {
+		size_t first = sx->nmagics;
+
+		for (mag = &idinfos[i]->magics[0]; mag->magic; mag++) {
+			struct sublks_magic *m = &sx->magics[sx->nmagics];
+
+			if (mag->hoff || mag->is_zoned || mag->kboff < 0)
+				break;
+			m->kboff = mag->kboff + (mag->sboff >> 10);
+			m->mag = mag;
+			m->idx = i;
+			sx->nmagics++;
+		}
+
+		/* no magic or variable offset, always call the prober */
+		if (!idinfos[i]->magics[0].magic || mag->magic) {
+			sx->nmagics = first;
+			blkid_bmp_set_item(sx->always, i);
+		}
+	}
+
+	qsort(sx->magics, sx->nmagics, sizeof(struct sublks_magic), cmp_sublks_magic);
+
+	DBG(LOWPROBE, ul_debug("magic index: %zu fixed magics", sx->nmagics));
+	return sx;
+}
+
+/* returns 1 if the prober is not used for the device */
+static int sublks_skip_prober(blkid_probe pr, struct blkid_chain *chn, size_t i)
+{
+	const struct blkid_idinfo *id = idinfos[i];
+
+	if (chn->fltr && blkid_bmp_get_item(chn->fltr, i))
+		return 1;
+
+	if (id->minsz && (unsigned)id->minsz > pr->size)
+		return 1;	/* the device is too small */
+
+	/* don't probe for RAIDs, swap or journal on CD/DVDs */
+	if ((id->usage & (BLKID_USAGE_RAID | BLKID_USAGE_OTHER)) &&
+	    blkid_probe_is_cdrom(pr))
+		return 1;
+
+	/* don't probe for RAIDs on floppies */
+	if ((id->usage & BLKID_USAGE_RAID) && blkid_probe_is_tiny(pr))
+		return 1;
+
+	return 0;
+}
+
+/* set sx->cands for probers from @first */
+static void sublks_find_candidates(blkid_probe pr, struct blkid_chain *chn,
+				   struct sublks_index *sx, size_t first)
+{
+	uint64_t end = 0, last = UINT64_MAX;
+	size_t i, nblocks = 0;
+
+	memcpy(sx->cands, sx->always, blkid_bmp_nbytes(ARRAY_SIZE(idinfos)));
+
+	/* read the low blocks by one read(), the blocks are cached in the probe */
+	for (i = 0; i < sx->nmagics; i++) {
+		const struct sublks_magic *m = &sx->magics[i];
+
+		if (m->idx < first || (m->kboff + 1) << 10 > SUBLKS_PREFETCH_MAX
+		    || sublks_skip_prober(pr, chn, m->idx))
+			continue;
+		if (m->kboff != last)
+			nblocks++;
+		last = m->kboff;
+		end = (m->kboff + 1) << 10;
+	}
+	/* prefetch only, read errors are reported by the block reads below */
+	if (nblocks > 1 && !S_ISCHR(pr->mode))
+		ignore_result( blkid_probe_get_buffer(pr, 0,
+				min(end, (uint64_t) pr->size)) );
+
+	for (i = 0; i < sx->nmagics; ) {
+		uint64_t kboff = sx->magics[i].kboff;
+		unsigned char *buf = NULL;
+		int read = 0, fail = 0;
+
+		for (; i < sx->nmagics && sx->magics[i].kboff == kboff; i++) {
+			const struct sublks_magic *m = &sx->magics[i];
+			const struct blkid_idmag *mag = m->mag;
+
+			if (m->idx < first || blkid_bmp_get_item(sx->cands, m->idx)
+			    || sublks_skip_prober(pr, chn, m->idx))
+				continue;
+			if (!read) {
+				buf = blkid_probe_get_buffer(pr, kboff << 10, 1024);
+				fail = !buf && errno;
+				read = 1;
+			}
+
+			/* on I/O error let blkid_probe_get_idmag() return the error */
+			if (fail || (buf && !memcmp(mag->magic,
+					buf + (mag->sboff & 0x3ff), mag->len)))
+				blkid_bmp_set_item(sx->cands, m->idx);
+		}
+	}
+}
+
 static int superblocks_probe(blkid_probe pr, struct blkid_chain *chn)
 {
+	struct sublks_index *sx;
 	size_t i;
 	int rc = BLKID_PROBE_NONE;
 
@@ -368,6 +543,12 @@ static int superblocks_probe(blkid_probe pr, struct blkid_chain *chn)
 
 	i = chn->idx < 0 ? 0 : chn->idx + 1U;
 
+	if (!chn->data)
+		chn->data = sublks_new_index();
+	sx = (struct sublks_index *) chn->data;
+	if (sx)
+		sublks_find_candidates(pr, chn, sx, i);
+
 	for ( ; i < ARRAY_SIZE(idinfos); i++) {
 		const struct blkid_idinfo *id;
 		const struct blkid_idmag *mag = NULL;
@@ -376,26 +557,14 @@ static int superblocks_probe(blkid_probe pr, struct blkid_chain *chn)
 		chn->idx = i;
 		id = idinfos[i];
 
-		if (chn->fltr && blkid_bmp_get_item(chn->fltr, i)) {
-			DBG(LOWPROBE, ul_debug("filter out: %s", id->name));
-			rc = BLKID_PROBE_NONE;
-			continue;
-		}
-
-		if (id->minsz && (unsigned)id->minsz > pr->size) {
-			rc = BLKID_PROBE_NONE;
-			continue;	/* the device is too small */
-		}
-
-		/* don't probe for RAIDs, swap or journal on CD/DVDs */
-		if ((id->usage & (BLKID_USAGE_RAID | BLKID_USAGE_OTHER)) &&
-		    blkid_probe_is_cdrom(pr)) {
+		if (sublks_skip_prober(pr, chn, i)) {
+			DBG(LOWPROBE, ul_debug("skip: %s", id->name));
 			rc = BLKID_PROBE_NONE;
 			continue;
 		}
 
-		/* don't probe for RAIDs on floppies */
-		if ((id->usage & BLKID_USAGE_RAID) && blkid_probe_is_tiny(pr)) {
+		/* no matching magic string in the index */
+		if (sx && !blkid_bmp_get_item(sx->cands, i)) {
 			rc = BLKID_PROBE_NONE;
 			continue;
 		}
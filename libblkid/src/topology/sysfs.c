@@ -43,8 +43,8 @@ static struct topology_val {
 static int probe_sysfs_tp(blkid_probe pr,
 		const struct blkid_idmag *mag __attribute__((__unused__)))
 {
-	dev_t dev;
-	int rc, set_parent = 1;
+	dev_t dev, disk;
+	int rc;
 	struct path_cxt *pc;
 	size_t i, count = 0;
 
@@ -57,48 +57,39 @@ static int probe_sysfs_tp(blkid_probe pr,
 
 	rc = 1;		/* nothing (default) */
 
+	/*
+	 * Read queue/ attributes from "disk" if the current device is a
+	 * partition. The sysfs ul_path_* API redirects requests to the parent
+	 * for non-existing queue/ attributes, so the attributes are read
+	 * in one pass without access() checks.
+	 */
+	disk = blkid_probe_get_wholedisk_devno(pr);
+	if (disk && disk != dev) {
+		struct path_cxt *parent = ul_new_sysfs_path(disk, NULL, NULL);
+		if (!parent)
+			goto done;
+
+		sysfs_blkdev_set_parent(pc, parent);
+		ul_unref_path(parent);
+	}
+
 	for (i = 0; i < ARRAY_SIZE(topology_vals); i++) {
 		struct topology_val *val = &topology_vals[i];
-		int ok = ul_path_access(pc, F_OK, val->attr) == 0;
 
 		rc = 1;	/* nothing */
 
-		if (!ok && set_parent) {
-			dev_t disk = blkid_probe_get_wholedisk_devno(pr);
-			set_parent = 0;
-
-			/*
-			 * Read attributes from "disk" if the current device is
-			 * a partition. Note that sysfs ul_path_* API is able
-			 * to redirect requests to attributes if parent is set.
-			 */
-			if (disk && disk != dev) {
-				struct path_cxt *parent = ul_new_sysfs_path(disk, NULL, NULL);
-				if (!parent)
-					goto done;
-
-				sysfs_blkdev_set_parent(pc, parent);
-				ul_unref_path(parent);
-
-				/* try it again */
-				ok = ul_path_access(pc, F_OK, val->attr) == 0;
-			}
-		}
-		if (!ok)
-			continue;	/* attribute does not exist */
-
 		if (val->set_ulong) {
 			uint64_t data;
 
 			if (ul_path_read_u64(pc, &data, val->attr) != 0)
-				continue;
+				continue;	/* attribute does not exist */
 			rc = val->set_ulong(pr, (unsigned long) data);
 
 		} else if (val->set_int) {
 			int64_t data;
 
 			if (ul_path_read_s64(pc, &data, val->attr) != 0)
-				continue;
+				continue;	/* attribute does not exist */
 			rc = val->set_int(pr, (int) data);
 		}
 
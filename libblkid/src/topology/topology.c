@@ -70,6 +70,21 @@ struct blkid_struct_topology {
 	unsigned long   dax;
 };
 
+/*
+ * Chain private data. The queue/ limits are per whole-disk, so the last
+ * result is cached and reused for the other partitions of the same disk
+ * probed by the same probe (see blkid_probe_set_device()). Only the
+ * alignment offset is per partition.
+ */
+struct topology_data {
+	struct blkid_struct_topology	tp;	/* result; has to be the first */
+
+	dev_t				disk;	/* cached whole-disk or 0 */
+	struct blkid_struct_topology	disk_tp;
+	int				disk_idx;	/* prober with the result */
+	unsigned int			disk_align : 1;	/* per-device ALIGNMENT_OFFSET */
+};
+
 /*
  * Topology chain probing functions
  */
@@ -138,12 +153,48 @@ blkid_topology blkid_probe_get_topology(blkid_probe pr)
 			&pr->chains[BLKID_CHAIN_TOPLGY]);
 }
 
+/* set the topology cached for the whole-disk */
+static int topology_set_cached(blkid_probe pr, struct topology_data *td)
+{
+	const struct blkid_struct_topology *tp = &td->disk_tp;
+	int rc = 0;
+
+	if (td->disk_align) {
+		int data;
+
+		if (ioctl(pr->fd, BLKALIGNOFF, &data) == -1)
+			return 1;
+		rc = blkid_topology_set_alignment_offset(pr, data);
+	}
+	if (!rc)
+		rc = blkid_topology_set_minimum_io_size(pr, tp->minimum_io_size);
+	if (!rc)
+		rc = blkid_topology_set_optimal_io_size(pr, tp->optimal_io_size);
+	if (!rc)
+		rc = blkid_topology_set_physical_sector_size(pr, tp->physical_sector_size);
+	if (!rc)
+		rc = blkid_topology_set_dax(pr, tp->dax);
+	return rc;
+}
+
+static void topology_cache_result(blkid_probe pr, struct topology_data *td,
+				  int idx)
+{
+	td->disk = blkid_probe_get_wholedisk_devno(pr);
+	td->disk_tp = td->tp;
+	td->disk_idx = idx;
+	td->disk_align = idinfos[idx] == &sysfs_tp_idinfo
+			 || idinfos[idx] == &ioctl_tp_idinfo;
+}
+
 /*
  * The blkid_do_probe() backend.
  */
 static int topology_probe(blkid_probe pr, struct blkid_chain *chn)
 {
+	struct topology_data *td;
 	size_t i;
+	int fresh = chn->idx < 0;
 
 	if (chn->idx < -1)
 		return -1;
@@ -151,23 +202,41 @@ static int topology_probe(blkid_probe pr, struct blkid_chain *chn)
 	if (!S_ISBLK(pr->mode))
 		return -EINVAL;	/* nothing, works with block devices only */
 
-	if (chn->binary) {
-		DBG(LOWPROBE, ul_debug("initialize topology binary data"));
-
-		if (chn->data)
-			/* reset binary data */
-			memset(chn->data, 0,
-					sizeof(struct blkid_struct_topology));
-		else {
-			chn->data = calloc(1,
-					sizeof(struct blkid_struct_topology));
-			if (!chn->data)
-				return -ENOMEM;
-		}
+	DBG(LOWPROBE, ul_debug("initialize topology data"));
+
+	if (chn->data)
+		/* reset the result, keep the cache */
+		memset(chn->data, 0, sizeof(struct blkid_struct_topology));
+	else {
+		chn->data = calloc(1, sizeof(struct topology_data));
+		if (!chn->data)
+			return -ENOMEM;
 	}
+	td = (struct topology_data *) chn->data;
 
 	blkid_probe_chain_reset_values(pr, chn);
 
+	if (fresh && td->disk
+	    && td->disk == blkid_probe_get_wholedisk_devno(pr)) {
+		int rc = topology_set_cached(pr, td);
+
+		if (rc == 0 && topology_is_complete(pr)) {
+			chn->idx = td->disk_idx;
+			topology_set_logical_sector_size(pr);
+
+			DBG(LOWPROBE, ul_debug("<-- leaving probing loop (cached type=%s) [TOPOLOGY idx=%d]",
+				idinfos[chn->idx]->name, chn->idx));
+			return BLKID_PROBE_OK;
+		}
+		if (rc < 0)
+			return rc;
+
+		/* not usable, probe again */
+		td->disk = 0;
+		memset(&td->tp, 0, sizeof(td->tp));
+		blkid_probe_chain_reset_values(pr, chn);
+	}
+
 	DBG(LOWPROBE, ul_debug("--> starting probing loop [TOPOLOGY idx=%d]",
 		chn->idx));
 
@@ -187,6 +256,10 @@ static int topology_probe(blkid_probe pr, struct blkid_chain *chn)
 		if (!topology_is_complete(pr))
 			continue;
 
+		/* the first result from the whole-disk limits */
+		if (fresh)
+			topology_cache_result(pr, td, i);
+
 		/* generic for all probing drivers */
 		topology_set_logical_sector_size(pr);
 
@@ -216,10 +289,9 @@ static int topology_set_value(blkid_probe pr, const char *name,
 	if (!data)
 		return 0;	/* ignore zeros */
 
-	if (chn->binary) {
-		memcpy((char *) chn->data + structoff, &data, sizeof(data));
+	memcpy((char *) chn->data + structoff, &data, sizeof(data));
+	if (chn->binary)
 		return 0;
-	}
 	return blkid_probe_sprintf_value(pr, name, "%lu", data);
 }
 
@@ -233,7 +305,7 @@ static int topology_is_complete(blkid_probe pr)
 	if (!chn)
 		return FALSE;
 
-	if (chn->binary && chn->data) {
+	if (chn->data) {
 		blkid_topology tp = (blkid_topology) chn->data;
 		if (tp->minimum_io_size)
 			return TRUE;
@@ -837,10 +837,8 @@ static int bsd_readlabel(struct fdisk_context *cxt)
 		 * partition. Note that DOS uses native sector size. */
 		offset = dos_partition_get_start(l->dos_part) * cxt->sector_size;
 
-	if (lseek(cxt->dev_fd, offset, SEEK_SET) == -1)
+	if (fdisk_read_device(cxt, l->bsdbuffer, offset, sizeof(l->bsdbuffer)) != 0)
 		return -1;
-	if (read_all(cxt->dev_fd, l->bsdbuffer, sizeof(l->bsdbuffer)) < 0)
-		return errno ? -errno : -1;
 
 	/* The offset to begin of the disk label. Note that BSD uses
 	 * 512-byte (default) sectors. */
@@ -560,6 +560,8 @@ static void reset_context(struct fdisk_context *cxt)
 	cxt->firstsector = NULL;
 	cxt->firstsector_bufsz = 0;
 
+	fdisk_free_readahead(cxt);
+
 	fdisk_zeroize_device_properties(cxt);
 
 	fdisk_unref_script(cxt->script);
@@ -784,6 +786,7 @@ int fdisk_deassign_device(struct fdisk_context *cxt, int nosync)
 	cxt->is_priv = 0;
 	cxt->is_excl = 0;
 
+	fdisk_free_readahead(cxt);
 	return 0;
 }
 
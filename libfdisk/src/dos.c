@@ -234,18 +234,8 @@ static int seek_sector(struct fdisk_context *cxt, fdisk_sector_t secno)
 static int read_sector(struct fdisk_context *cxt, fdisk_sector_t secno,
 			unsigned char *buf)
 {
-	int rc = seek_sector(cxt, secno);
-	ssize_t r;
-
-	if (rc < 0)
-		return rc;
-
-	r = read(cxt->dev_fd, buf, cxt->sector_size);
-	if (r == (ssize_t) cxt->sector_size)
-		return 0;
-	if (r < 0)
-		return -errno;
-	return -1;
+	return fdisk_read_device(cxt, buf,
+			(uint64_t) secno * cxt->sector_size, cxt->sector_size);
 }
 
 /* Allocate a buffer and read a partition table sector */
@@ -377,6 +377,17 @@ struct fdisk_ask {
 	} data;
 };
 
+/* read-ahead window, see fdisk_read_device() */
+struct fdisk_readahead {
+	unsigned char	*buf;
+	uint64_t	off;		/* offset on the device in bytes */
+	size_t		size;		/* size of the window */
+	unsigned int	done : 1,	/* already tried to read */
+			failed : 1;	/* read failed, don't use the window */
+};
+
+#define FDISK_READAHEAD_SIZE	(1024 * 1024)
+
 struct fdisk_context {
 	int dev_fd;         /* device descriptor */
 	char *dev_path;     /* device path */
@@ -388,6 +399,7 @@ struct fdisk_context {
 	unsigned char *firstsector; /* buffer with master boot record */
 	unsigned long firstsector_bufsz;
 
+	struct fdisk_readahead ra[2];	/* begin and end of the device */
 
 	/* topology */
 	unsigned long io_size;		/* I/O size used by fdisk */
@@ -476,6 +488,9 @@ extern void fdisk_zeroize_device_properties(struct fdisk_context *cxt);
 extern int fdisk_init_firstsector_buffer(struct fdisk_context *cxt,
 			unsigned int protect_off, unsigned int protect_size);
 extern int fdisk_read_firstsector(struct fdisk_context *cxt);
+extern int fdisk_read_device(struct fdisk_context *cxt, void *buf,
+			uint64_t offset, size_t size);
+extern void fdisk_free_readahead(struct fdisk_context *cxt);
 
 /* label.c */
 extern int fdisk_probe_labels(struct fdisk_context *cxt);
@@ -184,6 +184,7 @@ struct fdisk_gpt_label {
 	struct gpt_header	*bheader;	/* backup header */
 
 	unsigned char *ents;			/* entries (partitions) */
+	struct gpt_extents *extents;		/* used LBA ranges, see gpt_get_extents() */
 
 	unsigned int no_relocate :1,		/* do not fix backup location */
 		     minimize :1;
@@ -994,11 +995,7 @@ static uint64_t last_lba(struct fdisk_context *cxt)
 static ssize_t read_lba(struct fdisk_context *cxt, uint64_t lba,
 			void *buffer, const size_t bytes)
 {
-	off_t offset = lba * cxt->sector_size;
-
-	if (lseek(cxt->dev_fd, offset, SEEK_SET) == (off_t) -1)
-		return -1;
-	return (size_t)read(cxt->dev_fd, buffer, bytes) != bytes;
+	return fdisk_read_device(cxt, buffer, lba * cxt->sector_size, bytes) != 0;
 }
 
 
@@ -1007,10 +1004,9 @@ static unsigned char *gpt_read_entries(struct fdisk_context *cxt,
 					 struct gpt_header *header)
 {
 	size_t sz = 0;
-	ssize_t ssz;
 
 	unsigned char *ret = NULL;
-	off_t offset;
+	uint64_t offset;
 
 	assert(cxt);
 	assert(header);
@@ -1027,14 +1023,10 @@ static unsigned char *gpt_read_entries(struct fdisk_context *cxt,
 	if (!ret)
 		return NULL;
 
-	offset = (off_t) le64_to_cpu(header->partition_entry_lba) *
+	offset = le64_to_cpu(header->partition_entry_lba) *
 		       cxt->sector_size;
 
-	if (offset != lseek(cxt->dev_fd, offset, SEEK_SET))
-		goto fail;
-
-	ssz = read(cxt->dev_fd, ret, sz);
-	if (ssz < 0 || (size_t) ssz != sz)
+	if (fdisk_read_device(cxt, ret, offset, sz) != 0)
 		goto fail;
 
 	return ret;
@@ -1427,17 +1419,205 @@ static inline int partition_overlap(struct gpt_entry *e1, struct gpt_entry *e2)
 	return (start1 && start2 && (start1 <= end2) != (end1 < start2));
 }
 
+/*
+ * Sorted index of the used LBA ranges. It's built on demand from the entries
+ * array and dropped by gpt_reset_extents() whenever the array is modified, so
+ * the overlap and free space queries below don't rescan all the entries
+ * again and again (that's expensive for tables with thousands of entries).
+ */
+struct gpt_extent {
+	uint64_t	start;
+	uint64_t	end;
+	size_t		partno;
+};
+
+struct gpt_extents {
+	/* the index is valid for this table geometry only */
+	const unsigned char *ents;
+	size_t		nents;
+	uint64_t	fu;
+	uint64_t	lu;
+
+	struct gpt_extent *ext;		/* used entries sorted by start */
+	size_t		next;
+	struct gpt_extent *runs;	/* merged extents, gaps are the free space */
+	size_t		nruns;
+
+	uint32_t	overlap;	/* overlapping partition number or 0 */
+
+	uint64_t	free_sectors;	/* free space in first..last usable LBA */
+	uint32_t	free_nsegments;
+	uint64_t	largest_start;	/* first largest free segment */
+	uint64_t	largest_size;
+};
+
+static void gpt_reset_extents(struct fdisk_gpt_label *gpt)
+{
+	if (gpt->extents) {
+		free(gpt->extents->ext);
+		free(gpt->extents);
+		gpt->extents = NULL;
+	}
+}
+
+static int gpt_extent_cmp(const void *a, const void *b)
+{
+	const struct gpt_extent *x = a, *y = b;
+
+	if (x->start != y->start)
+		return x->start < y->start ? -1 : 1;
+	if (x->end != y->end)
+		return x->end < y->end ? -1 : 1;
+	return 0;
+}
+
+static void gpt_extents_add_free(struct gpt_extents *x, uint64_t first, uint64_t last)
+{
+	uint64_t sz = last - first + 1ULL;
+
+	x->free_sectors += sz;
+	x->free_nsegments++;
+	if (sz > x->largest_size) {
+		x->largest_size = sz;
+		x->largest_start = first;
+	}
+}
+
+static struct gpt_extents *gpt_get_extents(struct fdisk_gpt_label *gpt)
+{
+	struct gpt_extents *x = gpt->extents;
+	uint64_t fu, lu, pos, maxend = 0;
+	size_t i, nents, maxend_partno = 0;
+	int done;
+
+	assert(gpt);
+	assert(gpt->pheader);
+	assert(gpt->ents);
+
+	fu = le64_to_cpu(gpt->pheader->first_usable_lba);
+	lu = le64_to_cpu(gpt->pheader->last_usable_lba);
+	nents = gpt_get_nentries(gpt);
+
+	if (x && x->ents == gpt->ents && x->nents == nents
+	      && x->fu == fu && x->lu == lu)
+		return x;
+
+	gpt_reset_extents(gpt);
+
+	x = calloc(1, sizeof(*x));
+	if (!x)
+		return NULL;
+	if (nents) {
+		x->ext = malloc(2 * nents * sizeof(struct gpt_extent));
+		if (!x->ext) {
+			free(x);
+			return NULL;
+		}
+		x->runs = x->ext + nents;
+	}
+	x->ents = gpt->ents;
+	x->nents = nents;
+	x->fu = fu;
+	x->lu = lu;
+
+	for (i = 0; i < nents; i++) {
+		struct gpt_entry *e = gpt_get_entry(gpt, i);
+
+		if (!gpt_entry_is_used(e))
+			continue;
+		x->ext[x->next].start = gpt_partition_start(e);
+		x->ext[x->next].end = gpt_partition_end(e);
+		x->ext[x->next].partno = i;
+		x->next++;
+	}
+	if (x->next > 1)
+		qsort(x->ext, x->next, sizeof(struct gpt_extent), gpt_extent_cmp);
+
+	for (i = 0; i < x->next; i++) {
+		const struct gpt_extent *ex = &x->ext[i];
+		struct gpt_extent *r = x->nruns ? &x->runs[x->nruns - 1] : NULL;
+
+		/* overlaps with any previous extent, see partition_overlap() */
+		if (ex->start) {
+			if (!x->overlap && maxend && ex->start <= maxend) {
+				DBG(GPT, ul_debug("partitions overlap detected [%zu vs. %zu]",
+							ex->partno, maxend_partno));
+				x->overlap = max(ex->partno, maxend_partno) + 1;
+			}
+			if (ex->end >= maxend) {
+				maxend = ex->end;
+				maxend_partno = ex->partno;
+			}
+		}
+
+		/* merge overlapping and adjacent extents to runs */
+		if (r && (ex->start <= r->end || ex->start - r->end == 1)) {
+			if (ex->end > r->end)
+				r->end = ex->end;
+		} else
+			x->runs[x->nruns++] = *ex;
+	}
+
+	/* free segments, see find_first_available() and find_last_free() */
+	pos = fu;
+	done = fu > lu;
+	for (i = 0; !done && i < x->nruns; i++) {
+		const struct gpt_extent *r = &x->runs[i];
+
+		if (r->end < pos)
+			continue;
+		if (r->start > pos)
+			gpt_extents_add_free(x, pos, r->start < lu ? r->start - 1ULL : lu);
+		if (r->end >= lu)
+			done = 1;
+		else
+			pos = r->end + 1ULL;
+	}
+	if (!done)
+		gpt_extents_add_free(x, pos, lu);
+
+	DBG(GPT, ul_debug("extents: %zu used, %zu runs, %u free segments",
+				x->next, x->nruns, x->free_nsegments));
+	gpt->extents = x;
+	return x;
+}
+
+/* Returns the run (merged extents) which contains @lba or NULL */
+static const struct gpt_extent *gpt_extents_find_run(const struct gpt_extents *x,
+						     uint64_t lba)
+{
+	size_t lo = 0, hi = x->nruns;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (x->runs[mid].start <= lba)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo && x->runs[lo - 1].end >= lba)
+		return &x->runs[lo - 1];
+	return NULL;
+}
+
 /*
  * Find any partitions that overlap.
  */
 static uint32_t check_overlap_partitions(struct fdisk_gpt_label *gpt)
 {
+	struct gpt_extents *x;
 	size_t i, j;
 
 	assert(gpt);
 	assert(gpt->pheader);
 	assert(gpt->ents);
 
+	x = gpt_get_extents(gpt);
+	if (x)
+		return x->overlap;
+
+	/* no memory for the index, compare all the pairs */
 	for (i = 0; i < gpt_get_nentries(gpt); i++)
 		for (j = 0; j < i; j++) {
 			struct gpt_entry *ei = gpt_get_entry(gpt, i);
@@ -1460,49 +1640,29 @@ static uint32_t check_overlap_partitions(struct fdisk_gpt_label *gpt)
  */
 static uint64_t find_first_available(struct fdisk_gpt_label *gpt, uint64_t start)
 {
-	int first_moved = 0;
+	const struct gpt_extents *x;
+	const struct gpt_extent *r;
 	uint64_t first;
-	uint64_t fu, lu;
-
-	assert(gpt);
-	assert(gpt->pheader);
-	assert(gpt->ents);
 
-	fu = le64_to_cpu(gpt->pheader->first_usable_lba);
-	lu = le64_to_cpu(gpt->pheader->last_usable_lba);
+	x = gpt_get_extents(gpt);
+	if (!x)
+		return 0;
 
 	/*
 	 * Begin from the specified starting point or from the first usable
 	 * LBA, whichever is greater...
 	 */
-	first = start < fu ? fu : start;
+	first = start < x->fu ? x->fu : start;
 
 	/*
-	 * Now search through all partitions; if first is within an
-	 * existing partition, move it to the next sector after that
-	 * partition and repeat. If first was moved, set firstMoved
-	 * flag; repeat until firstMoved is not set, so as to catch
-	 * cases where partitions are out of sequential order....
+	 * ...and if it's within an existing partition, move it to the next
+	 * sector after all the partitions which overlap or follow it.
 	 */
-	do {
-		size_t i;
+	r = gpt_extents_find_run(x, first);
+	if (r)
+		first = r->end + 1ULL;
 
-		first_moved = 0;
-		for (i = 0; i < gpt_get_nentries(gpt); i++) {
-			struct gpt_entry *e = gpt_get_entry(gpt, i);
-
-			if (!gpt_entry_is_used(e))
-				continue;
-			if (first < gpt_partition_start(e))
-				continue;
-			if (first <= gpt_partition_end(e)) {
-				first = gpt_partition_end(e) + 1;
-				first_moved = 1;
-			}
-		}
-	} while (first_moved == 1);
-
-	if (first > lu)
+	if (first > x->lu)
 		first = 0;
 
 	return first;
@@ -1512,54 +1672,44 @@ static uint64_t find_first_available(struct fdisk_gpt_label *gpt, uint64_t start
 /* Returns last available sector in the free space pointed to by start. From gdisk. */
 static uint64_t find_last_free(struct fdisk_gpt_label *gpt, uint64_t start)
 {
-	size_t i;
-	uint64_t nearest_start;
+	const struct gpt_extents *x;
+	size_t lo = 0, hi;
 
-	assert(gpt);
-	assert(gpt->pheader);
-	assert(gpt->ents);
+	x = gpt_get_extents(gpt);
+	if (!x)
+		return 0;
 
-	nearest_start = le64_to_cpu(gpt->pheader->last_usable_lba);
+	/* the nearest partition which starts after @start */
+	hi = x->next;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
 
-	for (i = 0; i < gpt_get_nentries(gpt); i++) {
-		struct gpt_entry *e = gpt_get_entry(gpt, i);
-		uint64_t ps = gpt_partition_start(e);
-
-		if (nearest_start > ps && ps > start)
-			nearest_start = ps - 1ULL;
+		if (x->ext[mid].start <= start)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
 
-	return nearest_start;
+	if (lo < x->next && x->ext[lo].start < x->lu)
+		return x->ext[lo].start - 1ULL;
+
+	return x->lu;
 }
 
 /* Returns the last free sector on the disk. From gdisk. */
 static uint64_t find_last_free_sector(struct fdisk_gpt_label *gpt)
 {
-	int last_moved;
-	uint64_t last = 0;
+	const struct gpt_extents *x;
+	const struct gpt_extent *r;
 
-	assert(gpt);
-	assert(gpt->pheader);
-	assert(gpt->ents);
+	x = gpt_get_extents(gpt);
+	if (!x)
+		return 0;
 
 	/* start by assuming the last usable LBA is available */
-	last = le64_to_cpu(gpt->pheader->last_usable_lba);
-	do {
-		size_t i;
-
-		last_moved = 0;
-		for (i = 0; i < gpt_get_nentries(gpt); i++) {
-			struct gpt_entry *e = gpt_get_entry(gpt, i);
-
-			if (last >= gpt_partition_start(e) &&
-			    last <= gpt_partition_end(e)) {
-				last = gpt_partition_start(e) - 1ULL;
-				last_moved = 1;
-			}
-		}
-	} while (last_moved == 1);
+	r = gpt_extents_find_run(x, x->lu);
 
-	return last;
+	return r ? r->start - 1ULL : x->lu;
 }
 
 /*
@@ -1569,28 +1719,9 @@ static uint64_t find_last_free_sector(struct fdisk_gpt_label *gpt)
  */
 static uint64_t find_first_in_largest(struct fdisk_gpt_label *gpt)
 {
-	uint64_t start = 0, first_sect, last_sect;
-	uint64_t segment_size, selected_size = 0, selected_segment = 0;
-
-	assert(gpt);
-	assert(gpt->pheader);
-	assert(gpt->ents);
-
-	do {
-		first_sect = find_first_available(gpt, start);
-		if (first_sect != 0) {
-			last_sect = find_last_free(gpt, first_sect);
-			segment_size = last_sect - first_sect + 1ULL;
-
-			if (segment_size > selected_size) {
-				selected_size = segment_size;
-				selected_segment = first_sect;
-			}
-			start = last_sect + 1ULL;
-		}
-	} while (first_sect != 0);
+	const struct gpt_extents *x = gpt_get_extents(gpt);
 
-	return selected_segment;
+	return x ? x->largest_start : 0;
 }
 
 /*
@@ -1602,39 +1733,17 @@ static uint64_t get_free_sectors(struct fdisk_context *cxt,
 				 uint32_t *nsegments,
 				 uint64_t *largest_segment)
 {
-	uint32_t num = 0;
-	uint64_t first_sect, last_sect;
-	uint64_t largest_seg = 0, segment_sz;
-	uint64_t totfound = 0, start = 0; /* starting point for each search */
+	const struct gpt_extents *x = NULL;
 
-	if (!cxt->total_sectors)
-		goto done;
-
-	assert(gpt);
-	assert(gpt->pheader);
-	assert(gpt->ents);
-
-	do {
-		first_sect = find_first_available(gpt, start);
-		if (first_sect) {
-			last_sect = find_last_free(gpt, first_sect);
-			segment_sz = last_sect - first_sect + 1;
-
-			if (segment_sz > largest_seg)
-				largest_seg = segment_sz;
-			totfound += segment_sz;
-			num++;
-			start = last_sect + 1ULL;
-		}
-	} while (first_sect);
+	if (cxt->total_sectors)
+		x = gpt_get_extents(gpt);
 
-done:
 	if (nsegments)
-		*nsegments = num;
+		*nsegments = x ? x->free_nsegments : 0;
 	if (largest_segment)
-		*largest_segment = largest_seg;
+		*largest_segment = x ? x->largest_size : 0;
 
-	return totfound;
+	return x ? x->free_sectors : 0;
 }
 
 static int gpt_probe_label(struct fdisk_context *cxt)
@@ -1647,6 +1756,7 @@ static int gpt_probe_label(struct fdisk_context *cxt)
 	assert(fdisk_is_label(cxt, GPT));
 
 	gpt = self_label(cxt);
+	gpt_reset_extents(gpt);
 
 	/* TODO: it would be nice to support scenario when GPT headers are OK,
 	 *       but PMBR is corrupt */
@@ -1954,6 +2064,9 @@ static int gpt_set_partition(struct fdisk_context *cxt, size_t n,
 	gpt = self_label(cxt);
 	e = gpt_get_entry(gpt, n);
 
+	/* type and LBAs may be changed below */
+	gpt_reset_extents(gpt);
+
 	if (pa->uuid) {
 		char new_u[UUID_STR_LEN], old_u[UUID_STR_LEN];
 		struct gpt_guid guid;
@@ -2026,11 +2139,10 @@ static int gpt_set_partition(struct fdisk_context *cxt, size_t n,
 
 static int gpt_read(struct fdisk_context *cxt, off_t offset, void *buf, size_t count)
 {
-	if (offset != lseek(cxt->dev_fd, offset, SEEK_SET))
-		return -errno;
+	int rc = fdisk_read_device(cxt, buf, offset, count);
 
-	if (read_all(cxt->dev_fd, buf, count))
-		return -errno;
+	if (rc)
+		return rc;
 
 	DBG(GPT, ul_debug("  read OK [offset=%zu, size=%zu]",
 				(size_t) offset, count));
@@ -2363,6 +2475,7 @@ static int gpt_delete_partition(struct fdisk_context *cxt,
 	/* hasta la vista, baby! */
 	gpt_zeroize_entry(gpt, partnum);
 
+	gpt_reset_extents(gpt);
 	gpt_recompute_crc(gpt->pheader, gpt->ents);
 	gpt_recompute_crc(gpt->bheader, gpt->ents);
 	cxt->label->nparts_cur--;
@@ -2606,6 +2719,7 @@ static int gpt_add_partition(
 	assert(partnum < gpt_get_nentries(gpt));
 
 	e = gpt_get_entry(gpt, partnum);
+	gpt_reset_extents(gpt);
 	e->lba_end = cpu_to_le64(user_l);
 	e->lba_start = cpu_to_le64(user_f);
 
@@ -2725,6 +2839,7 @@ static int gpt_create_disklabel(struct fdisk_context *cxt)
 		rc = -ENOMEM;
 		goto done;
 	}
+	gpt_reset_extents(gpt);
 	gpt_recompute_crc(gpt->pheader, gpt->ents);
 	gpt_recompute_crc(gpt->bheader, gpt->ents);
 
@@ -2911,6 +3026,8 @@ int fdisk_gpt_set_npartitions(struct fdisk_context *cxt, uint32_t nents)
 	/* The backup header must be recalculated */
 	gpt_mknew_header_common(cxt, gpt->bheader, le64_to_cpu(gpt->pheader->alternative_lba));
 
+	gpt_reset_extents(gpt);
+
 	/* CRCs will have changed */
 	gpt_recompute_crc(gpt->pheader, gpt->ents);
 	gpt_recompute_crc(gpt->bheader, gpt->ents);
@@ -3162,6 +3279,7 @@ static int gpt_reorder(struct fdisk_context *cxt)
 	qsort(gpt->ents, nparts, sizeof(struct gpt_entry),
 			gpt_entry_cmp_start);
 
+	gpt_reset_extents(gpt);
 	gpt_recompute_crc(gpt->pheader, gpt->ents);
 	gpt_recompute_crc(gpt->bheader, gpt->ents);
 	fdisk_label_set_changed(cxt->label, 1);
@@ -3208,6 +3326,7 @@ static void gpt_deinit(struct fdisk_label *lb)
 	if (!gpt)
 		return;
 
+	gpt_reset_extents(gpt);
 	free(gpt->ents);
 	free(gpt->pheader);
 	free(gpt->bheader);
@@ -63,6 +63,8 @@ struct fdisk_script {
 	size_t			nlines;
 	struct fdisk_label	*label;
 
+	int			json_indent;		/* JSON embedded level */
+
 	unsigned int		json : 1,		/* JSON output */
 				force_label : 1;	/* label: <name> specified */
 };
@@ -546,6 +548,32 @@ int fdisk_script_enable_json(struct fdisk_script *dp, int json)
 	return 0;
 }
 
+/**
+ * fdisk_script_set_json_indent:
+ * @dp: script
+ * @indent: indentation level or 0
+ *
+ * Sets the level of the JSON output in another JSON document. If @indent is
+ * not zero, the "partitiontable" object is written as a member of the already
+ * opened parent object at the @indent level (3 spaces for each level), the
+ * braces of the JSON document and the final new line are not written. The
+ * caller is expected to write the parent object.
+ *
+ * The default is 0, the complete JSON document is written.
+ *
+ * Returns: 0 on success, <0 on error.
+ *
+ * Since: 2.39
+ */
+int fdisk_script_set_json_indent(struct fdisk_script *dp, int indent)
+{
+	if (!dp || indent < 0)
+		return -EINVAL;
+
+	dp->json_indent = indent;
+	return 0;
+}
+
 static int write_file_json(struct fdisk_script *dp, FILE *f)
 {
 	struct list_head *h;
@@ -560,8 +588,9 @@ static int write_file_json(struct fdisk_script *dp, FILE *f)
 
 	DBG(SCRIPT, ul_debugobj(dp, "writing json dump to file"));
 
-	ul_jsonwrt_init(&json, f, 0);
-	ul_jsonwrt_root_open(&json);
+	ul_jsonwrt_init(&json, f, dp->json_indent);
+	if (!dp->json_indent)
+		ul_jsonwrt_root_open(&json);
 
 	ul_jsonwrt_object_open(&json, "partitiontable");
 
@@ -652,7 +681,8 @@ static int write_file_json(struct fdisk_script *dp, FILE *f)
 	ul_jsonwrt_array_close(&json);
 done:
 	ul_jsonwrt_object_close(&json);
-	ul_jsonwrt_root_close(&json);
+	if (!dp->json_indent)
+		ul_jsonwrt_root_close(&json);
 
 	DBG(SCRIPT, ul_debugobj(dp, "write script done"));
 	return 0;
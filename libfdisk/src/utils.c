@@ -11,21 +11,120 @@
  * @short_description: misc fdisk functions
  */
 
-static int read_from_device(struct fdisk_context *cxt,
-		unsigned char *buf,
-		uintmax_t start, size_t size)
+/*
+ * Read-ahead of the partition metadata.
+ *
+ * The label drivers read the metadata by many small reads (MBR, EBR chain,
+ * GPT headers and entries, BSD disklabel, ...) from the begin and the end of
+ * the device. It's expensive on devices with high latency. For read-only
+ * contexts the first and the last FDISK_READAHEAD_SIZE bytes of the device
+ * are read by one aligned read on the first access to the area and the small
+ * reads are served from memory.
+ *
+ * Read-write contexts always read from the device, we write to the device and
+ * libblkid (wipe) writes to the device too.
+ */
+static void readahead_setup(struct fdisk_context *cxt)
+{
+	struct fdisk_readahead *ra = cxt->ra;
+	uint64_t bytes = (uint64_t) cxt->total_sectors * cxt->sector_size;
+	unsigned long align = max(cxt->io_size, 4096UL);
+
+	if (bytes <= 2 * FDISK_READAHEAD_SIZE) {
+		ra[0].size = bytes;
+		ra[1].failed = 1;
+	} else {
+		ra[0].size = FDISK_READAHEAD_SIZE;
+		ra[1].off = (bytes - FDISK_READAHEAD_SIZE) / align * align;
+		ra[1].size = bytes - ra[1].off;
+	}
+	if (!ra[0].size)
+		ra[0].failed = 1;
+
+	DBG(CXT, ul_debugobj(cxt, "read-ahead: begin [0, %zu], end [%ju, %zu]",
+				ra[0].size, (uintmax_t) ra[1].off, ra[1].size));
+}
+
+static int readahead_fill(struct fdisk_context *cxt, struct fdisk_readahead *ra)
+{
+	size_t done = 0;
+
+	ra->done = 1;
+	ra->buf = malloc(ra->size);
+	if (!ra->buf)
+		goto fail;
+
+	while (done < ra->size) {
+		ssize_t r = pread(cxt->dev_fd, ra->buf + done,
+				  ra->size - done, ra->off + done);
+		if (r < 0 && (errno == EINTR || errno == EAGAIN))
+			continue;
+		if (r <= 0)
+			goto fail;
+		done += r;
+	}
+
+	DBG(CXT, ul_debugobj(cxt, "read-ahead: read %zu bytes from offset %ju",
+				ra->size, (uintmax_t) ra->off));
+	return 0;
+fail:
+	DBG(CXT, ul_debugobj(cxt, "read-ahead: failed to read %zu bytes from offset %ju: %m",
+				ra->size, (uintmax_t) ra->off));
+	free(ra->buf);
+	ra->buf = NULL;
+	ra->failed = 1;
+	return -1;
+}
+
+void fdisk_free_readahead(struct fdisk_context *cxt)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(cxt->ra); i++)
+		free(cxt->ra[i].buf);
+	memset(cxt->ra, 0, sizeof(cxt->ra));
+}
+
+/*
+ * Reads @size bytes from @offset; returns 0 or <0 on error (including
+ * short read).
+ */
+int fdisk_read_device(struct fdisk_context *cxt, void *buf,
+		uint64_t offset, size_t size)
 {
 	ssize_t r;
+	size_t i;
 
 	assert(cxt);
 
+	/* nested contexts share the device with the parent */
+	if (cxt->parent && cxt->parent->dev_fd == cxt->dev_fd)
+		return fdisk_read_device(cxt->parent, buf, offset, size);
+
+	if (cxt->readonly && !cxt->ra[0].size && !cxt->ra[0].failed)
+		readahead_setup(cxt);
+
+	for (i = 0; cxt->readonly && i < ARRAY_SIZE(cxt->ra); i++) {
+		struct fdisk_readahead *ra = &cxt->ra[i];
+
+		if (ra->failed || offset < ra->off
+		    || offset + size > ra->off + ra->size)
+			continue;
+		if (!ra->done && readahead_fill(cxt, ra) != 0)
+			break;
+
+		memcpy(buf, ra->buf + (offset - ra->off), size);
+		return 0;
+	}
+
 	DBG(CXT, ul_debugobj(cxt, "reading: offset=%ju, size=%zu",
-				start, size));
+				(uintmax_t) offset, size));
 
-	r = lseek(cxt->dev_fd, start, SEEK_SET);
+	r = lseek(cxt->dev_fd, offset, SEEK_SET);
 	if (r == -1)
 	{
-		DBG(CXT, ul_debugobj(cxt, "failed to seek to offset %ju: %m", start));
+		DBG(CXT, ul_debugobj(cxt, "failed to seek to offset %ju: %m",
+					(uintmax_t) offset));
 		return -errno;
 	}
 
@@ -34,7 +133,7 @@ static int read_from_device(struct fdisk_context *cxt,
 		if (!errno)
 			errno = EINVAL;	/* probably too small file/device */
 		DBG(CXT, ul_debugobj(cxt, "failed to read %zu from offset %ju: %m",
-				size, start));
+				size, (uintmax_t) offset));
 		return -errno;
 	}
 
@@ -83,7 +182,7 @@ int fdisk_init_firstsector_buffer(struct fdisk_context *cxt,
 		 * to be sure.			-- kzak 13-Apr-2015
 		 */
 		DBG(CXT, ul_debugobj(cxt, "first sector protection enabled -- re-reading"));
-		read_from_device(cxt, cxt->firstsector, protect_off, protect_size);
+		fdisk_read_device(cxt, cxt->firstsector, protect_off, protect_size);
 	}
 	return 0;
 }
@@ -102,7 +201,7 @@ int fdisk_read_firstsector(struct fdisk_context *cxt)
 	assert(cxt->sector_size == cxt->firstsector_bufsz);
 
 
-	return  read_from_device(cxt, cxt->firstsector, 0, cxt->sector_size);
+	return fdisk_read_device(cxt, cxt->firstsector, 0, cxt->sector_size);
 }
 
 /**
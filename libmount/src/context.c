@@ -40,6 +40,7 @@
 #include "fileutils.h"
 #include "strutils.h"
 #include "namespace.h"
+#include "loopdev.h"
 
 #include <sys/wait.h>
 
@@ -106,6 +107,7 @@ void mnt_free_context(struct libmnt_context *cxt)
 	mnt_unref_fs(cxt->fs_template);
 
 	mnt_context_clear_loopdev(cxt);
+	loopdev_unref_index(cxt->loopdev_index);
 	mnt_free_lock(cxt->lock);
 	mnt_free_update(cxt->update);
 
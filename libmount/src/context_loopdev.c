@@ -22,6 +22,23 @@
 #include "linux_version.h"
 
 
+/*
+ * Returns index of the used loop devices, the index is shared by all the
+ * loopdev lookups in the context (it survives mnt_reset_context()).
+ *
+ * Note that the index is private to the context. It saves the scans only
+ * if the context is used for more operations (e.g. "mount -a" or
+ * "umount -a"), the other libmount contexts have to scan the devices again.
+ */
+struct loopdev_index *mnt_context_get_loopdev_index(struct libmnt_context *cxt)
+{
+	assert(cxt);
+
+	if (!cxt->loopdev_index)
+		cxt->loopdev_index = loopdev_new_index();
+	return cxt->loopdev_index;
+}
+
 int mnt_context_is_loopdev(struct libmnt_context *cxt)
 {
 	const char *type, *src;
@@ -235,6 +252,7 @@ int mnt_context_setup_loopdev(struct libmnt_context *cxt)
 		if (rc)
 			goto done_no_deinit;
 
+		loopcxt_set_index(&lc, mnt_context_get_loopdev_index(cxt));
 		rc = loopcxt_find_overlap(&lc, backing_file, offset, sizelimit);
 		switch (rc) {
 		case 0: /* not found */
@@ -140,8 +140,14 @@ try_loopdev:
 			int count;
 			struct libmnt_cache *cache = mnt_context_get_cache(cxt);
 			const char *bf = cache ? mnt_resolve_path(tgt, cache) : tgt;
+			struct loopdev_cxt lc;
 
-			count = loopdev_count_by_backing_file(bf, &loopdev);
+			count = loopcxt_init(&lc, 0);
+			if (count == 0) {
+				loopcxt_set_index(&lc, mnt_context_get_loopdev_index(cxt));
+				count = loopcxt_count_by_backing_file(&lc, bf, &loopdev);
+				loopcxt_deinit(&lc);
+			}
 			if (count == 1) {
 				DBG(CXT, ul_debugobj(cxt,
 					"umount: %s --> %s (retry)", tgt, loopdev));
@@ -319,6 +319,7 @@ struct libmnt_context
 
 	int	optsmode;	/* fstab optstr mode MNT_OPTSMODE_{AUTO,FORCE,IGNORE} */
 	int	loopdev_fd;	/* open loopdev */
+	struct loopdev_index *loopdev_index;	/* used loop devices, see lib/loopdev.c */
 
 	unsigned long	mountflags;	/* final mount(2) flags */
 	const void	*mountdata;	/* final mount(2) data, string or binary data */
@@ -456,6 +457,7 @@ extern void mnt_free_addmount(struct libmnt_addmount *ad);
 extern int mnt_context_setup_loopdev(struct libmnt_context *cxt);
 extern int mnt_context_delete_loopdev(struct libmnt_context *cxt);
 extern int mnt_context_clear_loopdev(struct libmnt_context *cxt);
+extern struct loopdev_index *mnt_context_get_loopdev_index(struct libmnt_context *cxt);
 
 extern int mnt_fork_context(struct libmnt_context *cxt);
 
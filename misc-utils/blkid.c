@@ -18,6 +18,7 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <getopt.h>
+#include <pthread.h>
 
 #define OUTPUT_FULL		(1 << 0)
 #define OUTPUT_VALUE_ONLY	(1 << 1)
@@ -47,6 +48,10 @@
 #include "xalloc.h"
 
 #include "sysfs.h"
+#include "jsonwrt.h"
+#include "mbsalign.h"
+
+#define BATCH_MAX_THREADS	64
 
 struct blkid_control {
 	int output;
@@ -74,7 +79,8 @@ static void __attribute__((__noreturn__)) usage(void)
 			"       [--match-token <token>] [<dev> ...]\n\n"), program_invocation_short_name);
 	fprintf(out, _(	" %s -p [--match-tag <tag>] [--offset <offset>] [--size <size>] \n"
 			"       [--output <format>] <dev> ...\n\n"), program_invocation_short_name);
-	fprintf(out, _(	" %s -i [--match-tag <tag>] [--output <format>] <dev> ...\n"), program_invocation_short_name);
+	fprintf(out, _(	" %s -i [--match-tag <tag>] [--output <format>] <dev> ...\n\n"), program_invocation_short_name);
+	fprintf(out, _(	" %s --batch[=<threads>] [-i] [--match-tag <tag>] < <list>\n"), program_invocation_short_name);
 	fputs(USAGE_OPTIONS, out);
 	fputs(_(	" -c, --cache-file <file>    read from <file> instead of reading from the default\n"
 			"                              cache file (-c /dev/null means no cache)\n"), out);
@@ -98,6 +104,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(	" -u, --usages <list>        filter by \"usage\" (e.g. -u filesystem,raid)\n"), out);
 	fputs(_(	" -n, --match-types <list>   filter by filesystem type (e.g. -n vfat,ext3)\n"), out);
 	fputs(_(	" -D, --no-part-details      don't print info from partition table\n"), out);
+	fputs(_(	"     --batch[=<threads>]    probe devices read from stdin, print JSON lines\n"), out);
 
 	fputs(USAGE_SEPARATOR, out);
 	printf(USAGE_HELP_OPTIONS(28));
@@ -505,6 +512,26 @@ static int lowprobe_topology(blkid_probe pr)
 	return blkid_do_fullprobe(pr);
 }
 
+/* returns 1 for supported devices, 0 for unsupported or -errno */
+static int is_lowprobe_device(const char *devname)
+{
+	struct stat sb;
+
+	if (stat(devname, &sb) != 0)
+		return -errno;
+	if (S_ISBLK(sb.st_mode) || S_ISREG(sb.st_mode))
+		return 1;
+	if (S_ISCHR(sb.st_mode)) {
+		char buf[PATH_MAX];
+
+		if (!sysfs_chrdev_devno_to_devname(
+				sb.st_rdev, buf, sizeof(buf)))
+			return 0;
+		return strncmp(buf, "ubi", 3) == 0;
+	}
+	return 0;
+}
+
 static int lowprobe_device(blkid_probe pr, const char *devname,
 			   struct blkid_control *ctl)
 {
@@ -582,6 +609,218 @@ done:
 	return 0;		/* success */
 }
 
+static blkid_probe new_lowprobe(struct blkid_control *ctl, const char *hint,
+				int fltr_usage, int fltr_flag, char **fltr_type)
+{
+	blkid_probe pr = blkid_new_probe();
+
+	if (!pr)
+		return NULL;
+	if (hint && blkid_probe_set_hint(pr, hint, 0) != 0) {
+		warn(_("Failed to use probing hint: %s"), hint);
+		goto fail;
+	}
+
+	if (ctl->lowprobe_superblocks) {
+		blkid_probe_set_superblocks_flags(pr,
+			BLKID_SUBLKS_LABEL | BLKID_SUBLKS_UUID |
+			BLKID_SUBLKS_TYPE | BLKID_SUBLKS_SECTYPE |
+			BLKID_SUBLKS_USAGE | BLKID_SUBLKS_VERSION |
+			BLKID_SUBLKS_FSSIZE);
+
+
+		if (fltr_usage &&
+		    blkid_probe_filter_superblocks_usage(pr, fltr_flag, fltr_usage))
+			goto fail;
+
+		else if (fltr_type &&
+			 blkid_probe_filter_superblocks_type(pr, fltr_flag, fltr_type))
+			goto fail;
+	}
+	return pr;
+fail:
+	blkid_free_probe(pr);
+	return NULL;
+}
+
+/*
+ * --batch
+ *
+ * The device names are read from stdin by all the workers, every worker
+ * owns one probe reused for all its devices. The result for a device is
+ * composed in memory and written to stdout as one JSON line, in the order
+ * the devices are done.
+ */
+struct batch_pool {
+	struct blkid_control	*ctl;
+	pthread_mutex_t		in_lock;	/* stdin */
+	pthread_mutex_t		out_lock;	/* stdout */
+};
+
+struct batch_worker {
+	pthread_t		thread;
+	blkid_probe		pr;
+	struct batch_pool	*pool;
+};
+
+static void batch_device(blkid_probe pr, const char *devname,
+			 struct blkid_control *ctl, FILE *out)
+{
+	struct ul_jsonwrt json;
+	const char *errmsg = NULL;
+	int fd = -1, rc, n, nvals = 0;
+
+	ul_jsonwrt_init(&json, out, 0);
+	ul_jsonwrt_set_compact(&json, 1);
+	ul_jsonwrt_root_open(&json);
+	ul_jsonwrt_value_s(&json, "devname", devname);
+
+	rc = is_lowprobe_device(devname);
+	if (rc <= 0) {
+		errmsg = rc ? strerror(-rc) : _("unsupported device type");
+		goto done;
+	}
+
+	fd = open(devname, O_RDONLY|O_CLOEXEC|O_NONBLOCK);
+	if (fd < 0) {
+		errmsg = strerror(errno);
+		goto done;
+	}
+	errno = 0;
+	if (blkid_probe_set_device(pr, fd, ctl->offset, ctl->size)) {
+		errmsg = errno ? strerror(errno) : _("failed to assign device");
+		goto done;
+	}
+
+	rc = 0;
+	if (ctl->lowprobe_topology)
+		rc = lowprobe_topology(pr);
+	if (rc >= 0 && ctl->lowprobe_superblocks)
+		rc = lowprobe_superblocks(pr, ctl);
+	if (rc == -2)
+		errmsg = _("ambivalent result");
+	else if (rc < 0)
+		errmsg = _("probing failed");
+
+	if (!rc)
+		nvals = blkid_probe_numof_values(pr);
+
+	for (n = 0; n < nvals; n++) {
+		const char *name, *data;
+
+		if (blkid_probe_get_value(pr, n, &name, &data, NULL))
+			continue;
+		if (ctl->show[0] && !has_item(ctl, name))
+			continue;
+		if (!ctl->raw_chars) {
+			size_t width;
+			char *enc = mbs_invalid_encode(data, &width);
+
+			ul_jsonwrt_value_s(&json, name, enc ? enc : data);
+			free(enc);
+		} else
+			ul_jsonwrt_value_s(&json, name, data);
+	}
+done:
+	if (errmsg)
+		ul_jsonwrt_value_s(&json, "error", errmsg);
+	ul_jsonwrt_root_close(&json);
+
+	if (fd >= 0)
+		close(fd);
+}
+
+static void *batch_worker(void *data)
+{
+	struct batch_worker *wk = (struct batch_worker *) data;
+	struct batch_pool *bp = wk->pool;
+	char *line = NULL, *res = NULL;
+	size_t linesz = 0, ressz = 0;
+
+	do {
+		ssize_t len;
+		FILE *out;
+
+		pthread_mutex_lock(&bp->in_lock);
+		len = getline(&line, &linesz, stdin);
+		pthread_mutex_unlock(&bp->in_lock);
+		if (len < 0)
+			break;
+
+		if (len && line[len - 1] == '\n')
+			line[--len] = '\0';
+		if (!len)
+			continue;
+
+		out = open_memstream(&res, &ressz);
+		if (!out)
+			err(BLKID_EXIT_OTHER, _("cannot open memory stream"));
+		batch_device(wk->pr, line, bp->ctl, out);
+		fclose(out);
+
+		pthread_mutex_lock(&bp->out_lock);
+		fwrite(res, 1, ressz, stdout);
+		fflush(stdout);
+		pthread_mutex_unlock(&bp->out_lock);
+
+		free(res);
+		res = NULL;
+	} while (1);
+
+	free(line);
+	return NULL;
+}
+
+static int lowprobe_batch(struct blkid_control *ctl, size_t nthreads,
+			  const char *hint, int fltr_usage, int fltr_flag,
+			  char **fltr_type)
+{
+	struct batch_pool bp = { .ctl = ctl };
+	struct batch_worker *wks;
+	size_t i;
+	int rc = 0;
+
+	pthread_mutex_init(&bp.in_lock, NULL);
+	pthread_mutex_init(&bp.out_lock, NULL);
+
+	wks = xcalloc(nthreads, sizeof(struct batch_worker));
+	for (i = 0; i < nthreads; i++) {
+		wks[i].pool = &bp;
+		wks[i].pr = new_lowprobe(ctl, hint, fltr_usage, fltr_flag, fltr_type);
+		if (!wks[i].pr) {
+			rc = BLKID_EXIT_OTHER;
+			goto done;
+		}
+	}
+
+	if (nthreads == 1)
+		batch_worker(&wks[0]);
+	else {
+		for (i = 0; i < nthreads; i++) {
+			int e = pthread_create(&wks[i].thread, NULL,
+					       batch_worker, &wks[i]);
+			if (e) {
+				errno = e;
+				err(BLKID_EXIT_OTHER, _("failed to create thread"));
+			}
+		}
+		for (i = 0; i < nthreads; i++)
+			pthread_join(wks[i].thread, NULL);
+	}
+
+	if (ferror(stdin)) {
+		warnx(_("failed to read device names from standard input"));
+		rc = BLKID_EXIT_OTHER;
+	}
+done:
+	for (i = 0; i < nthreads; i++)
+		blkid_free_probe(wks[i].pr);
+	free(wks);
+	pthread_mutex_destroy(&bp.in_lock);
+	pthread_mutex_destroy(&bp.out_lock);
+	return rc;
+}
+
 /* converts comma separated list to BLKID_USAGE_* mask */
 static int list_to_usage(const char *list, int *flag)
 {
@@ -675,11 +914,15 @@ int main(int argc, char **argv)
 	int fltr_usage = 0;
 	char **fltr_type = NULL;
 	int fltr_flag = BLKID_FLTR_ONLYIN;
-	unsigned int numdev = 0, numtag = 0;
+	unsigned int numdev = 0, numtag = 0, batch = 0;
 	int err = BLKID_EXIT_OTHER;
 	unsigned int i;
 	int c;
 
+	enum {
+		OPT_BATCH = CHAR_MAX + 1
+	};
+
 	static const struct option longopts[] = {
 		{ "cache-file",	      required_argument, NULL, 'c' },
 		{ "no-encoding",      no_argument,	 NULL, 'd' },
@@ -699,6 +942,7 @@ int main(int argc, char **argv)
 		{ "offset",	      required_argument, NULL, 'O' },
 		{ "usages",	      required_argument, NULL, 'u' },
 		{ "match-types",      required_argument, NULL, 'n' },
+		{ "batch",	      optional_argument, NULL, OPT_BATCH },
 		{ "version",	      no_argument,	 NULL, 'V' },
 		{ "help",	      no_argument,       NULL, 'h' },
 		{ NULL, 0, NULL, 0 }
@@ -706,6 +950,7 @@ int main(int argc, char **argv)
 
 	static const ul_excl_t excl[] = {       /* rows and cols in ASCII order */
 		{ 'n','u' },
+		{ 'o', OPT_BATCH },
 		{ 0 }
 	};
 	int excl_st[ARRAY_SIZE(excl)] = UL_EXCL_STATUS_INIT;
@@ -720,7 +965,7 @@ int main(int argc, char **argv)
 	while ((c = getopt_long (argc, argv,
 			    "c:DdgH:hilL:n:ko:O:ps:S:t:u:U:w:Vv", longopts, NULL)) != -1) {
 
-		err_exclusive_options(c, NULL, excl, excl_st);
+		err_exclusive_options(c, longopts, excl, excl_st);
 
 		switch (c) {
 		case 'c':
@@ -824,6 +1069,17 @@ int main(int argc, char **argv)
 		case 'w':
 			/* ignore - backward compatibility */
 			break;
+		case OPT_BATCH:
+			batch = 1;
+			if (optarg) {
+				batch = strtou32_or_err(optarg,
+						_("invalid threads argument"));
+				if (!batch || batch > BATCH_MAX_THREADS)
+					errx(BLKID_EXIT_OTHER,
+					     _("number of threads must be in the range 1..%d"),
+					     BATCH_MAX_THREADS);
+			}
+			break;
 		case 'h':
 			usage();
 			break;
@@ -832,6 +1088,21 @@ int main(int argc, char **argv)
 		}
 	}
 
+	if (batch) {
+		if (optind < argc)
+			errx(BLKID_EXIT_OTHER, _("--batch reads the devices "
+				"from standard input"));
+
+		/* the low-level superblocks probing by default */
+		if (!ctl.lowprobe_topology)
+			ctl.lowprobe_superblocks = 1;
+		ctl.lowprobe = 1;
+
+		err = lowprobe_batch(&ctl, batch, hint, fltr_usage,
+				     fltr_flag, fltr_type);
+		goto exit;
+	}
+
 	if (ctl.lowprobe_topology || ctl.lowprobe_superblocks)
 		ctl.lowprobe = 1;
 
@@ -840,23 +1111,8 @@ int main(int argc, char **argv)
 		devices = xcalloc(argc - optind, sizeof(char *));
 		while (optind < argc) {
 			char *dev = argv[optind++];
-			struct stat sb;
 
-			if (stat(dev, &sb) != 0)
-				continue;
-			else if (S_ISBLK(sb.st_mode))
-				;
-			else if (S_ISREG(sb.st_mode))
-				;
-			else if (S_ISCHR(sb.st_mode)) {
-				char buf[PATH_MAX];
-
-				if (!sysfs_chrdev_devno_to_devname(
-						sb.st_rdev, buf, sizeof(buf)))
-					continue;
-				if (strncmp(buf, "ubi", 3) != 0)
-					continue;
-			} else
+			if (is_lowprobe_device(dev) <= 0)
 				continue;
 
 			devices[numdev++] = dev;
@@ -909,30 +1165,9 @@ int main(int argc, char **argv)
 		if (!ctl.output  && ctl.lowprobe_topology)
 			ctl.output = OUTPUT_EXPORT_LIST;
 
-		pr = blkid_new_probe();
+		pr = new_lowprobe(&ctl, hint, fltr_usage, fltr_flag, fltr_type);
 		if (!pr)
 			goto exit;
-		if (hint && blkid_probe_set_hint(pr, hint, 0) != 0) {
-			warn(_("Failed to use probing hint: %s"), hint);
-			goto exit;
-		}
-
-		if (ctl.lowprobe_superblocks) {
-			blkid_probe_set_superblocks_flags(pr,
-				BLKID_SUBLKS_LABEL | BLKID_SUBLKS_UUID |
-				BLKID_SUBLKS_TYPE | BLKID_SUBLKS_SECTYPE |
-				BLKID_SUBLKS_USAGE | BLKID_SUBLKS_VERSION |
-				BLKID_SUBLKS_FSSIZE);
-
-
-			if (fltr_usage &&
-			    blkid_probe_filter_superblocks_usage(pr, fltr_flag, fltr_usage))
-				goto exit;
-
-			else if (fltr_type &&
-				 blkid_probe_filter_superblocks_type(pr, fltr_flag, fltr_type))
-				goto exit;
-		}
 
 		for (i = 0; i < numdev; i++) {
 			err = lowprobe_device(pr, devices[i], &ctl);
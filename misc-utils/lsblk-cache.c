@@ -0,0 +1,424 @@
+/*
+ * Persistent cache for udev/blkid based device properties (see --cache).
+ *
+ * The cache is a text file with one section for each device:
+ *
+ *	device <maj>:<min> <diskseq> <node-mtime> <udev-mtime> <size>
+ *	FSTYPE=ext4
+ *	UUID=...
+ *
+ * The values are mangled (see mangle()). The section is valid only if the
+ * device has the same number, the whole-disk has the same diskseq (since Linux
+ * 5.15), and the device node, the udev database record of the device and the
+ * size are not modified. udevd rewrites the record on "change" uevent, which
+ * is generated when a device is modified (e.g. by mkfs). Devices without the
+ * udev record are not cached at all, there is no way to detect the changes.
+ *
+ * Sections for devices which do not exist anymore are removed when the cache
+ * is saved.
+ */
+#include <pthread.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#include "c.h"
+#include "pathnames.h"
+#include "xalloc.h"
+#include "nls.h"
+#include "mangle.h"
+#include "path.h"
+#include "strutils.h"
+#include "fileutils.h"
+#include "closestream.h"
+
+#include "lsblk.h"
+
+struct lsblk_cachestamp {
+	uint64_t	diskseq;	/* whole-disk sequence number */
+	struct timespec	mtime;		/* device node modification time */
+	struct timespec	udev_mtime;	/* udev database record modification time */
+	uint64_t	size;		/* device size */
+};
+
+struct lsblk_cachent {
+	dev_t		devno;
+	struct lsblk_cachestamp stamp;
+	struct lsblk_devprop	*properties;
+
+	struct list_head	entries;	/* item in cache->entries */
+
+	unsigned int	valid : 1,	/* properties are set */
+			seen : 1;	/* requested in this run */
+};
+
+struct lsblk_cache {
+	char		*filename;
+	struct list_head entries;
+	pthread_mutex_t	lock;		/* properties are read by threads */
+
+	unsigned int	modified : 1;
+};
+
+static struct lsblk_cache *cache;
+
+/* cached properties, see struct lsblk_devprop */
+static const struct lsblk_cachefield {
+	const char	*name;
+	size_t		offset;
+} cache_fields[] = {
+	{ "FSTYPE",	offsetof(struct lsblk_devprop, fstype) },
+	{ "FSVERSION",	offsetof(struct lsblk_devprop, fsversion) },
+	{ "UUID",	offsetof(struct lsblk_devprop, uuid) },
+	{ "PTUUID",	offsetof(struct lsblk_devprop, ptuuid) },
+	{ "PTTYPE",	offsetof(struct lsblk_devprop, pttype) },
+	{ "LABEL",	offsetof(struct lsblk_devprop, label) },
+	{ "PARTTYPE",	offsetof(struct lsblk_devprop, parttype) },
+	{ "PARTUUID",	offsetof(struct lsblk_devprop, partuuid) },
+	{ "PARTLABEL",	offsetof(struct lsblk_devprop, partlabel) },
+	{ "PARTFLAGS",	offsetof(struct lsblk_devprop, partflags) },
+	{ "WWN",	offsetof(struct lsblk_devprop, wwn) },
+	{ "SERIAL",	offsetof(struct lsblk_devprop, serial) },
+	{ "MODEL",	offsetof(struct lsblk_devprop, model) },
+	{ "IDLINK",	offsetof(struct lsblk_devprop, idlink) },
+};
+
+#define prop_field(_p, _f)	((char **) ((char *) (_p) + (_f)->offset))
+
+static struct lsblk_devprop *dup_properties(struct lsblk_devprop *p)
+{
+	struct lsblk_devprop *x;
+	size_t i;
+
+	if (!p)
+		return NULL;
+
+	x = xcalloc(1, sizeof(*x));
+	for (i = 0; i < ARRAY_SIZE(cache_fields); i++) {
+		char *str = *prop_field(p, &cache_fields[i]);
+
+		if (str)
+			*prop_field(x, &cache_fields[i]) = xstrdup(str);
+	}
+	return x;
+}
+
+static void free_entry(struct lsblk_cachent *ent)
+{
+	list_del(&ent->entries);
+	lsblk_device_free_properties(ent->properties);
+	free(ent);
+}
+
+static struct lsblk_cachent *get_entry(dev_t devno)
+{
+	struct list_head *p;
+
+	list_for_each(p, &cache->entries) {
+		struct lsblk_cachent *ent = list_entry(p, struct lsblk_cachent, entries);
+
+		if (ent->devno == devno)
+			return ent;
+	}
+	return NULL;
+}
+
+static struct lsblk_cachent *new_entry(dev_t devno)
+{
+	struct lsblk_cachent *ent = xcalloc(1, sizeof(*ent));
+
+	ent->devno = devno;
+	INIT_LIST_HEAD(&ent->entries);
+	list_add_tail(&ent->entries, &cache->entries);
+	return ent;
+}
+
+static int read_stamp(struct lsblk_device *dev, struct lsblk_cachestamp *st)
+{
+	struct lsblk_device *disk = dev->wholedisk ? dev->wholedisk : dev;
+	char path[sizeof(_PATH_UDEV_DATADIR) + sizeof(_PATH_SYS_DEVBLOCK) + 64];
+	struct stat sb;
+
+	memset(st, 0, sizeof(*st));
+
+	snprintf(path, sizeof(path), _PATH_UDEV_DATADIR "/b%d:%d",
+		 dev->maj, dev->min);
+	if (stat(path, &sb) != 0)
+		return -1;
+	st->udev_mtime = sb.st_mtim;
+
+	if (!dev->filename || stat(dev->filename, &sb) != 0)
+		return -1;
+	st->mtime = sb.st_mtim;
+
+	/* don't use dev->sysfs, the path context is not thread-safe */
+	snprintf(path, sizeof(path), _PATH_SYS_DEVBLOCK "/%d:%d/diskseq",
+		 disk->maj, disk->min);
+	if (ul_path_read_u64(NULL, &st->diskseq, path) != 0)
+		st->diskseq = 0;
+
+	st->size = dev->size;
+	return 0;
+}
+
+static int cmp_stamps(struct lsblk_cachestamp *a, struct lsblk_cachestamp *b)
+{
+	return a->diskseq == b->diskseq
+		&& a->mtime.tv_sec == b->mtime.tv_sec
+		&& a->mtime.tv_nsec == b->mtime.tv_nsec
+		&& a->udev_mtime.tv_sec == b->udev_mtime.tv_sec
+		&& a->udev_mtime.tv_nsec == b->udev_mtime.tv_nsec
+		&& a->size == b->size ? 0 : 1;
+}
+
+static void parse_cache(FILE *f)
+{
+	struct lsblk_cachent *ent = NULL;
+	char buf[BUFSIZ];
+
+	while (fgets(buf, sizeof(buf), f) != NULL) {
+		struct lsblk_cachestamp st = { 0 };
+		unsigned int maj, min;
+		uintmax_t sec, nsec, usec, unsec;
+		char *p;
+		size_t i;
+
+		p = strchr(buf, '\n');
+		if (!p)
+			break;		/* too long line; ignore rest of the file */
+		*p = '\0';
+
+		if (sscanf(buf, "device %u:%u %"SCNu64" %ju.%ju %ju.%ju %"SCNu64,
+			   &maj, &min, &st.diskseq, &sec, &nsec,
+			   &usec, &unsec, &st.size) == 8) {
+			st.mtime.tv_sec = sec;
+			st.mtime.tv_nsec = nsec;
+			st.udev_mtime.tv_sec = usec;
+			st.udev_mtime.tv_nsec = unsec;
+
+			ent = get_entry(makedev(maj, min));
+			if (ent)
+				free_entry(ent);
+			ent = new_entry(makedev(maj, min));
+			ent->stamp = st;
+			ent->valid = 1;
+			continue;
+		}
+		if (!ent || !(p = strchr(buf, '=')))
+			continue;
+
+		*p++ = '\0';
+		for (i = 0; i < ARRAY_SIZE(cache_fields); i++) {
+			char **str;
+
+			if (strcmp(buf, cache_fields[i].name) != 0)
+				continue;
+			if (!ent->properties)
+				ent->properties = xcalloc(1, sizeof(*ent->properties));
+			str = prop_field(ent->properties, &cache_fields[i]);
+			if (!*str) {
+				*str = xstrdup(p);
+				unmangle_string(*str);
+			}
+			break;
+		}
+	}
+}
+
+/*
+ * Reads the cache from @filename; the file does not have to exist. The cache
+ * file is ignored if it's not owned by root or by the current user, or if it's
+ * writable by group or others.
+ */
+void lsblk_cache_init(const char *filename)
+{
+	struct stat st;
+	FILE *f;
+
+	assert(filename);
+	assert(!cache);
+
+	cache = xcalloc(1, sizeof(*cache));
+	cache->filename = xstrdup(filename);
+	INIT_LIST_HEAD(&cache->entries);
+	pthread_mutex_init(&cache->lock, NULL);
+
+	f = fopen(filename, "r" UL_CLOEXECSTR);
+	if (!f)
+		return;
+	if (fstat(fileno(f), &st) == 0
+	    && (st.st_uid == 0 || st.st_uid == getuid())
+	    && !(st.st_mode & (S_IWGRP | S_IWOTH))) {
+		parse_cache(f);
+		DBG(DEV, ul_debug("cache: %s parsed", filename));
+	} else
+		DBG(DEV, ul_debug("cache: %s untrusted, ignored", filename));
+	fclose(f);
+}
+
+/*
+ * Returns 0 and sets @prop (maybe to NULL) if the cache contains valid
+ * properties for the device, otherwise returns 1 and the device is expected
+ * in lsblk_cache_set_properties() later.
+ */
+int lsblk_cache_get_properties(struct lsblk_device *dev, struct lsblk_devprop **prop)
+{
+	struct lsblk_cachestamp st;
+	struct lsblk_cachent *ent;
+	dev_t devno = makedev(dev->maj, dev->min);
+	int rc = 1;
+
+	if (!cache || read_stamp(dev, &st) != 0)
+		return 1;
+
+	pthread_mutex_lock(&cache->lock);
+
+	ent = get_entry(devno);
+	if (ent)
+		ent->seen = 1;
+	if (ent && ent->valid && cmp_stamps(&ent->stamp, &st) == 0) {
+		*prop = dup_properties(ent->properties);
+		rc = 0;
+	} else {
+		/* use the stamp from the time before the properties are read */
+		if (!ent) {
+			ent = new_entry(devno);
+			ent->seen = 1;
+		}
+		lsblk_device_free_properties(ent->properties);
+		ent->properties = NULL;
+		ent->stamp = st;
+		ent->valid = 0;
+	}
+
+	pthread_mutex_unlock(&cache->lock);
+
+	DBG(DEV, ul_debugobj(dev, "%s: cache %s", dev->name, rc == 0 ? "hit" : "miss"));
+	return rc;
+}
+
+void lsblk_cache_set_properties(struct lsblk_device *dev, struct lsblk_devprop *prop)
+{
+	struct lsblk_cachent *ent;
+
+	if (!cache)
+		return;
+
+	pthread_mutex_lock(&cache->lock);
+
+	ent = get_entry(makedev(dev->maj, dev->min));
+	if (ent && !ent->valid) {
+		ent->properties = dup_properties(prop);
+		ent->valid = 1;
+		cache->modified = 1;
+	}
+
+	pthread_mutex_unlock(&cache->lock);
+}
+
+static int write_cache(FILE *f)
+{
+	struct list_head *p;
+
+	fputs("# lsblk properties cache, do not edit\n", f);
+
+	list_for_each(p, &cache->entries) {
+		struct lsblk_cachent *ent = list_entry(p, struct lsblk_cachent, entries);
+		size_t i;
+
+		if (!ent->valid)
+			continue;
+
+		fprintf(f, "device %u:%u %"PRIu64" %ju.%09ju %ju.%09ju %"PRIu64"\n",
+			major(ent->devno), minor(ent->devno),
+			ent->stamp.diskseq,
+			(uintmax_t) ent->stamp.mtime.tv_sec,
+			(uintmax_t) ent->stamp.mtime.tv_nsec,
+			(uintmax_t) ent->stamp.udev_mtime.tv_sec,
+			(uintmax_t) ent->stamp.udev_mtime.tv_nsec,
+			ent->stamp.size);
+
+		for (i = 0; ent->properties && i < ARRAY_SIZE(cache_fields); i++) {
+			char *str = *prop_field(ent->properties, &cache_fields[i]);
+			char *x;
+
+			if (!str)
+				continue;
+			x = mangle(str);
+			if (x)
+				fprintf(f, "%s=%s\n", cache_fields[i].name, x);
+			free(x);
+		}
+	}
+	return close_stream(f);
+}
+
+/*
+ * Removes entries for devices which have not been requested in this run and
+ * do not exist anymore. The devices not requested (e.g. "lsblk /dev/sda") are
+ * kept, the next run may list them.
+ */
+static void prune_cache(void)
+{
+	struct list_head *p, *pnext;
+
+	list_for_each_safe(p, pnext, &cache->entries) {
+		struct lsblk_cachent *ent = list_entry(p, struct lsblk_cachent, entries);
+		char path[sizeof(_PATH_SYS_DEVBLOCK) + 32];
+
+		if (ent->seen)
+			continue;
+
+		snprintf(path, sizeof(path), _PATH_SYS_DEVBLOCK "/%u:%u",
+			 major(ent->devno), minor(ent->devno));
+		if (access(path, F_OK) == 0)
+			continue;
+
+		DBG(DEV, ul_debug("cache: remove %s", path));
+		free_entry(ent);
+		cache->modified = 1;
+	}
+}
+
+/*
+ * Saves the cache if modified; all errors are silently ignored (the cache is
+ * only optimization and unprivileged users usually cannot write to /run).
+ */
+void lsblk_cache_deinit(void)
+{
+	if (!cache)
+		return;
+
+	prune_cache();
+
+	if (cache->modified) {
+		char *dir = xstrdup(cache->filename), *tmp = NULL, *p;
+		FILE *f;
+
+		p = strrchr(dir, '/');
+		if (p)
+			*(p == dir ? p + 1 : p) = '\0';
+		else
+			strcpy(dir, ".");
+
+		f = xfmkstemp(&tmp, dir, ".lsblk-cache");
+		if (f) {
+			ignore_result( fchmod(fileno(f), 0644) );
+			if (write_cache(f) != 0 || rename(tmp, cache->filename) != 0)
+				unlink(tmp);
+			else
+				DBG(DEV, ul_debug("cache: %s saved", cache->filename));
+		}
+		free(tmp);
+		free(dir);
+	}
+
+	while (!list_empty(&cache->entries))
+		free_entry(list_entry(cache->entries.next,
+				      struct lsblk_cachent, entries));
+
+	pthread_mutex_destroy(&cache->lock);
+	free(cache->filename);
+	free(cache);
+	cache = NULL;
+}
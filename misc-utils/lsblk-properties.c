@@ -1,5 +1,6 @@
 
 #include <blkid.h>
+#include <pthread.h>
 
 #ifdef HAVE_LIBUDEV
 # include <libudev.h>
@@ -14,10 +15,26 @@
 
 #include "lsblk.h"
 
+/*
+ * libudev is not thread-safe, every thread has to use its own udev handler.
+ * Without libudev there is nothing to keep and the context is NULL.
+ */
+struct lsblk_propctx;
+
 #ifdef HAVE_LIBUDEV
-static struct udev *udev;
+struct lsblk_propctx {
+	struct udev *udev;
+};
+
+static struct lsblk_propctx main_ctx;	/* global handler */
+# define MAIN_PROPCTX	(&main_ctx)
+#else
+# define MAIN_PROPCTX	NULL
 #endif
 
+/* max number of threads to read properties, see lsblk_devtree_prefetch_properties() */
+#define LSBLK_PREFETCH_MAXTHREADS	16
+
 void lsblk_device_free_properties(struct lsblk_devprop *p)
 {
 	if (!p)
@@ -46,8 +63,9 @@ void lsblk_device_free_properties(struct lsblk_devprop *p)
 }
 
 #ifndef HAVE_LIBUDEV
-static struct lsblk_devprop *get_properties_by_udev(struct lsblk_device *dev
-				__attribute__((__unused__)))
+static struct lsblk_devprop *get_properties_by_udev(
+				struct lsblk_propctx *cx __attribute__((__unused__)),
+				struct lsblk_device *dev __attribute__((__unused__)))
 {
 	return NULL;
 }
@@ -56,7 +74,8 @@ static struct lsblk_devprop *get_properties_by_udev(struct lsblk_device *dev
 #define LSBLK_UDEV_BYID_PREFIX "/dev/disk/by-id/"
 #define LSBLK_UDEV_BYID_PREFIXSZ (sizeof(LSBLK_UDEV_BYID_PREFIX) - 1)
 
-static struct lsblk_devprop *get_properties_by_udev(struct lsblk_device *ld)
+static struct lsblk_devprop *get_properties_by_udev(struct lsblk_propctx *cx,
+						    struct lsblk_device *ld)
 {
 	struct udev_device *dev;
 	struct udev_list_entry *le;
@@ -67,12 +86,12 @@ static struct lsblk_devprop *get_properties_by_udev(struct lsblk_device *ld)
 	if (ld->udev_requested)
 		return ld->properties;
 
-	if (!udev)
-		udev = udev_new();	/* global handler */
-	if (!udev)
+	if (!cx->udev)
+		cx->udev = udev_new();
+	if (!cx->udev)
 		goto done;
 
-	dev = udev_device_new_from_subsystem_sysname(udev, "block", ld->name);
+	dev = udev_device_new_from_subsystem_sysname(cx->udev, "block", ld->name);
 	if (!dev)
 		goto done;
 
@@ -333,25 +352,130 @@ done:
 	return dev->properties;
 }
 
-struct lsblk_devprop *lsblk_device_get_properties(struct lsblk_device *dev)
+static struct lsblk_devprop *get_properties(struct lsblk_propctx *cx,
+					    struct lsblk_device *dev)
 {
 	struct lsblk_devprop *p = NULL;
+	int cache_miss = 0;
 
 	DBG(DEV, ul_debugobj(dev, "%s: properties requested", dev->filename));
 	if (lsblk->sysroot)
 		return get_properties_by_file(dev);
 
-	p = get_properties_by_udev(dev);
+	if (!dev->cache_requested) {
+		dev->cache_requested = 1;
+		if (lsblk_cache_get_properties(dev, &p) == 0) {
+			lsblk_device_free_properties(dev->properties);
+			dev->properties = p;
+			dev->udev_requested = dev->blkid_requested = 1;
+			return p;
+		}
+		cache_miss = 1;
+	}
+
+	p = get_properties_by_udev(cx, dev);
 	if (!p)
 		p = get_properties_by_blkid(dev);
+	if (cache_miss)
+		lsblk_cache_set_properties(dev, p);
 	return p;
 }
 
+struct lsblk_devprop *lsblk_device_get_properties(struct lsblk_device *dev)
+{
+	return get_properties(MAIN_PROPCTX, dev);
+}
+
+static void deinit_propctx(struct lsblk_propctx *cx __attribute__((__unused__)))
+{
+#ifdef HAVE_LIBUDEV
+	udev_unref(cx->udev);
+	cx->udev = NULL;
+#endif
+}
+
 void lsblk_properties_deinit(void)
 {
+	deinit_propctx(MAIN_PROPCTX);
+}
+
+struct lsblk_prefetch {
+	pthread_mutex_t		lock;
+	struct lsblk_device	**devs;
+	size_t			ndevs;
+	size_t			next;		/* the next unprocessed device */
+};
+
+static void *prefetch_thread(void *data)
+{
+	struct lsblk_prefetch *pf = data;
 #ifdef HAVE_LIBUDEV
-	udev_unref(udev);
+	struct lsblk_propctx ctx = { 0 }, *cx = &ctx;
+#else
+	struct lsblk_propctx *cx = NULL;
 #endif
+
+	for (;;) {
+		struct lsblk_device *dev = NULL;
+
+		pthread_mutex_lock(&pf->lock);
+		if (pf->next < pf->ndevs)
+			dev = pf->devs[pf->next++];
+		pthread_mutex_unlock(&pf->lock);
+
+		if (!dev)
+			break;
+		get_properties(cx, dev);
+	}
+
+	deinit_propctx(cx);
+	return NULL;
+}
+
+/*
+ * Reads properties of all devices in the tree by a pool of threads. The udev
+ * database and blkid probing are blocking operations (blkid reads from the
+ * devices), so it's better to wait for more devices at the same time. The
+ * properties are later used by lsblk_device_get_properties() without any
+ * additional I/O.
+ *
+ * Note that device_to_scols() has to be called after this function, the
+ * devices are not locked.
+ */
+void lsblk_devtree_prefetch_properties(struct lsblk_devtree *tr)
+{
+	struct lsblk_prefetch pf = { .lock = PTHREAD_MUTEX_INITIALIZER };
+	struct lsblk_iter itr;
+	struct lsblk_device *dev = NULL;
+	pthread_t threads[LSBLK_PREFETCH_MAXTHREADS];
+	size_t i, nthreads = 0;
+
+	lsblk_reset_iter(&itr, LSBLK_ITER_FORWARD);
+	while (lsblk_devtree_next_device(tr, &itr, &dev) == 0)
+		pf.ndevs++;
+	if (pf.ndevs < 2)
+		return;		/* nothing to do in parallel */
+
+	pf.devs = xcalloc(pf.ndevs, sizeof(struct lsblk_device *));
+
+	lsblk_reset_iter(&itr, LSBLK_ITER_FORWARD);
+	for (i = 0; lsblk_devtree_next_device(tr, &itr, &dev) == 0; i++)
+		pf.devs[i] = dev;
+
+	DBG(DEV, ul_debug("prefetching properties for %zu devices", pf.ndevs));
+
+	for (i = 0; i < min(pf.ndevs, (size_t) LSBLK_PREFETCH_MAXTHREADS); i++) {
+		if (pthread_create(&threads[i], NULL, prefetch_thread, &pf) != 0)
+			break;
+		nthreads++;
+	}
+
+	/* without threads the properties are read later on demand */
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+
+	pthread_mutex_destroy(&pf.lock);
+	free(pf.devs);
 }
 
 
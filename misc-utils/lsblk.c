@@ -349,6 +349,46 @@ static int column_id_to_number(int id)
 	return -1;
 }
 
+/*
+ * Returns 1 if any wanted column is based on udev/blkid properties, see
+ * lsblk_device_get_properties() calls in device_get_data().
+ */
+static int has_properties_column(void)
+{
+	size_t i;
+
+	for (i = 0; i < ncolumns; i++) {
+		switch (get_column_id(i)) {
+		case COL_OWNER:
+		case COL_GROUP:
+		case COL_MODE:
+			if (lsblk->sysroot)
+				return 1;
+			break;
+		case COL_FSTYPE:
+		case COL_FSVERSION:
+		case COL_LABEL:
+		case COL_UUID:
+		case COL_PTUUID:
+		case COL_PTTYPE:
+		case COL_PARTTYPE:
+		case COL_PARTTYPENAME:
+		case COL_PARTLABEL:
+		case COL_PARTUUID:
+		case COL_PARTFLAGS:
+		case COL_WWN:
+		case COL_IDLINK:
+		case COL_ID:
+		case COL_MODEL:
+		case COL_SERIAL:
+			return 1;
+		default:
+			break;
+		}
+	}
+	return 0;
+}
+
 /* Checks for DM prefix in the device name */
 static int is_dm(const char *name)
 {
@@ -1315,6 +1355,8 @@ static int initialize_device(struct lsblk_device *dev,
 		DBG(DEV, ul_debugobj(dev, "%s: failed to initialize sysfs handler", dev->name));
 		return -1;
 	}
+	/* lsblk reads some attributes more than once (e.g. for more columns) */
+	ul_path_enable_cache(dev->sysfs, 1);
 
 	dev->maj = major(devno);
 	dev->min = minor(devno);
@@ -1945,6 +1987,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -y, --shell          use column names to be usable as shell variable identifiers\n"), out);
 	fputs(_(" -z, --zoned          print zone related information\n"), out);
 	fputs(_("     --sysroot <dir>  use specified directory as system root\n"), out);
+	fputs(_("     --cache[=<file>] cache filesystem and partition properties\n"), out);
 	fputs(USAGE_SEPARATOR, out);
 	printf(USAGE_HELP_OPTIONS(22));
 
@@ -1979,14 +2022,17 @@ int main(int argc, char *argv[])
 	size_t i;
 	unsigned int width = 0;
 	int force_tree = 0, has_tree_col = 0;
+	const char *cachefile = NULL;
 
 	enum {
-		OPT_SYSROOT = CHAR_MAX + 1
+		OPT_SYSROOT = CHAR_MAX + 1,
+		OPT_CACHE
 	};
 
 	static const struct option longopts[] = {
 		{ "all",	no_argument,       NULL, 'a' },
 		{ "bytes",      no_argument,       NULL, 'b' },
+		{ "cache",      optional_argument, NULL, OPT_CACHE },
 		{ "nodeps",     no_argument,       NULL, 'd' },
 		{ "noempty",    no_argument,       NULL, 'A' },
 		{ "discard",    no_argument,       NULL, 'D' },
@@ -2176,6 +2222,9 @@ int main(int argc, char *argv[])
 		case OPT_SYSROOT:
 			lsblk->sysroot = optarg;
 			break;
+		case OPT_CACHE:
+			cachefile = optarg ? optarg : _PATH_LSBLK_CACHE;
+			break;
 		case 'E':
 			lsblk->dedup_id = column_name_to_id(optarg, strlen(optarg));
 			if (lsblk->dedup_id >= 0)
@@ -2247,6 +2296,8 @@ int main(int argc, char *argv[])
 	}
 
 	lsblk_mnt_init();
+	if (cachefile && !lsblk->sysroot)
+		lsblk_cache_init(cachefile);
 	scols_init_debug(0);
 	ul_path_init_debug();
 
@@ -2364,6 +2415,9 @@ int main(int argc, char *argv[])
 					  EXIT_SUCCESS;		/* all success */
 	}
 
+	if (has_properties_column())
+		lsblk_devtree_prefetch_properties(tr);
+
 	if (lsblk->dedup_id > -1) {
 		devtree_set_dedupkeys(tr, lsblk->dedup_id);
 		lsblk_devtree_deduplicate_devices(tr);
@@ -2385,6 +2439,7 @@ leave:
 	scols_unref_table(lsblk->table);
 
 	lsblk_mnt_deinit();
+	lsblk_cache_deinit();
 	lsblk_properties_deinit();
 	lsblk_unref_devtree(tr);
 
@@ -140,7 +140,8 @@ struct lsblk_device {
 			is_printed : 1,
 			udev_requested : 1,
 			blkid_requested : 1,
-			file_requested : 1;
+			file_requested : 1,
+			cache_requested : 1;
 };
 
 #define device_is_partition(_x)		((_x)->wholedisk != NULL)
@@ -219,9 +220,16 @@ extern struct libmnt_fs **lsblk_device_get_filesystems(struct lsblk_device *dev,
 extern void lsblk_device_free_properties(struct lsblk_devprop *p);
 extern struct lsblk_devprop *lsblk_device_get_properties(struct lsblk_device *dev);
 extern void lsblk_properties_deinit(void);
+extern void lsblk_devtree_prefetch_properties(struct lsblk_devtree *tr);
 
 extern const char *lsblk_parttype_code_to_string(const char *code, const char *pttype);
 
+/* lsblk-cache.c */
+extern void lsblk_cache_init(const char *filename);
+extern int lsblk_cache_get_properties(struct lsblk_device *dev, struct lsblk_devprop **prop);
+extern void lsblk_cache_set_properties(struct lsblk_device *dev, struct lsblk_devprop *prop);
+extern void lsblk_cache_deinit(void);
+
 /* lsblk-devtree.c */
 void lsblk_reset_iter(struct lsblk_iter *itr, int direction);
 struct lsblk_device *lsblk_new_device(void);
@@ -22,6 +22,7 @@
 #include <sys/types.h>
 #include <ctype.h>
 #include <errno.h>
+#include <stdarg.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -30,6 +31,10 @@
 #include <string.h>
 #include <limits.h>
 #include <libgen.h>
+#include <pthread.h>
+#ifdef HAVE_LINUX_BLKZONED_H
+# include <linux/blkzoned.h>
+#endif
 
 #include <blkid.h>
 #include <libsmartcols.h>
@@ -74,6 +79,8 @@ struct wipe_control {
 	char		**reread;		/* devices to BLKRRPART */
 	size_t		nrereads;		/* size of reread */
 
+	FILE		*out;			/* erase messages */
+
 	unsigned int	noact : 1,
 			all : 1,
 			quiet : 1,
@@ -81,7 +88,8 @@ struct wipe_control {
 			force : 1,
 			json : 1,
 			no_headings : 1,
-			parsable : 1;
+			parsable : 1,
+			parallel : 1;
 };
 
 
@@ -359,6 +367,22 @@ static struct wipe_desc *get_desc_for_probe(struct wipe_control *ctl,
 	return wp;
 }
 
+static void setup_probe(blkid_probe pr)
+{
+	blkid_probe_enable_superblocks(pr, 1);
+	blkid_probe_set_superblocks_flags(pr,
+			BLKID_SUBLKS_MAGIC |	/* return magic string and offset */
+			BLKID_SUBLKS_TYPE |	/* return superblock type */
+			BLKID_SUBLKS_USAGE |	/* return USAGE= */
+			BLKID_SUBLKS_LABEL |	/* return LABEL= */
+			BLKID_SUBLKS_UUID |	/* return UUID= */
+			BLKID_SUBLKS_BADCSUM);	/* accept bad checksums */
+
+	blkid_probe_enable_partitions(pr, 1);
+	blkid_probe_set_partitions_flags(pr, BLKID_PARTS_MAGIC |
+					     BLKID_PARTS_FORCE_GPT);
+}
+
 static blkid_probe
 new_probe(const char *devname, int mode)
 {
@@ -383,18 +407,7 @@ new_probe(const char *devname, int mode)
 	if (!pr)
 		goto error;
 
-	blkid_probe_enable_superblocks(pr, 1);
-	blkid_probe_set_superblocks_flags(pr,
-			BLKID_SUBLKS_MAGIC |	/* return magic string and offset */
-			BLKID_SUBLKS_TYPE |	/* return superblock type */
-			BLKID_SUBLKS_USAGE |	/* return USAGE= */
-			BLKID_SUBLKS_LABEL |	/* return LABEL= */
-			BLKID_SUBLKS_UUID |	/* return UUID= */
-			BLKID_SUBLKS_BADCSUM);	/* accept bad checksums */
-
-	blkid_probe_enable_partitions(pr, 1);
-	blkid_probe_set_partitions_flags(pr, BLKID_PARTS_MAGIC |
-					     BLKID_PARTS_FORCE_GPT);
+	setup_probe(pr);
 	return pr;
 error:
 	blkid_free_probe(pr);
@@ -443,48 +456,90 @@ static void free_wipe(struct wipe_desc *wp)
 	}
 }
 
-static void do_wipe_real(struct wipe_control *ctl, blkid_probe pr,
-			struct wipe_desc *w)
+static void print_erased(struct wipe_control *ctl, struct wipe_desc *w)
 {
+	FILE *out = ctl->out ? ctl->out : stdout;
 	size_t i;
 
-	if (blkid_do_wipe(pr, ctl->noact) != 0)
-		err(EXIT_FAILURE, _("%s: failed to erase %s magic string at offset 0x%08jx"),
-		     ctl->devname, w->type, (intmax_t)w->offset);
-
 	if (ctl->quiet)
 		return;
 
-	printf(P_("%s: %zd byte was erased at offset 0x%08jx (%s): ",
-		  "%s: %zd bytes were erased at offset 0x%08jx (%s): ",
-		  w->len),
+	fprintf(out, P_("%s: %zd byte was erased at offset 0x%08jx (%s): ",
+		       "%s: %zd bytes were erased at offset 0x%08jx (%s): ",
+		       w->len),
 	       ctl->devname, w->len, (intmax_t)w->offset, w->type);
 
 	for (i = 0; i < w->len; i++) {
-		printf("%02x", w->magic[i]);
+		fprintf(out, "%02x", w->magic[i]);
 		if (i + 1 < w->len)
-			fputc(' ', stdout);
+			fputc(' ', out);
 	}
-	putchar('\n');
+	fputc('\n', out);
+}
+
+static void do_wipe_real(struct wipe_control *ctl, blkid_probe pr,
+			struct wipe_desc *w)
+{
+	if (blkid_do_wipe(pr, ctl->noact) != 0)
+		err(EXIT_FAILURE, _("%s: failed to erase %s magic string at offset 0x%08jx"),
+		     ctl->devname, w->type, (intmax_t)w->offset);
+
+	print_erased(ctl, w);
+}
+
+/* warn() and warnx() for the workers; the messages are buffered in the job
+ * and printed by the main thread, so they are not mixed with the others */
+static void __attribute__ ((__format__ (__printf__, 3, 4)))
+job_warn(FILE *f, int errsv, const char *fmt, ...)
+{
+	va_list ap;
+
+	fprintf(f, "%s: ", program_invocation_short_name);
+	va_start(ap, fmt);
+	vfprintf(f, fmt, ap);
+	va_end(ap);
+	if (errsv)
+		fprintf(f, ": %s", strerror(errsv));
+	fputc('\n', f);
 }
 
-static void do_backup(struct wipe_desc *wp, const char *base)
+static int do_backup(struct wipe_desc *wp, const char *base, FILE *errf)
 {
 	char *fname = NULL;
-	int fd;
+	int fd, errsv;
 
 	xasprintf(&fname, "%s0x%08jx.bak", base, (intmax_t)wp->offset);
 
 	fd = open(fname, O_CREAT | O_WRONLY, S_IRUSR | S_IWUSR);
 	if (fd < 0)
 		goto err;
-	if (write_all(fd, wp->magic, wp->len) != 0)
+	if (write_all(fd, wp->magic, wp->len) != 0) {
+		errsv = errno;
+		close(fd);
+		errno = errsv;
 		goto err;
+	}
 	close(fd);
 	free(fname);
-	return;
+	return 0;
 err:
-	err(EXIT_FAILURE, _("%s: failed to create a signature backup"), fname);
+	job_warn(errf, errno, _("%s: failed to create a signature backup"), fname);
+	free(fname);
+	return -1;
+}
+
+static char *get_backup_base(struct wipe_control *ctl)
+{
+	const char *home = getenv ("HOME");
+	char *tmp, *base = NULL;
+
+	if (!home)
+		errx(EXIT_FAILURE, _("failed to create a signature backup, $HOME undefined"));
+
+	tmp = xstrdup(ctl->devname);
+	xasprintf (&base, "%s/wipefs-%s-", home, basename(tmp));
+	free(tmp);
+	return base;
 }
 
 #ifdef BLKRRPART
@@ -534,15 +589,8 @@ static int do_wipe(struct wipe_control *ctl)
 		return -1;
 	}
 
-	if (ctl->backup) {
-		const char *home = getenv ("HOME");
-		char *tmp = xstrdup(ctl->devname);
-
-		if (!home)
-			errx(EXIT_FAILURE, _("failed to create a signature backup, $HOME undefined"));
-		xasprintf (&backup, "%s/wipefs-%s-", home, basename(tmp));
-		free(tmp);
-	}
+	if (ctl->backup)
+		backup = get_backup_base(ctl);
 
 	while (blkid_do_probe(pr) == 0) {
 		int wiped = 0;
@@ -563,8 +611,8 @@ static int do_wipe(struct wipe_control *ctl)
 			goto done;
 		}
 
-		if (backup)
-			do_backup(wp, backup);
+		if (backup && do_backup(wp, backup, stderr) != 0)
+			exit(EXIT_FAILURE);
 		do_wipe_real(ctl, pr, wp);
 		if (wp->is_parttable)
 			reread = 1;
@@ -624,6 +672,352 @@ static int do_wipe(struct wipe_control *ctl)
 }
 
 
+/*
+ * --parallel
+ *
+ * Devices are wiped concurrently. Every device is probed only once: all
+ * signatures are collected (and hidden in the probing buffers, so libblkid
+ * can continue with the next one), then the magic strings are zeroed in one
+ * pass sorted by offset and flushed by one fsync. Devices on the same whole
+ * disk are processed one after another by the same thread, otherwise
+ * O_EXCL would fail for the partitions while the whole disk is open.
+ */
+#define WIPE_MAX_THREADS	32
+
+struct wipe_job {
+	char		*devname;
+	dev_t		disk;		/* whole-disk devno or st_dev of a file */
+	ino_t		ino;		/* inode of a regular file */
+	struct wipe_job	*next;		/* next device on the same disk */
+
+	char		*msg;		/* buffered erase messages */
+	size_t		msgsz;
+	char		*errmsg;	/* buffered warnings */
+	size_t		errmsgsz;
+	int		rc;
+
+	unsigned int	reread : 1;
+};
+
+struct wipe_pool {
+	struct wipe_control *ctl;
+	struct wipe_job	**disks;	/* first job for each disk */
+	size_t		ndisks;
+	size_t		next;		/* next disk to process */
+	pthread_mutex_t	lock;
+};
+
+static int is_zoned(int fd)
+{
+#if defined(HAVE_LINUX_BLKZONED_H) && defined(BLKGETZONESZ)
+	uint32_t zone_size = 0;
+
+	if (ioctl(fd, BLKGETZONESZ, &zone_size) == 0 && zone_size)
+		return 1;
+#endif
+	return 0;
+}
+
+static int cmp_desc_offset(const void *a, const void *b)
+{
+	const struct wipe_desc *x = *(struct wipe_desc * const *) a,
+			       *y = *(struct wipe_desc * const *) b;
+
+	return x->offset < y->offset ? -1 : x->offset > y->offset;
+}
+
+static int write_zeroes(int fd, loff_t offset, size_t len)
+{
+	static const char zeros[BUFSIZ];
+
+	while (len) {
+		ssize_t rc = pwrite(fd, zeros, min(len, sizeof(zeros)), offset);
+
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		offset += rc;
+		len -= rc;
+	}
+	return 0;
+}
+
+/* Zero all collected magic strings; adjacent or overlapping strings are
+ * merged to one write. */
+static int write_collected(int fd, struct wipe_desc *wp0, size_t nwps)
+{
+	struct wipe_desc **wps, *wp;
+	size_t i, n = 0;
+	int rc = 0;
+
+	wps = xcalloc(nwps, sizeof(struct wipe_desc *));
+	for (wp = wp0; wp; wp = wp->next)
+		wps[n++] = wp;
+	qsort(wps, n, sizeof(struct wipe_desc *), cmp_desc_offset);
+
+	for (i = 0; rc == 0 && i < n; ) {
+		loff_t start = wps[i]->offset,
+		       end = start + wps[i]->len;
+
+		for (i++; i < n && wps[i]->offset <= end; i++)
+			end = max(end, (loff_t) (wps[i]->offset + wps[i]->len));
+
+		rc = write_zeroes(fd, start, end - start);
+	}
+
+	free(wps);
+	return rc;
+}
+
+static void wipe_job_device(struct wipe_control *ctl0, struct wipe_job *job)
+{
+	struct wipe_control ctl = *ctl0;
+	struct wipe_desc *wp0 = NULL, *last = NULL, *w;
+	blkid_probe pr = NULL;
+	char *backup = NULL;
+	size_t nwps = 0;
+	int fd, mode = O_RDWR, zoned, need_force = 0, reread = 0;
+	FILE *errf;
+
+	ctl.devname = job->devname;
+	ctl.offsets = NULL;
+	for (w = ctl0->offsets; w; w = w->next)
+		add_offset(&ctl.offsets, w->offset);
+
+	if (!ctl.force)
+		mode |= O_EXCL;
+
+	job->msg = job->errmsg = NULL;
+	ctl.out = open_memstream(&job->msg, &job->msgsz);
+	errf = open_memstream(&job->errmsg, &job->errmsgsz);
+	if (!ctl.out || !errf)
+		err(EXIT_FAILURE, _("failed to allocate output buffer"));
+
+	fd = open(ctl.devname, mode | O_NONBLOCK);
+	if (fd < 0 || !(pr = blkid_new_probe())
+	    || blkid_probe_set_device(pr, fd, 0, 0) != 0) {
+		job_warn(errf, errno, _("error: %s: probing initialization failed"),
+			 ctl.devname);
+		job->rc = -1;
+		if (fd >= 0)
+			close(fd);
+		goto done;
+	}
+	setup_probe(pr);
+
+	if (blkdev_lock(fd, ctl.devname, ctl.lockmode) != 0) {
+		job->rc = -1;
+		close(fd);
+		goto done;
+	}
+
+	if (ctl.backup)
+		backup = get_backup_base(&ctl);
+
+	/* zones have to be reset by libblkid, wipe them one by one */
+	zoned = is_zoned(fd);
+
+	while (blkid_do_probe(pr) == 0) {
+		size_t len = 0;
+		loff_t offset = 0;
+		struct wipe_desc *wp;
+
+		wp = get_desc_for_probe(&ctl, NULL, pr, &offset, &len);
+		if (wp && !ctl.force
+		    && wp->is_parttable
+		    && !blkid_probe_is_wholedisk(pr)) {
+			job_warn(errf, 0, _("%s: ignoring nested \"%s\" partition table "
+				"on non-whole disk device"), ctl.devname, wp->type);
+			need_force = 1;
+			free_wipe(wp);
+			wp = NULL;
+		}
+		if (!wp) {
+			if (len) {
+				blkid_probe_hide_range(pr, offset, len);
+				blkid_probe_step_back(pr);
+			}
+			continue;
+		}
+
+		if (last)
+			last->next = wp;
+		else
+			wp0 = wp;
+		last = wp;
+		nwps++;
+
+		if (backup && do_backup(wp, backup, errf) != 0) {
+			job->rc = -1;
+			break;
+		}
+		/* hide in memory only, unless the zone has to be reset now */
+		if (blkid_do_wipe(pr, zoned ? ctl.noact : 1) != 0) {
+			job_warn(errf, errno, _("%s: failed to erase %s magic string at offset 0x%08jx"),
+				 ctl.devname, wp->type, (intmax_t)wp->offset);
+			job->rc = -1;
+			break;
+		}
+		if (wp->is_parttable)
+			reread = 1;
+	}
+
+	if (job->rc == 0 && !zoned && !ctl.noact && wp0) {
+		int rc = write_collected(fd, wp0, nwps);
+
+		if (rc) {
+			job_warn(errf, -rc, _("%s: failed to erase signatures"),
+				 ctl.devname);
+			job->rc = -1;
+		}
+	}
+	if (job->rc == 0 && fsync(fd) != 0) {
+		job_warn(errf, errno, _("%s: cannot flush modified buffers"),
+			 ctl.devname);
+		job->rc = -1;
+	}
+
+	if (job->rc == 0) {
+		for (w = wp0; w; w = w->next)
+			print_erased(&ctl, w);
+		for (w = ctl.offsets; w; w = w->next) {
+			if (!w->on_disk && !ctl.quiet)
+				job_warn(errf, 0, _("%s: offset 0x%jx not found"),
+						ctl.devname, (uintmax_t)w->offset);
+		}
+		if (need_force)
+			job_warn(errf, 0, _("Use the --force option to force erase."));
+		job->reread = reread && (mode & O_EXCL);
+	}
+
+	if (close(fd) != 0 && job->rc == 0) {
+		job_warn(errf, errno, _("%s: close device failed"), ctl.devname);
+		job->rc = -1;
+	}
+done:
+	fclose(ctl.out);
+	fclose(errf);
+	blkid_free_probe(pr);
+	free_wipe(wp0);
+	free_wipe(ctl.offsets);
+	free(backup);
+}
+
+static void *wipe_worker(void *data)
+{
+	struct wipe_pool *pool = data;
+
+	do {
+		struct wipe_job *job = NULL;
+
+		pthread_mutex_lock(&pool->lock);
+		if (pool->next < pool->ndisks)
+			job = pool->disks[pool->next++];
+		pthread_mutex_unlock(&pool->lock);
+
+		if (!job)
+			break;
+		for (; job; job = job->next)
+			wipe_job_device(pool->ctl, job);
+	} while (1);
+
+	return NULL;
+}
+
+static int do_wipe_parallel(struct wipe_control *ctl, char **devnames, size_t ndevs)
+{
+	struct wipe_pool pool = { .ctl = ctl };
+	struct wipe_job *jobs;
+	pthread_t *threads;
+	size_t i, j, nthreads;
+	int ec = EXIT_SUCCESS;
+
+	jobs = xcalloc(ndevs, sizeof(struct wipe_job));
+	pool.disks = xcalloc(ndevs, sizeof(struct wipe_job *));
+
+	for (i = 0; i < ndevs; i++) {
+		struct wipe_job *job = &jobs[i];
+		struct stat st;
+
+		job->devname = devnames[i];
+		if (stat(job->devname, &st) == 0) {
+			if (S_ISBLK(st.st_mode)) {
+				if (blkid_devno_to_wholedisk(st.st_rdev, NULL, 0,
+							     &job->disk) != 0)
+					job->disk = st.st_rdev;
+			} else {
+				job->disk = st.st_dev;
+				job->ino = st.st_ino;
+			}
+		}
+
+		/* append to the disk, the order of the arguments is kept */
+		for (j = 0; j < pool.ndisks; j++) {
+			struct wipe_job *x = pool.disks[j];
+
+			if (x->disk == job->disk && x->ino == job->ino) {
+				while (x->next)
+					x = x->next;
+				x->next = job;
+				break;
+			}
+		}
+		if (j == pool.ndisks)
+			pool.disks[pool.ndisks++] = job;
+	}
+
+	nthreads = min(pool.ndisks, (size_t) WIPE_MAX_THREADS);
+	threads = xcalloc(nthreads, sizeof(pthread_t));
+	pthread_mutex_init(&pool.lock, NULL);
+
+	for (i = 0; i < nthreads; i++) {
+		int rc = pthread_create(&threads[i], NULL, wipe_worker, &pool);
+		if (rc) {
+			errno = rc;
+			err(EXIT_FAILURE, _("failed to create thread"));
+		}
+	}
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+
+	pthread_mutex_destroy(&pool.lock);
+
+	for (i = 0; i < ndevs; i++) {
+		if (jobs[i].msg)
+			fputs(jobs[i].msg, stdout);
+		if (jobs[i].errmsg) {
+			fflush(stdout);
+			fputs(jobs[i].errmsg, stderr);
+		}
+		free(jobs[i].msg);
+		free(jobs[i].errmsg);
+		if (jobs[i].rc)
+			ec = EXIT_FAILURE;
+	}
+
+#ifdef BLKRRPART
+	/* all is erased, now re-read partition tables */
+	for (i = 0; i < ndevs; i++) {
+		int fd;
+
+		if (!jobs[i].reread)
+			continue;
+		fd = open(jobs[i].devname, O_RDONLY);
+		if (fd >= 0) {
+			rereadpt(fd, jobs[i].devname);
+			close(fd);
+		}
+	}
+#endif
+	free(threads);
+	free(pool.disks);
+	free(jobs);
+	return ec;
+}
+
+
 static void __attribute__((__noreturn__))
 usage(void)
 {
@@ -643,6 +1037,7 @@ usage(void)
 	puts(_(" -J, --json          use JSON output format"));
 	puts(_(" -n, --no-act        do everything except the actual write() call"));
 	puts(_(" -o, --offset <num>  offset to erase, in bytes"));
+	puts(_("     --parallel      wipe all the devices concurrently"));
 	puts(_(" -O, --output <list> COLUMNS to display (see below)"));
 	puts(_(" -p, --parsable      print out in parsable instead of printable format"));
 	puts(_(" -q, --quiet         suppress output messages"));
@@ -673,6 +1068,7 @@ main(int argc, char **argv)
 	char *outarg = NULL;
 	enum {
 		OPT_LOCK = CHAR_MAX + 1,
+		OPT_PARALLEL,
 	};
 	static const struct option longopts[] = {
 	    { "all",       no_argument,       NULL, 'a' },
@@ -682,6 +1078,7 @@ main(int argc, char **argv)
 	    { "lock",      optional_argument, NULL, OPT_LOCK },
 	    { "no-act",    no_argument,       NULL, 'n' },
 	    { "offset",    required_argument, NULL, 'o' },
+	    { "parallel",  no_argument,       NULL, OPT_PARALLEL },
 	    { "parsable",  no_argument,       NULL, 'p' },
 	    { "quiet",     no_argument,       NULL, 'q' },
 	    { "types",     required_argument, NULL, 't' },
@@ -751,6 +1148,9 @@ main(int argc, char **argv)
 				ctl.lockmode = optarg;
 			}
 			break;
+		case OPT_PARALLEL:
+			ctl.parallel = 1;
+			break;
 		case 'h':
 			usage();
 		case 'V':
@@ -768,6 +1168,8 @@ main(int argc, char **argv)
 
 	if (ctl.backup && !(ctl.all || ctl.offsets))
 		warnx(_("The --backup option is meaningless in this context"));
+	if (ctl.parallel && !(ctl.all || ctl.offsets))
+		warnx(_("The --parallel option is meaningless in this context"));
 
 	if (!ctl.all && !ctl.offsets) {
 		/*
@@ -811,6 +1213,12 @@ main(int argc, char **argv)
 		 */
 		ctl.ndevs = argc - optind;
 
+		if (ctl.parallel) {
+			if (ctl.backup && !getenv("HOME"))
+				errx(EXIT_FAILURE, _("failed to create a signature backup, $HOME undefined"));
+			return do_wipe_parallel(&ctl, argv + optind, ctl.ndevs);
+		}
+
 		while (optind < argc) {
 			ctl.devname = argv[optind++];
 			do_wipe(&ctl);
@@ -32,6 +32,7 @@
 #include <limits.h>
 #include <getopt.h>
 #include <time.h>
+#include <pthread.h>
 
 #include <sys/ioctl.h>
 #include <sys/stat.h>
@@ -46,7 +47,9 @@
 #include "strutils.h"
 #include "c.h"
 #include "closestream.h"
+#include "xalloc.h"
 #include "monotonic.h"
+#include "sysfs.h"
 
 #ifndef BLKDISCARD
 # define BLKDISCARD	_IO(0x12,119)
@@ -81,6 +84,177 @@ static void print_stats(int act, char *path, uint64_t stats[])
 	}
 }
 
+/*
+ * Parallel engine, used for --threads and --rate. The range is split to
+ * steps and every thread issues one ioctl after another for the next unused
+ * step. The bandwidth is limited by delaying the next ioctl until the time
+ * when the already issued bytes meet the rate.
+ */
+struct discard_ctl {
+	int		fd;
+	int		act;
+	char		*path;
+
+	uint64_t	offset;		/* range start */
+	uint64_t	next;		/* the next unused step */
+	uint64_t	end;
+	uint64_t	step;
+	uint64_t	rate;		/* max bytes per second or 0 */
+
+	uint64_t	issued;		/* bytes issued to the device */
+	uint64_t	done;		/* bytes finished */
+	uint64_t	reported;	/* bytes in the last progress report */
+
+	struct timeval	start;
+	struct timeval	last;		/* last progress report */
+
+	pthread_mutex_t	lock;
+
+	unsigned int	verbose : 1;
+};
+
+static void discard_range(int fd, int act, const char *path, uint64_t range[2])
+{
+	switch (act) {
+	case ACT_ZEROOUT:
+		if (ioctl(fd, BLKZEROOUT, range))
+			 err(EXIT_FAILURE, _("%s: BLKZEROOUT ioctl failed"), path);
+		break;
+	case ACT_SECURE:
+		if (ioctl(fd, BLKSECDISCARD, range))
+			err(EXIT_FAILURE, _("%s: BLKSECDISCARD ioctl failed"), path);
+		break;
+	case ACT_DISCARD:
+		if (ioctl(fd, BLKDISCARD, range))
+			err(EXIT_FAILURE, _("%s: BLKDISCARD ioctl failed"), path);
+		break;
+	}
+}
+
+static double time_diff(struct timeval *a, struct timeval *b)
+{
+	return (a->tv_sec - b->tv_sec) + (a->tv_usec - b->tv_usec) / 1E6;
+}
+
+static void print_rate(const char *path, uint64_t bytes, double sec)
+{
+	char *str = size_to_human_string(SIZE_SUFFIX_1LETTER,
+				sec > 0 ? (uint64_t) (bytes / sec) : bytes);
+
+	printf(_("%s: %" PRIu64 " bytes in %.1f seconds (%s/s)\n"),
+			path, bytes, sec, str);
+	free(str);
+}
+
+static void *discard_thread(void *data)
+{
+	struct discard_ctl *ctl = data;
+
+	for (;;) {
+		uint64_t range[2];
+		struct timeval now;
+		double wait = 0;
+
+		pthread_mutex_lock(&ctl->lock);
+		if (ctl->next >= ctl->end) {
+			pthread_mutex_unlock(&ctl->lock);
+			break;
+		}
+		range[0] = ctl->next;
+		range[1] = min(ctl->step, ctl->end - ctl->next);
+		ctl->next += range[1];
+
+		if (ctl->rate) {
+			gettime_monotonic(&now);
+			wait = (double) ctl->issued / ctl->rate
+			       - time_diff(&now, &ctl->start);
+		}
+		ctl->issued += range[1];
+		pthread_mutex_unlock(&ctl->lock);
+
+		if (wait > 0)
+			xusleep(wait * 1E6);
+
+		discard_range(ctl->fd, ctl->act, ctl->path, range);
+
+		pthread_mutex_lock(&ctl->lock);
+		ctl->done += range[1];
+
+		/* reporting progress at most once per second */
+		if (ctl->verbose) {
+			gettime_monotonic(&now);
+			if (time_diff(&now, &ctl->last) >= 1) {
+				print_rate(ctl->path, ctl->done - ctl->reported,
+						time_diff(&now, &ctl->last));
+				ctl->reported = ctl->done;
+				ctl->last = now;
+			}
+		}
+		pthread_mutex_unlock(&ctl->lock);
+	}
+	return NULL;
+}
+
+static void discard_parallel(struct discard_ctl *ctl, size_t nthreads)
+{
+	pthread_t *threads;
+	struct timeval now;
+	size_t i;
+
+	threads = xcalloc(nthreads, sizeof(pthread_t));
+	pthread_mutex_init(&ctl->lock, NULL);
+	gettime_monotonic(&ctl->start);
+	ctl->last = ctl->start;
+
+	for (i = 0; i < nthreads; i++) {
+		int rc = pthread_create(&threads[i], NULL, discard_thread, ctl);
+		if (rc) {
+			errno = rc;
+			err(EXIT_FAILURE, _("failed to create thread"));
+		}
+	}
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+
+	pthread_mutex_destroy(&ctl->lock);
+	free(threads);
+
+	if (ctl->verbose && ctl->done) {
+		uint64_t stats[2] = { ctl->offset, ctl->done };
+
+		gettime_monotonic(&now);
+		print_stats(ctl->act, ctl->path, stats);
+		print_rate(ctl->path, ctl->done, time_diff(&now, &ctl->start));
+	}
+}
+
+/*
+ * Returns max number of bytes the kernel accepts for one discard (or write
+ * zeroes) request, or 0.
+ */
+static uint64_t get_max_bytes(dev_t devno, int act)
+{
+	struct path_cxt *pc;
+	dev_t disk;
+	uint64_t sz = 0;
+
+	pc = ul_new_sysfs_path(devno, NULL, NULL);
+	if (!pc)
+		return 0;
+
+	/* the queue/ directory exists for whole-disks only */
+	if (sysfs_blkdev_get_wholedisk(pc, NULL, 0, &disk) == 0
+	    && (devno == disk || sysfs_blkdev_init_path(pc, disk, NULL) == 0)) {
+		if (ul_path_read_u64(pc, &sz, act == ACT_ZEROOUT ?
+					"queue/write_zeroes_max_bytes" :
+					"queue/discard_max_bytes") != 0)
+			sz = 0;
+	}
+
+	ul_unref_path(pc);
+	return sz;
+}
+
 static void __attribute__((__noreturn__)) usage(void)
 {
 	FILE *out = stdout;
@@ -96,7 +270,9 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -o, --offset <num>  offset in bytes to discard from\n"), out);
 	fputs(_(" -l, --length <num>  length of bytes to discard from the offset\n"), out);
 	fputs(_(" -p, --step <num>    size of the discard iterations within the offset\n"), out);
+	fputs(_(" -r, --rate <num>    limit the bandwidth to <num> bytes per second\n"), out);
 	fputs(_(" -s, --secure        perform secure discard\n"), out);
+	fputs(_(" -t, --threads <num> number of requests in flight\n"), out);
 	fputs(_(" -z, --zeroout       zero-fill rather than discard\n"), out);
 	fputs(_(" -v, --verbose       print aligned length and offset\n"), out);
 
@@ -156,6 +332,8 @@ int main(int argc, char **argv)
 	struct stat sb;
 	struct timeval now = { 0 }, last = { 0 };
 	int act = ACT_DISCARD;
+	uint64_t rate = 0;
+	size_t nthreads = 0;
 
 	static const struct option longopts[] = {
 	    { "help",      no_argument,       NULL, 'h' },
@@ -164,7 +342,9 @@ int main(int argc, char **argv)
 	    { "force",     no_argument,       NULL, 'f' },
 	    { "length",    required_argument, NULL, 'l' },
 	    { "step",      required_argument, NULL, 'p' },
+	    { "rate",      required_argument, NULL, 'r' },
 	    { "secure",    no_argument,       NULL, 's' },
+	    { "threads",   required_argument, NULL, 't' },
 	    { "verbose",   no_argument,       NULL, 'v' },
 	    { "zeroout",   no_argument,       NULL, 'z' },
 	    { NULL, 0, NULL, 0 }
@@ -179,7 +359,7 @@ int main(int argc, char **argv)
 	range[1] = ULLONG_MAX;
 	step = 0;
 
-	while ((c = getopt_long(argc, argv, "hfVsvo:l:p:z", longopts, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "hfVsvo:l:p:r:t:z", longopts, NULL)) != -1) {
 		switch(c) {
 		case 'f':
 			force = 1;
@@ -196,9 +376,21 @@ int main(int argc, char **argv)
 			step = strtosize_or_err(optarg,
 					_("failed to parse step"));
 			break;
+		case 'r':
+			rate = strtosize_or_err(optarg,
+					_("failed to parse rate"));
+			if (!rate)
+				errx(EXIT_FAILURE, _("invalid rate argument"));
+			break;
 		case 's':
 			act = ACT_SECURE;
 			break;
+		case 't':
+			nthreads = strtou32_or_err(optarg,
+					_("failed to parse number of threads"));
+			if (!nthreads)
+				errx(EXIT_FAILURE, _("invalid number of threads"));
+			break;
 		case 'v':
 			verbose = 1;
 			break;
@@ -251,6 +443,18 @@ int main(int argc, char **argv)
 	if (end < range[0] || end > blksize)
 		end = blksize;
 
+	/* split the range by the max request size for the parallel engine */
+	if (!step && (nthreads > 1 || rate)) {
+		step = get_max_bytes(sb.st_rdev, act);
+		if (!step)
+			step = 1024 * 1024 * 1024;
+		if (rate && step > rate)
+			step = rate;
+		step -= step % secsize;
+		if (!step)
+			step = secsize;
+	}
+
 	range[1] = (step > 0) ? step : end - range[0];
 
 	/* check length alignment to the sector size */
@@ -283,6 +487,27 @@ int main(int argc, char **argv)
 	}
 #endif /* HAVE_LIBBLKID */
 
+	if (nthreads > 1 || rate) {
+		/* don't start threads without a step to discard */
+		uint64_t nsteps = (end - range[0] + range[1] - 1) / range[1];
+		struct discard_ctl ctl = {
+			.fd = fd,
+			.act = act,
+			.path = path,
+			.offset = range[0],
+			.next = range[0],
+			.end = end,
+			.step = range[1],
+			.rate = rate,
+			.verbose = verbose ? 1 : 0
+		};
+
+		nthreads = min((uint64_t) nthreads, nsteps);
+		discard_parallel(&ctl, max(nthreads, (size_t) 1));
+		close(fd);
+		return EXIT_SUCCESS;
+	}
+
 	stats[0] = range[0], stats[1] = 0;
 	gettime_monotonic(&last);
 
@@ -290,20 +515,7 @@ int main(int argc, char **argv)
 		if (range[0] + range[1] > end)
 			range[1] = end - range[0];
 
-		switch (act) {
-		case ACT_ZEROOUT:
-			if (ioctl(fd, BLKZEROOUT, &range))
-				 err(EXIT_FAILURE, _("%s: BLKZEROOUT ioctl failed"), path);
-			break;
-		case ACT_SECURE:
-			if (ioctl(fd, BLKSECDISCARD, &range))
-				err(EXIT_FAILURE, _("%s: BLKSECDISCARD ioctl failed"), path);
-			break;
-		case ACT_DISCARD:
-			if (ioctl(fd, BLKDISCARD, &range))
-				err(EXIT_FAILURE, _("%s: BLKDISCARD ioctl failed"), path);
-			break;
-		}
+		discard_range(fd, act, path, range);
 
 		stats[1] += range[1];
 
@@ -44,6 +44,7 @@
 #include "blkdev.h"
 #include "sysfs.h"
 #include "optutils.h"
+#include "jsonwrt.h"
 
 /*
  * These ioctls are defined in linux/blkzoned.h starting with kernel 5.5.
@@ -83,6 +84,7 @@ struct blkzone_control {
 	uint32_t count;
 
 	unsigned int force : 1;
+	unsigned int json : 1;
 	unsigned int verbose : 1;
 };
 
@@ -95,6 +97,10 @@ static const struct blkzone_command commands[] = {
 		.name = "capacity",
 		.handler = blkzone_report,
 		.help = N_("Report sum of zone capacities for the given device")
+	},{
+		.name = "summary",
+		.handler = blkzone_report,
+		.help = N_("Report zone statistics for the given device")
 	},{
 		.name = "reset",
 		.handler = blkzone_action,
@@ -206,6 +212,7 @@ done:
  * blkzone report
  */
 #define DEF_REPORT_LEN		(1U << 12) /* 4k zones per report (256k kzalloc) */
+#define MAX_REPORT_LEN		(1U << 16) /* 64k zones per report (4M) */
 
 static const char *type_text[] = {
 	"RESERVED",
@@ -226,13 +233,140 @@ static const char *condition_str[] = {
 	"of"  /* Offline */
 };
 
+#define type_to_text(t)		((t) < ARRAY_SIZE(type_text) ? type_text[t] : "UNKNOWN")
+#define cond_to_str(c)		condition_str[(c) & (ARRAY_SIZE(condition_str) - 1)]
+
+/* blkzone summary */
+struct blkzone_stats {
+	uint64_t nzones;
+	uint64_t types[ARRAY_SIZE(type_text) + 1];	/* the last is unknown */
+	uint64_t conds[ARRAY_SIZE(condition_str)];
+	uint64_t nresets;				/* reset recommended */
+
+	uint64_t len;					/* sum of zone lengths */
+	uint64_t cap;					/* sum of zone capacities */
+	uint64_t seq_cap;				/* capacity of write pointer zones */
+	uint64_t seq_written;				/* data below write pointers */
+};
+
+static void stats_add_zone(struct blkzone_stats *st, const struct blk_zone *entry,
+			   uint64_t cap)
+{
+	unsigned int type = entry->type;
+	uint8_t cond = entry->cond;
+
+	st->nzones++;
+	st->types[min(type, (unsigned int) ARRAY_SIZE(type_text))]++;
+	st->conds[cond & (ARRAY_SIZE(condition_str) - 1)]++;
+	if (entry->reset)
+		st->nresets++;
+
+	st->len += entry->len;
+	st->cap += cap;
+
+	switch (cond) {
+	case BLK_ZONE_COND_NOT_WP:
+	case BLK_ZONE_COND_OFFLINE:
+		break;
+	case BLK_ZONE_COND_FULL:
+		st->seq_cap += cap;
+		st->seq_written += cap;
+		break;
+	default:
+		st->seq_cap += cap;
+		if (entry->wp > entry->start)
+			st->seq_written += min((uint64_t) (entry->wp - entry->start), cap);
+		break;
+	}
+}
+
+static void print_stats(struct blkzone_control *ctl, struct blkzone_stats *st)
+{
+	size_t i;
+
+	if (ctl->json) {
+		struct ul_jsonwrt json;
+
+		ul_jsonwrt_init(&json, stdout, 0);
+		ul_jsonwrt_root_open(&json);
+		ul_jsonwrt_value_u64(&json, "zones", st->nzones);
+		/* only the types and conditions in use, as in the text output */
+		ul_jsonwrt_object_open(&json, "types");
+		for (i = 0; i < ARRAY_SIZE(type_text); i++) {
+			if (st->types[i])
+				ul_jsonwrt_value_u64(&json, type_text[i], st->types[i]);
+		}
+		if (st->types[i])
+			ul_jsonwrt_value_u64(&json, "UNKNOWN", st->types[i]);
+		ul_jsonwrt_object_close(&json);
+		ul_jsonwrt_object_open(&json, "conditions");
+		for (i = 0; i < ARRAY_SIZE(condition_str); i++) {
+			if (st->conds[i])
+				ul_jsonwrt_value_u64(&json, condition_str[i], st->conds[i]);
+		}
+		ul_jsonwrt_object_close(&json);
+		ul_jsonwrt_value_u64(&json, "reset", st->nresets);
+		ul_jsonwrt_value_u64(&json, "len", st->len);
+		ul_jsonwrt_value_u64(&json, "cap", st->cap);
+		ul_jsonwrt_value_u64(&json, "wp-cap", st->seq_cap);
+		ul_jsonwrt_value_u64(&json, "wp-written", st->seq_written);
+		ul_jsonwrt_root_close(&json);
+		return;
+	}
+
+	printf(_("Zones:            %"PRIu64"\n"), st->nzones);
+	for (i = 0; i < ARRAY_SIZE(type_text); i++) {
+		if (st->types[i])
+			printf("  %-20s %"PRIu64"\n", type_text[i], st->types[i]);
+	}
+	if (st->types[i])
+		printf("  %-20s %"PRIu64"\n", "UNKNOWN", st->types[i]);
+
+	fputs(_("Conditions:\n"), stdout);
+	for (i = 0; i < ARRAY_SIZE(condition_str); i++) {
+		if (st->conds[i])
+			printf("  %-20s %"PRIu64"\n", condition_str[i], st->conds[i]);
+	}
+	printf(_("Reset recommended: %"PRIu64"\n"), st->nresets);
+
+	printf(_("Length:           0x%09"PRIx64"\n"), st->len);
+	printf(_("Capacity:         0x%09"PRIx64"\n"), st->cap);
+	printf(_("Written:          0x%09"PRIx64" (%.1f%% of write pointer zones capacity)\n"),
+			st->seq_written,
+			st->seq_cap ? (double) st->seq_written * 100 / st->seq_cap : 0.0);
+}
+
+static void print_zone_json(struct ul_jsonwrt *json, const struct blk_zone *entry,
+			    uint64_t cap, int has_cap)
+{
+	unsigned int type = entry->type;
+	uint8_t cond = entry->cond;
+
+	ul_jsonwrt_object_open(json, NULL);
+	ul_jsonwrt_value_u64(json, "start", entry->start);
+	ul_jsonwrt_value_u64(json, "len", entry->len);
+	if (has_cap)
+		ul_jsonwrt_value_u64(json, "cap", cap);
+	ul_jsonwrt_value_u64(json, "wptr", type == BLK_ZONE_TYPE_CONVENTIONAL ?
+				0 : entry->wp - entry->start);
+	ul_jsonwrt_value_boolean(json, "reset", entry->reset);
+	ul_jsonwrt_value_boolean(json, "non-seq", entry->non_seq);
+	ul_jsonwrt_value_s(json, "cond", cond_to_str(cond));
+	ul_jsonwrt_value_s(json, "type", type_to_text(type));
+	ul_jsonwrt_object_close(json);
+}
+
 static int blkzone_report(struct blkzone_control *ctl)
 {
 	bool only_capacity_sum = !strcmp(ctl->command->name, "capacity");
+	bool only_stats = !strcmp(ctl->command->name, "summary");
+	struct blkzone_stats stats = { .nzones = 0 };
+	struct ul_jsonwrt json;
 	uint64_t capacity_sum = 0;
 	struct blk_zone_report *zi;
 	unsigned long zonesize;
-	uint32_t i, nr_zones;
+	uint32_t i, nr_zones, report_len = DEF_REPORT_LEN;
+	const char *fmt_cap, *fmt_nocap;
 	int fd;
 
 	fd = init_device(ctl, O_RDONLY);
@@ -252,24 +386,54 @@ static int blkzone_report(struct blkzone_control *ctl)
 	else
 		nr_zones = 1 + (ctl->total_sectors - ctl->offset) / zonesize;
 
+	/* translate only once, not for every zone */
+	fmt_cap = _("  start: 0x%09"PRIx64", len 0x%06"PRIx64
+		    ", cap 0x%06"PRIx64", wptr 0x%06"PRIx64
+		    " reset:%u non-seq:%u, zcond:%2u(%s) [type: %u(%s)]\n");
+	fmt_nocap = _("  start: 0x%09"PRIx64", len 0x%06"PRIx64
+		    ", wptr 0x%06"PRIx64
+		    " reset:%u non-seq:%u, zcond:%2u(%s) [type: %u(%s)]\n");
+
+	if (ctl->json && !only_capacity_sum && !only_stats) {
+		ul_jsonwrt_init(&json, stdout, 0);
+		ul_jsonwrt_root_open(&json);
+		ul_jsonwrt_array_open(&json, "zones");
+	}
+
 	zi = xmalloc(sizeof(struct blk_zone_report) +
-		     (DEF_REPORT_LEN * sizeof(struct blk_zone)));
+		     (report_len * sizeof(struct blk_zone)));
 
 	while (nr_zones && ctl->offset < ctl->total_sectors) {
 
-		zi->nr_zones = min(nr_zones, DEF_REPORT_LEN);
+		zi->nr_zones = min(nr_zones, report_len);
 		zi->sector = ctl->offset;
 
-		if (ioctl(fd, BLKREPORTZONE, zi) == -1)
+		if (ioctl(fd, BLKREPORTZONE, zi) == -1) {
+			/* try smaller report buffer */
+			if (errno == ENOMEM && report_len > DEF_REPORT_LEN) {
+				report_len /= 2;
+				continue;
+			}
 			err(EXIT_FAILURE, _("%s: BLKREPORTZONE ioctl failed"), ctl->devname);
+		}
 
+		/* don't mix the messages with JSON output */
 		if (ctl->verbose)
-			printf(_("Found %d zones from 0x%"PRIx64"\n"),
+			fprintf(ctl->json ? stderr : stdout,
+				_("Found %d zones from 0x%"PRIx64"\n"),
 				zi->nr_zones, ctl->offset);
 
 		if (!zi->nr_zones)
 			break;
 
+		/* the device returns full reports, use larger buffer for the next */
+		if (zi->nr_zones == report_len && nr_zones > report_len
+		    && report_len < MAX_REPORT_LEN) {
+			report_len *= 2;
+			zi = xrealloc(zi, sizeof(struct blk_zone_report) +
+				      (report_len * sizeof(struct blk_zone)));
+		}
+
 		for (i = 0; i < zi->nr_zones; i++) {
 /*
  * blk_zone_report hasn't been packed since https://github.com/torvalds/linux/commit/b3e7e7d2d668de0102264302a4d10dd9d4438a42
@@ -298,22 +462,22 @@ static int blkzone_report(struct blkzone_control *ctl)
 
 			if (only_capacity_sum) {
 				capacity_sum += cap;
+			} else if (only_stats) {
+				stats_add_zone(&stats, entry, cap);
+			} else if (ctl->json) {
+				print_zone_json(&json, entry, cap, has_zone_capacity(zi));
 			} else if (has_zone_capacity(zi)) {
-				printf(_("  start: 0x%09"PRIx64", len 0x%06"PRIx64
-					", cap 0x%06"PRIx64", wptr 0x%06"PRIx64
-					" reset:%u non-seq:%u, zcond:%2u(%s) [type: %u(%s)]\n"),
+				printf(fmt_cap,
 					start, len, cap, (type == 0x1) ? 0 : wp - start,
 					entry->reset, entry->non_seq,
-					cond, condition_str[cond & (ARRAY_SIZE(condition_str) - 1)],
-					type, type_text[type]);
+					cond, cond_to_str(cond),
+					type, type_to_text(type));
 			} else {
-				printf(_("  start: 0x%09"PRIx64", len 0x%06"PRIx64
-					", wptr 0x%06"PRIx64
-					" reset:%u non-seq:%u, zcond:%2u(%s) [type: %u(%s)]\n"),
+				printf(fmt_nocap,
 					start, len, (type == 0x1) ? 0 : wp - start,
 					entry->reset, entry->non_seq,
-					cond, condition_str[cond & (ARRAY_SIZE(condition_str) - 1)],
-					type, type_text[type]);
+					cond, cond_to_str(cond),
+					type, type_to_text(type));
 			}
 
 			nr_zones--;
@@ -322,8 +486,19 @@ static int blkzone_report(struct blkzone_control *ctl)
 
 	}
 
-	if (only_capacity_sum)
+	if (only_capacity_sum && ctl->json) {
+		ul_jsonwrt_init(&json, stdout, 0);
+		ul_jsonwrt_root_open(&json);
+		ul_jsonwrt_value_u64(&json, "capacity", capacity_sum);
+		ul_jsonwrt_root_close(&json);
+	} else if (only_capacity_sum)
 		printf(_("0x%09"PRIx64"\n"), capacity_sum);
+	else if (only_stats)
+		print_stats(ctl, &stats);
+	else if (ctl->json) {
+		ul_jsonwrt_array_close(&json);
+		ul_jsonwrt_root_close(&json);
+	}
 
 	free(zi);
 	close(fd);
@@ -407,6 +582,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -l, --length <sectors> maximum sectors to act (in 512-byte sectors)\n"), out);
 	fputs(_(" -c, --count <number>   maximum number of zones\n"), out);
 	fputs(_(" -f, --force            enforce on block devices used by the system\n"), out);
+	fputs(_(" -J, --json             use JSON output format\n"), out);
 	fputs(_(" -v, --verbose          display more details\n"), out);
 	fputs(USAGE_SEPARATOR, out);
 	printf(USAGE_HELP_OPTIONS(24));
@@ -431,6 +607,7 @@ int main(int argc, char **argv)
 	    { "length",  required_argument, NULL, 'l' }, /* max of sectors to operate on */
 	    { "offset",  required_argument, NULL, 'o' }, /* starting LBA */
 	    { "force",   no_argument,       NULL, 'f' },
+	    { "json",    no_argument,       NULL, 'J' },
 	    { "verbose", no_argument,       NULL, 'v' },
 	    { "version", no_argument,       NULL, 'V' },
 	    { NULL, 0, NULL, 0 }
@@ -455,7 +632,7 @@ int main(int argc, char **argv)
 		argc--;
 	}
 
-	while ((c = getopt_long(argc, argv, "hc:l:o:fvV", longopts, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "hc:l:o:fJvV", longopts, NULL)) != -1) {
 
 		err_exclusive_options(c, longopts, excl, excl_st);
 
@@ -475,6 +652,9 @@ int main(int argc, char **argv)
 		case 'f':
 			ctl.force = 1;
 			break;
+		case 'J':
+			ctl.json = 1;
+			break;
 		case 'v':
 			ctl.verbose = 1;
 			break;
@@ -498,6 +678,10 @@ int main(int argc, char **argv)
 	if (optind != argc)
 		errx(EXIT_FAILURE,_("unexpected number of arguments"));
 
+	if (ctl.json && ctl.command->handler != blkzone_report)
+		errx(EXIT_FAILURE, _("--json is not supported by the %s command"),
+				ctl.command->name);
+
 	if (ctl.command->handler(&ctl) < 0)
 		return EXIT_FAILURE;
 
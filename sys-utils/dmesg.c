@@ -20,6 +20,7 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
 
 #include "c.h"
 #include "colors.h"
@@ -162,6 +163,63 @@ enum {
 };
 #define is_timefmt(c, f) ((c)->time_fmt == (DMESG_TIMEFTM_ ##f))
 
+/*
+ * Output buffer size for --follow. The stdout is flushed when there are no more
+ * records in /dev/kmsg, so during kernel log storms we write large blocks
+ * rather than one write() per record.
+ */
+#define DMESG_FOLLOW_BUFSIZ	(64 * 1024)
+
+/*
+ * Binary dump (see --dump-binary) file format:
+ *
+ *	header
+ *	records (aligned to 8 bytes), every record is terminated by '\0'
+ *	index
+ *
+ * The index contains one block entry for every DMESG_DUMP_BLOCKSZ records. The
+ * block entry describes the range of timestamps and bitmaps of the levels and
+ * facilities used in the block, so --since, --until, --level and --facility
+ * filters skip unwanted blocks without parsing the records. The record
+ * sequence number is the /dev/kmsg seqnum, or the record number if the
+ * messages have been read from the syslog buffer or from a file. All numbers
+ * are in little-endian.
+ */
+#define DMESG_DUMP_MAGIC	"ULDMESG\0"
+#define DMESG_DUMP_MAGICSZ	8
+#define DMESG_DUMP_VERSION	1
+#define DMESG_DUMP_BLOCKSZ	64
+#define DMESG_DUMP_ALIGN(x)	(((x) + 7) & ~((uint64_t) 7))
+
+struct dmesg_dump_header {
+	char		magic[DMESG_DUMP_MAGICSZ];
+	uint32_t	version;
+	uint32_t	nblocks;	/* number of the index entries */
+	uint64_t	nrecords;
+	uint64_t	index_offset;	/* file offset of the index */
+	int64_t		boot_sec;	/* boot time when the dump was created */
+	int64_t		boot_usec;
+	int64_t		suspended;	/* time spent in suspended state */
+};
+
+struct dmesg_dump_record {
+	uint64_t	usec;		/* timestamp in microseconds since boot */
+	uint64_t	seq;		/* sequence number */
+	int16_t		facility;	/* -1 if unknown */
+	int16_t		level;		/* -1 if unknown */
+	uint32_t	size;		/* message size without terminator */
+};
+
+struct dmesg_dump_block {
+	uint64_t	offset;		/* file offset of the first record */
+	uint64_t	first_usec;	/* the lowest timestamp in the block */
+	uint64_t	last_usec;	/* the highest timestamp in the block */
+	uint32_t	nrecords;
+	uint32_t	levels;		/* bitmap of the record levels */
+	uint32_t	facilities;	/* bitmap of the record facilities */
+	uint32_t	reserved;
+};
+
 struct dmesg_control {
 	/* bit arrays -- see include/bitops.h */
 	char levels[ARRAY_SIZE(level_names) / NBBY + 1];
@@ -196,6 +254,14 @@ struct dmesg_control {
 
 	struct ul_jsonwrt jfmt;		/* -J formatting */
 
+	/* --dump-binary writer */
+	char		*dump_name;
+	FILE		*dump;
+	uint64_t	dump_offset;	/* current file offset */
+	uint64_t	dump_nrecords;
+	struct dmesg_dump_block *dump_blocks;	/* the index */
+	size_t		dump_nblocks;
+
 	unsigned int	follow:1,	/* wait for new messages */
 			end:1,		/* seek to the of buffer */
 			raw:1,		/* raw mode */
@@ -206,6 +272,7 @@ struct dmesg_control {
 			pager:1,	/* pipe output into a pager */
 			color:1,	/* colorize messages */
 			json:1,		/* JSON output */
+			json_lines:1,	/* JSON Lines output (one object per record) */
 			force_prefix:1;	/* force timestamp and decode prefix
 					   on each line */
 	int		indent;		/* due to timestamps if newline */
@@ -218,6 +285,7 @@ struct dmesg_record {
 	int		level;
 	int		facility;
 	struct timeval  tv;
+	uint64_t	seq;		/* kmsg sequence number */
 
 	const char	*next;		/* buffer with next unparsed record */
 	size_t		next_size;	/* size of the next buffer */
@@ -230,6 +298,7 @@ struct dmesg_record {
 		(_r)->level = -1; \
 		(_r)->tv.tv_sec = 0; \
 		(_r)->tv.tv_usec = 0; \
+		(_r)->seq = UINT64_MAX; \
 	} while (0)
 
 static int read_kmsg(struct dmesg_control *ctl);
@@ -287,6 +356,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -f, --facility <list>       restrict output to defined facilities\n"), out);
 	fputs(_(" -H, --human                 human readable output\n"), out);
 	fputs(_(" -J, --json                  use JSON output format\n"), out);
+	fputs(_("     --json-lines            use JSON Lines output format (one object per line)\n"), out);
 	fputs(_(" -k, --kernel                display kernel messages\n"), out);
 	fprintf(out,
 	      _(" -L, --color[=<when>]        colorize messages (%s, %s or %s)\n"), "auto", "always", "never");
@@ -313,6 +383,7 @@ static void __attribute__((__noreturn__)) usage(void)
 		"Suspending/resume will make ctime and iso timestamps inaccurate.\n"), out);
 	fputs(_("     --since <time>          display the lines since the specified time\n"), out);
 	fputs(_("     --until <time>          display the lines until the specified time\n"), out);
+	fputs(_("     --dump-binary <file>    save the messages to indexed binary file (see --file)\n"), out);
 
 	fputs(USAGE_SEPARATOR, out);
 	printf(USAGE_HELP_OPTIONS(29));
@@ -747,7 +818,8 @@ static int get_next_syslog_record(struct dmesg_control *ctl,
 			continue;	/* error or empty line? */
 
 		if (*begin == '<') {
-			if (ctl->fltr_lev || ctl->fltr_fac || ctl->decode || ctl->color || ctl->json)
+			if (ctl->fltr_lev || ctl->fltr_fac || ctl->decode ||
+			    ctl->color || ctl->json || ctl->dump)
 				begin = parse_faclev(begin + 1, &rec->facility,
 						     &rec->level);
 			else
@@ -923,6 +995,101 @@ static const char *get_subsys_delimiter(const char *mesg, size_t mesg_size)
 	     ((_r)->facility > -1) && \
 	     ((_r)->facility < (int) ARRAY_SIZE(facility_names)))
 
+#define dump_bit(_n)	((_n) >= 0 && (_n) < 32 ? (uint32_t) 1 << (_n) : 0)
+
+static void dump_write(struct dmesg_control *ctl, const void *data, size_t sz)
+{
+	if (sz && fwrite(data, 1, sz, ctl->dump) != sz)
+		err(EXIT_FAILURE, _("write failed: %s"), ctl->dump_name);
+	ctl->dump_offset += sz;
+}
+
+static void dump_open(struct dmesg_control *ctl)
+{
+	struct dmesg_dump_header hdr = { .magic = DMESG_DUMP_MAGIC };
+
+	ctl->dump = fopen(ctl->dump_name, "w" UL_CLOEXECSTR);
+	if (!ctl->dump)
+		err(EXIT_FAILURE, _("cannot open %s"), ctl->dump_name);
+
+	/* the header is rewritten in dump_close() */
+	dump_write(ctl, &hdr, sizeof(hdr));
+}
+
+static void dump_record(struct dmesg_control *ctl, struct dmesg_record *rec)
+{
+	static const char zeros[8];
+	struct dmesg_dump_record r;
+	struct dmesg_dump_block *blk;
+	uint64_t usec = (uint64_t) rec->tv.tv_sec * 1000000 + rec->tv.tv_usec;
+	uint64_t seq = rec->seq != UINT64_MAX ? rec->seq : ctl->dump_nrecords;
+	size_t sz = rec->mesg_size + 1;
+
+	if (ctl->dump_nrecords % DMESG_DUMP_BLOCKSZ == 0) {
+		ctl->dump_blocks = xrealloc(ctl->dump_blocks,
+				(ctl->dump_nblocks + 1) * sizeof(*blk));
+		blk = &ctl->dump_blocks[ctl->dump_nblocks++];
+		memset(blk, 0, sizeof(*blk));
+		blk->offset = ctl->dump_offset;
+		blk->first_usec = blk->last_usec = usec;
+	} else
+		blk = &ctl->dump_blocks[ctl->dump_nblocks - 1];
+
+	blk->first_usec = min(blk->first_usec, usec);
+	blk->last_usec = max(blk->last_usec, usec);
+	blk->levels |= dump_bit(rec->level);
+	blk->facilities |= dump_bit(rec->facility);
+	blk->nrecords++;
+
+	r.usec = cpu_to_le64(usec);
+	r.seq = cpu_to_le64(seq);
+	r.facility = (int16_t) cpu_to_le16(rec->facility);
+	r.level = (int16_t) cpu_to_le16(rec->level);
+	r.size = cpu_to_le32(rec->mesg_size);
+
+	dump_write(ctl, &r, sizeof(r));
+	dump_write(ctl, rec->mesg, rec->mesg_size);
+	dump_write(ctl, zeros, 1);
+	dump_write(ctl, zeros, DMESG_DUMP_ALIGN(sz) - sz);
+
+	ctl->dump_nrecords++;
+}
+
+static void dump_close(struct dmesg_control *ctl)
+{
+	struct dmesg_dump_header hdr = { .magic = DMESG_DUMP_MAGIC };
+	uint64_t idx = ctl->dump_offset;
+	size_t i;
+
+	for (i = 0; i < ctl->dump_nblocks; i++) {
+		struct dmesg_dump_block *blk = &ctl->dump_blocks[i];
+
+		blk->offset = cpu_to_le64(blk->offset);
+		blk->first_usec = cpu_to_le64(blk->first_usec);
+		blk->last_usec = cpu_to_le64(blk->last_usec);
+		blk->nrecords = cpu_to_le32(blk->nrecords);
+		blk->levels = cpu_to_le32(blk->levels);
+		blk->facilities = cpu_to_le32(blk->facilities);
+		dump_write(ctl, blk, sizeof(*blk));
+	}
+
+	hdr.version = cpu_to_le32(DMESG_DUMP_VERSION);
+	hdr.nblocks = cpu_to_le32(ctl->dump_nblocks);
+	hdr.nrecords = cpu_to_le64(ctl->dump_nrecords);
+	hdr.index_offset = cpu_to_le64(idx);
+	hdr.boot_sec = (int64_t) cpu_to_le64(ctl->boot_time.tv_sec);
+	hdr.boot_usec = (int64_t) cpu_to_le64(ctl->boot_time.tv_usec);
+	hdr.suspended = (int64_t) cpu_to_le64(ctl->suspended_time);
+
+	if (fseek(ctl->dump, 0, SEEK_SET) != 0
+	    || fwrite(&hdr, 1, sizeof(hdr), ctl->dump) != sizeof(hdr)
+	    || close_stream(ctl->dump) != 0)
+		err(EXIT_FAILURE, _("write failed: %s"), ctl->dump_name);
+
+	ctl->dump = NULL;
+	free(ctl->dump_blocks);
+	ctl->dump_blocks = NULL;
+}
 
 static void print_record(struct dmesg_control *ctl,
 			 struct dmesg_record *rec)
@@ -938,13 +1105,22 @@ static void print_record(struct dmesg_control *ctl,
 	if (!accept_record(ctl, rec))
 		return;
 
+	if (ctl->dump) {
+		dump_record(ctl, rec);
+		return;
+	}
+
 	if (!rec->mesg_size) {
 		if (!ctl->json)
 			putchar('\n');
 		return;
 	}
 
-	if (ctl->json) {
+	if (ctl->json_lines) {
+		ul_jsonwrt_init(&ctl->jfmt, stdout, 0);
+		ul_jsonwrt_set_compact(&ctl->jfmt, 1);
+		ul_jsonwrt_root_open(&ctl->jfmt);
+	} else if (ctl->json) {
 		if (!ul_jsonwrt_is_ready(&ctl->jfmt)) {
 			ul_jsonwrt_init(&ctl->jfmt, stdout, 0);
 			ul_jsonwrt_root_open(&ctl->jfmt);
@@ -1108,9 +1284,13 @@ full_output:
 		if (has_color)
 			color_disable();
 	} else {
-		if (ctl->json)
+		if (ctl->json) {
+			/* syslog(2) and --file buffers are not terminated
+			 * after the record, kmsg records are */
+			if (line[mesg_size] != '\0')
+				line = mesg_copy = xstrndup(line, mesg_size);
 			ul_jsonwrt_value_s(&ctl->jfmt, "msg", line);
-		else
+		} else
 			safe_fwrite(ctl, line, mesg_size, ctl->indent, stdout);
 	}
 
@@ -1126,12 +1306,128 @@ full_output:
 
 done:
 	free(mesg_copy);
-	if (ctl->json)
+	if (ctl->json_lines)
+		ul_jsonwrt_root_close(&ctl->jfmt);
+	else if (ctl->json)
 		ul_jsonwrt_object_close(&ctl->jfmt);
 	else
 		putchar('\n');
 }
 
+/*
+ * Returns 1 if the buffer is a --dump-binary file.
+ */
+static int is_dump_buffer(const char *buf, size_t size)
+{
+	return size >= sizeof(struct dmesg_dump_header)
+		&& memcmp(buf, DMESG_DUMP_MAGIC, DMESG_DUMP_MAGICSZ) == 0;
+}
+
+/*
+ * Returns 1 if the block may contain records accepted by accept_record().
+ */
+static int accept_dump_block(struct dmesg_control *ctl,
+			     const struct dmesg_dump_block *blk)
+{
+	time_t base = ctl->boot_time.tv_sec + ctl->suspended_time;
+	size_t i;
+
+	if (ctl->fltr_lev) {
+		uint32_t levels = le32_to_cpu(blk->levels), mask = 0;
+
+		for (i = 0; i < ARRAY_SIZE(level_names); i++)
+			if (isset(ctl->levels, i))
+				mask |= dump_bit((int) i);
+		if (!(levels & mask))
+			return 0;
+	}
+
+	if (ctl->fltr_fac) {
+		uint32_t facilities = le32_to_cpu(blk->facilities), mask = 0;
+
+		for (i = 0; i < ARRAY_SIZE(facility_names); i++)
+			if (isset(ctl->facilities, i))
+				mask |= dump_bit((int) i);
+		if (!(facilities & mask))
+			return 0;
+	}
+
+	if (ctl->since &&
+	    ctl->since >= base + (time_t) (le64_to_cpu(blk->last_usec) / 1000000))
+		return 0;
+
+	if (ctl->until &&
+	    ctl->until <= base + (time_t) (le64_to_cpu(blk->first_usec) / 1000000))
+		return 0;
+
+	return 1;
+}
+
+/*
+ * Prints records from --dump-binary file. The records are read only from the
+ * index blocks which may contain wanted records.
+ */
+static void print_dump_buffer(struct dmesg_control *ctl,
+			      const char *buf, size_t size)
+{
+	const struct dmesg_dump_header *hdr = (const struct dmesg_dump_header *) buf;
+	const struct dmesg_dump_block *blocks;
+	uint64_t idx = le64_to_cpu(hdr->index_offset);
+	uint32_t nblocks = le32_to_cpu(hdr->nblocks);
+	size_t i;
+
+	if (le32_to_cpu(hdr->version) != DMESG_DUMP_VERSION)
+		errx(EXIT_FAILURE, _("%s: unsupported dump version"), ctl->filename);
+	if (idx < sizeof(*hdr) || idx > size || idx % 8
+	    || (size - idx) / sizeof(*blocks) < nblocks)
+		errx(EXIT_FAILURE, _("%s: corrupted dump"), ctl->filename);
+
+	/* timestamps are relative to the boot of the dumped system */
+	ctl->boot_time.tv_sec = (time_t) le64_to_cpu(hdr->boot_sec);
+	ctl->boot_time.tv_usec = (suseconds_t) le64_to_cpu(hdr->boot_usec);
+	ctl->suspended_time = (time_t) le64_to_cpu(hdr->suspended);
+
+	blocks = (const struct dmesg_dump_block *) (buf + idx);
+
+	for (i = 0; i < nblocks; i++) {
+		const struct dmesg_dump_block *blk = &blocks[i];
+		uint64_t off = le64_to_cpu(blk->offset);
+		uint32_t n = le32_to_cpu(blk->nrecords);
+
+		if (!accept_dump_block(ctl, blk))
+			continue;
+
+		for (; n > 0; n--) {
+			const struct dmesg_dump_record *r;
+			struct dmesg_record rec;
+			uint64_t usec;
+			uint32_t sz;
+
+			if (off % 8 || off > idx || idx - off < sizeof(*r))
+				errx(EXIT_FAILURE, _("%s: corrupted dump"), ctl->filename);
+
+			r = (const struct dmesg_dump_record *) (buf + off);
+			sz = le32_to_cpu(r->size);
+			if (idx - off - sizeof(*r) <= sz)
+				errx(EXIT_FAILURE, _("%s: corrupted dump"), ctl->filename);
+
+			INIT_DMESG_RECORD(&rec);
+			usec = le64_to_cpu(r->usec);
+			rec.tv.tv_sec = usec / 1000000;
+			rec.tv.tv_usec = usec % 1000000;
+			rec.facility = (int16_t) le16_to_cpu(r->facility);
+			rec.level = (int16_t) le16_to_cpu(r->level);
+			rec.seq = le64_to_cpu(r->seq);
+			rec.mesg = (const char *) (r + 1);
+			rec.mesg_size = sz;
+
+			print_record(ctl, &rec);
+
+			off += sizeof(*r) + DMESG_DUMP_ALIGN((uint64_t) sz + 1);
+		}
+	}
+}
+
 /*
  * Prints the 'buf' kernel ring buffer; the messages are filtered out according
  * to 'levels' and 'facilities' bitarrays.
@@ -1141,6 +1437,11 @@ static void print_buffer(struct dmesg_control *ctl,
 {
 	struct dmesg_record rec = { .next = buf, .next_size = size };
 
+	if (ctl->method == DMESG_METHOD_MMAP && is_dump_buffer(buf, size)) {
+		print_dump_buffer(ctl, buf, size);
+		return;
+	}
+
 	if (ctl->raw) {
 		raw_print(ctl, buf, size);
 		return;
@@ -1163,19 +1464,41 @@ static ssize_t read_kmsg_one(struct dmesg_control *ctl)
 	return size;
 }
 
-static int init_kmsg(struct dmesg_control *ctl)
+/*
+ * Flushes already composed output and waits for new /dev/kmsg records. It's
+ * called only when there is nothing to read, so the output is written in large
+ * blocks when the kernel produces many messages.
+ */
+static int wait_kmsg(struct dmesg_control *ctl)
 {
-	int mode = O_RDONLY;
+	struct pollfd fds = { .fd = ctl->kmsg, .events = POLLIN };
 
-	if (!ctl->follow)
-		mode |= O_NONBLOCK;
-	else
-		setlinebuf(stdout);
+	if (fflush(stdout) != 0) {
+		if (errno != EPIPE)
+			err(EXIT_FAILURE, _("write failed"));
+		exit(EXIT_SUCCESS);
+	}
+
+	while (poll(&fds, 1, -1) < 0) {
+		if (errno != EINTR)
+			return -1;
+	}
+	return 0;
+}
 
-	ctl->kmsg = open("/dev/kmsg", mode);
+static int init_kmsg(struct dmesg_control *ctl)
+{
+	/*
+	 * The device is always non-blocking; for --follow we wait for new
+	 * records by poll() in wait_kmsg().
+	 */
+	ctl->kmsg = open("/dev/kmsg", O_RDONLY | O_NONBLOCK);
 	if (ctl->kmsg < 0)
 		return -1;
 
+	if (ctl->follow)
+		setvbuf(stdout, NULL, _IOFBF, DMESG_FOLLOW_BUFSIZ);
+
 	/*
 	 * Seek after the last record available at the time
 	 * the last SYSLOG_ACTION_CLEAR was issued.
@@ -1192,6 +1515,9 @@ static int init_kmsg(struct dmesg_control *ctl)
 	 * read_kmsg().
 	 */
 	ctl->kmsg_first_read = read_kmsg_one(ctl);
+	if (ctl->kmsg_first_read < 0 && errno == EAGAIN && ctl->follow
+	    && wait_kmsg(ctl) == 0)
+		ctl->kmsg_first_read = read_kmsg_one(ctl);
 	if (ctl->kmsg_first_read < 0) {
 		close(ctl->kmsg);
 		ctl->kmsg = -1;
@@ -1232,7 +1558,7 @@ static int parse_kmsg_record(struct dmesg_control *ctl,
 
 	/* A) priority and facility */
 	if (ctl->fltr_lev || ctl->fltr_fac || ctl->decode ||
-	    ctl->raw || ctl->color || ctl->json)
+	    ctl->raw || ctl->color || ctl->json || ctl->dump)
 		p = parse_faclev(p, &rec->facility, &rec->level);
 	else
 		p = skip_item(p, end, ",");
@@ -1240,6 +1566,14 @@ static int parse_kmsg_record(struct dmesg_control *ctl,
 		goto mesg;
 
 	/* B) sequence number */
+	if (ctl->dump) {
+		char *e;
+
+		errno = 0;
+		rec->seq = strtoumax(p, &e, 10);
+		if (errno || e == p || (*e != ',' && *e != ';'))
+			rec->seq = UINT64_MAX;
+	}
 	p = skip_item(p, end, ",;");
 	if (LAST_KMSG_FIELD(p))
 		goto mesg;
@@ -1293,7 +1627,12 @@ mesg:
  * that we don't have to read whole message buffer before the records parsing.
  *
  * So this function does not compose one huge buffer (like read_syslog_buffer())
- * and print_buffer() is unnecessary. All is done in this function.
+ * and print_buffer() is unnecessary. All is done in this function. The record
+ * is parsed in place in ctl->kmsg_buf, so the memory usage does not depend on
+ * the number of the records.
+ *
+ * In --follow mode the output is flushed only when all available records are
+ * processed (see wait_kmsg()).
  *
  * Returns 0 on success, -1 on error.
  */
@@ -1312,12 +1651,17 @@ static int read_kmsg(struct dmesg_control *ctl)
 	 */
 	sz = ctl->kmsg_first_read;
 
-	while (sz > 0) {
-		*(ctl->kmsg_buf + sz) = '\0';	/* for debug messages */
+	while (1) {
+		if (sz > 0) {
+			*(ctl->kmsg_buf + sz) = '\0';	/* for debug messages */
 
-		if (parse_kmsg_record(ctl, &rec,
-				      ctl->kmsg_buf, (size_t) sz) == 0)
-			print_record(ctl, &rec);
+			if (parse_kmsg_record(ctl, &rec,
+					      ctl->kmsg_buf, (size_t) sz) == 0)
+				print_record(ctl, &rec);
+
+		} else if (sz == 0 || errno != EAGAIN
+			   || !ctl->follow || wait_kmsg(ctl) != 0)
+			break;
 
 		sz = read_kmsg_one(ctl);
 	}
@@ -1387,7 +1731,9 @@ int main(int argc, char *argv[])
 		OPT_TIME_FORMAT = CHAR_MAX + 1,
 		OPT_NOESC,
 		OPT_SINCE,
-		OPT_UNTIL
+		OPT_UNTIL,
+		OPT_JSON_LINES,
+		OPT_DUMP_BINARY
 	};
 
 	static const struct option longopts[] = {
@@ -1398,6 +1744,7 @@ int main(int argc, char *argv[])
 		{ "console-off",   no_argument,       NULL, 'D' },
 		{ "console-on",    no_argument,       NULL, 'E' },
 		{ "decode",        no_argument,	      NULL, 'x' },
+		{ "dump-binary",   required_argument, NULL, OPT_DUMP_BINARY },
 		{ "file",          required_argument, NULL, 'F' },
 		{ "facility",      required_argument, NULL, 'f' },
 		{ "follow",        no_argument,       NULL, 'w' },
@@ -1405,6 +1752,7 @@ int main(int argc, char *argv[])
 		{ "human",         no_argument,       NULL, 'H' },
 		{ "help",          no_argument,	      NULL, 'h' },
 		{ "json",          no_argument,       NULL, 'J' },
+		{ "json-lines",    no_argument,       NULL, OPT_JSON_LINES },
 		{ "kernel",        no_argument,       NULL, 'k' },
 		{ "level",         required_argument, NULL, 'l' },
 		{ "since",	   required_argument, NULL, OPT_SINCE },
@@ -1428,13 +1776,18 @@ int main(int argc, char *argv[])
 	static const ul_excl_t excl[] = {	/* rows and cols in ASCII order */
 		{ 'C','D','E','c','n','r' },	/* clear,off,on,read-clear,level,raw*/
 		{ 'H','r' },			/* human, raw */
+		{ 'J', OPT_DUMP_BINARY },	/* json, dump-binary */
 		{ 'L','r' },			/* color, raw */
 		{ 'S','w' },			/* syslog,follow */
 		{ 'T','r' },			/* ctime, raw */
+		{ 'W', OPT_DUMP_BINARY },	/* follow-new, dump-binary */
 		{ 'd','r' },			/* delta, raw */
 		{ 'e','r' },			/* reltime, raw */
 		{ 'r','x' },			/* raw, decode */
 		{ 'r','t' },			/* notime, raw */
+		{ 'r', OPT_DUMP_BINARY },	/* raw, dump-binary */
+		{ 'w', OPT_DUMP_BINARY },	/* follow, dump-binary */
+		{ OPT_JSON_LINES, OPT_DUMP_BINARY },
 		{ 0 }
 	};
 	int excl_st[ARRAY_SIZE(excl)] = UL_EXCL_STATUS_INIT;
@@ -1551,6 +1904,13 @@ int main(int argc, char *argv[])
 		case OPT_NOESC:
 			ctl.noesc = 1;
 			break;
+		case OPT_JSON_LINES:
+			ctl.json = 1;
+			ctl.json_lines = 1;
+			break;
+		case OPT_DUMP_BINARY:
+			ctl.dump_name = optarg;
+			break;
 		case OPT_SINCE:
 		{
 			usec_t p;
@@ -1590,11 +1950,20 @@ int main(int argc, char *argv[])
 		nopager = 1;
 	}
 
+	if (ctl.dump_name) {
+		ctl.time_fmt = DMESG_TIMEFTM_TIME;
+		delta = 0;
+		ctl.force_prefix = 0;
+		nopager = 1;
+		colormode = UL_COLORMODE_NEVER;
+	}
+
 	if ((is_timefmt(&ctl, RELTIME) ||
 	     is_timefmt(&ctl, CTIME)   ||
 	     is_timefmt(&ctl, ISO8601)) ||
 	     ctl.since ||
-	     ctl.until) {
+	     ctl.until ||
+	     ctl.dump_name) {
 		if (dmesg_get_boot_time(&ctl.boot_time) != 0)
 			ctl.time_fmt = DMESG_TIMEFTM_NONE;
 		else
@@ -1642,14 +2011,18 @@ int main(int argc, char *argv[])
 			ctl.force_prefix = 0;
 		if (ctl.pager)
 			pager_redirect();
+		if (ctl.dump_name)
+			dump_open(&ctl);
 		n = read_buffer(&ctl, &buf);
 		if (n > 0)
 			print_buffer(&ctl, buf, n);
+		if (ctl.dump)
+			dump_close(&ctl);
 		if (!ctl.mmap_buff)
 			free(buf);
 		if (ctl.kmsg >= 0)
 			close(ctl.kmsg);
-		if (ctl.json && ul_jsonwrt_is_ready(&ctl.jfmt)) {
+		if (ctl.json && !ctl.json_lines && ul_jsonwrt_is_ready(&ctl.jfmt)) {
 			ul_jsonwrt_array_close(&ctl.jfmt);
 			ul_jsonwrt_root_close(&ctl.jfmt);
 		}
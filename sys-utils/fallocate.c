@@ -33,6 +33,7 @@
 #include <getopt.h>
 #include <limits.h>
 #include <string.h>
+#include <pthread.h>
 
 #ifndef HAVE_FALLOCATE
 # include <sys/syscall.h>
@@ -95,6 +96,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -o, --offset <num>   offset for range operations, in bytes\n"), out);
 	fputs(_(" -p, --punch-hole     replace a range with a hole (implies -n)\n"), out);
 	fputs(_(" -z, --zero-range     zero and ensure allocation of a range\n"), out);
+	fputs(_(" -t, --threads <num>  number of threads for --dig-holes\n"), out);
 #ifdef HAVE_POSIX_FALLOCATE
 	fputs(_(" -x, --posix          use posix_fallocate(3) instead of fallocate(2)\n"), out);
 #endif
@@ -151,39 +153,43 @@ static void xposix_fallocate(int fd, off_t offset, off_t length)
 }
 #endif
 
-/* The real buffer size has to be bufsize + sizeof(uintptr_t) */
-static int is_nul(void *buf, size_t bufsize)
+/*
+ * Returns 1 if the buffer contains only zeros. If the first 16 bytes are
+ * zero and every byte is equal to the byte 16 positions later, then all the
+ * bytes are zero. This allows to use memcmp() which is vectorized by libc.
+ */
+static int is_nul(const void *buf, size_t bufsize)
 {
-	typedef uintptr_t word;
-	void const *vp;
-	char const *cbuf = buf, *cp;
-	word const *wp = buf;
-
-	/* set sentinel */
-	memset((char *) buf + bufsize, '\1', sizeof(word));
+	const unsigned char *p = buf;
+	size_t i, n = min(bufsize, (size_t) 16);
 
-	/* Find first nonzero *word*, or the word with the sentinel.  */
-	while (*wp++ == 0)
-		continue;
-
-	/* Find the first nonzero *byte*, or the sentinel.  */
-	vp = wp - 1;
-	cp = vp;
+	for (i = 0; i < n; i++) {
+		if (p[i])
+			return 0;
+	}
+	return bufsize <= n || memcmp(p, p + n, bufsize - n) == 0;
+}
 
-	while (*cp++ == 0)
-		continue;
+/* max size of one read(), the data are analyzed in st_blksize steps */
+#define DIG_READSZ	(1024 * 1024)
 
-	return cbuf + bufsize < cp;
-}
+struct dig_range {
+	int		fd;
+	off_t		start;
+	off_t		end;		/* 0 means end of file */
+	size_t		blksz;		/* filesystem I/O block size */
+	uintmax_t	count;		/* bytes converted to holes */
+	pthread_t	thread;
+};
 
-static void dig_holes(int fd, off_t file_off, off_t len)
+static void dig_holes_range(struct dig_range *rg)
 {
-	off_t file_end = len ? file_off + len : 0;
+	int fd = rg->fd;
+	off_t file_off = rg->start, file_end = rg->end;
 	off_t hole_start = 0, hole_sz = 0;
-	uintmax_t ct = 0;
-	size_t  bufsz;
+	size_t blksz = rg->blksz;
+	size_t bufsz = max(blksz, (DIG_READSZ / blksz) * blksz);
 	char *buf;
-	struct stat st;
 #if defined(POSIX_FADV_SEQUENTIAL) && defined(HAVE_POSIX_FADVISE)
 	off_t cache_start = file_off;
 	/*
@@ -197,21 +203,13 @@ static void dig_holes(int fd, off_t file_off, off_t len)
 	const size_t cachesz = getpagesize() * 256;
 #endif
 
-	if (fstat(fd, &st) != 0)
-		err(EXIT_FAILURE, _("stat of %s failed"), filename);
-
-	bufsz = st.st_blksize;
-
-	if (lseek(fd, file_off, SEEK_SET) < 0)
-		err(EXIT_FAILURE, _("seek on %s failed"), filename);
-
-	/* buffer + extra space for is_nul() sentinel */
-	buf = xmalloc(bufsz + sizeof(uintptr_t));
+	buf = xmalloc(bufsz);
 	while (file_end == 0 || file_off < file_end) {
 		/*
 		 * Detect data area (skip holes)
 		 */
 		off_t end, off;
+		int clamped = 0;
 
 		off = lseek(fd, file_off, SEEK_DATA);
 		if ((off == -1 && errno == ENXIO) ||
@@ -219,20 +217,22 @@ static void dig_holes(int fd, off_t file_off, off_t len)
 			break;
 
 		end = lseek(fd, off, SEEK_HOLE);
-		if (file_end && end > file_end)
+		if (file_end && end > file_end) {
 			end = file_end;
+			clamped = 1;
+		}
 
 		if (off < 0 || end < 0)
 			break;
 
 #if defined(POSIX_FADV_SEQUENTIAL) && defined(HAVE_POSIX_FADVISE)
-		(void) posix_fadvise(fd, off, end, POSIX_FADV_SEQUENTIAL);
+		(void) posix_fadvise(fd, off, end - off, POSIX_FADV_SEQUENTIAL);
 #endif
 		/*
 		 * Dig holes in the area
 		 */
 		while (off < end) {
-			ssize_t rsz = pread(fd, buf, bufsz, off);
+			ssize_t i, rsz = pread(fd, buf, bufsz, off);
 			if (rsz < 0 && errno)
 				err(EXIT_FAILURE, _("%s: read failed"), filename);
 			if (end && rsz > 0 && off > end - rsz)
@@ -240,15 +240,19 @@ static void dig_holes(int fd, off_t file_off, off_t len)
 			if (rsz <= 0)
 				break;
 
-			if (is_nul(buf, rsz)) {
-				if (!hole_sz)				/* new hole detected */
-					hole_start = off;
-				hole_sz += rsz;
-			 } else if (hole_sz) {
-				xfallocate(fd, FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE,
-					   hole_start, hole_sz);
-				ct += hole_sz;
-				hole_sz = hole_start = 0;
+			for (i = 0; i < rsz; i += blksz) {
+				size_t sz = min((size_t) (rsz - i), blksz);
+
+				if (is_nul(buf + i, sz)) {
+					if (!hole_sz)			/* new hole detected */
+						hole_start = off + i;
+					hole_sz += sz;
+				} else if (hole_sz) {
+					xfallocate(fd, FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE,
+						   hole_start, hole_sz);
+					rg->count += hole_sz;
+					hole_sz = hole_start = 0;
+				}
 			}
 
 #if defined(POSIX_FADV_DONTNEED) && defined(HAVE_POSIX_FADVISE)
@@ -265,16 +269,82 @@ static void dig_holes(int fd, off_t file_off, off_t len)
 		}
 		if (hole_sz) {
 			off_t alloc_sz = hole_sz;
-			if (off >= end)
-				alloc_sz += st.st_blksize;		/* meet block boundary */
+			/* meet block boundary, but don't touch the next range */
+			if (off >= end && !clamped)
+				alloc_sz += blksz;
 			xfallocate(fd, FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE,
 					hole_start, alloc_sz);
-			ct += hole_sz;
+			rg->count += hole_sz;
+			hole_sz = hole_start = 0;
 		}
 		file_off = off;
 	}
 
 	free(buf);
+}
+
+static void *dig_holes_thread(void *data)
+{
+	dig_holes_range((struct dig_range *) data);
+	return NULL;
+}
+
+/*
+ * The file is split into @nthreads ranges aligned to the I/O block size and
+ * every range is analyzed by a separate thread.
+ */
+static void dig_holes(int fd, off_t file_off, off_t len, size_t nthreads)
+{
+	struct dig_range *rgs;
+	struct stat st;
+	uintmax_t ct = 0;
+	off_t file_end, rgsz = 0;
+	size_t i, blksz;
+
+	if (fstat(fd, &st) != 0)
+		err(EXIT_FAILURE, _("stat of %s failed"), filename);
+
+	blksz = st.st_blksize;
+	file_end = len ? file_off + len : st.st_size;
+
+	if (nthreads > 1 && file_end > file_off) {
+		rgsz = (file_end - file_off) / nthreads;
+		rgsz = ((rgsz + DIG_READSZ - 1) / DIG_READSZ) * DIG_READSZ;
+		rgsz = ((rgsz + blksz - 1) / blksz) * blksz;
+		nthreads = (file_end - file_off + rgsz - 1) / rgsz;
+	}
+	if (nthreads < 1 || rgsz == 0)
+		nthreads = 1;
+
+	rgs = xcalloc(nthreads, sizeof(*rgs));
+	for (i = 0; i < nthreads; i++) {
+		struct dig_range *rg = &rgs[i];
+
+		rg->fd = fd;
+		rg->blksz = blksz;
+		rg->start = file_off + i * rgsz;
+		rg->end = i + 1 < nthreads ? rg->start + rgsz :
+			  len ? file_off + len : 0;
+	}
+
+	if (nthreads == 1)
+		dig_holes_range(&rgs[0]);
+	else {
+		for (i = 0; i < nthreads; i++) {
+			int rc = pthread_create(&rgs[i].thread, NULL,
+						dig_holes_thread, &rgs[i]);
+			if (rc) {
+				errno = rc;
+				err(EXIT_FAILURE, _("failed to create thread"));
+			}
+		}
+		for (i = 0; i < nthreads; i++)
+			pthread_join(rgs[i].thread, NULL);
+	}
+
+	for (i = 0; i < nthreads; i++)
+		ct += rgs[i].count;
+	free(rgs);
 
 	if (verbose) {
 		char *str = size_to_human_string(SIZE_SUFFIX_3LETTER | SIZE_SUFFIX_SPACE, ct);
@@ -291,6 +361,7 @@ int main(int argc, char **argv)
 	int	mode = 0;
 	int	dig = 0;
 	int posix = 0;
+	size_t	nthreads = 0;
 	loff_t	length = -2LL;
 	loff_t	offset = 0;
 
@@ -306,6 +377,7 @@ int main(int argc, char **argv)
 	    { "offset",         required_argument, NULL, 'o' },
 	    { "length",         required_argument, NULL, 'l' },
 	    { "posix",          no_argument,       NULL, 'x' },
+	    { "threads",        required_argument, NULL, 't' },
 	    { "verbose",        no_argument,       NULL, 'v' },
 	    { NULL, 0, NULL, 0 }
 	};
@@ -323,7 +395,7 @@ int main(int argc, char **argv)
 	textdomain(PACKAGE);
 	close_stdout_atexit();
 
-	while ((c = getopt_long(argc, argv, "hvVncpdizxl:o:", longopts, NULL))
+	while ((c = getopt_long(argc, argv, "hvVncpdizxl:o:t:", longopts, NULL))
 			!= -1) {
 
 		err_exclusive_options(c, longopts, excl, excl_st);
@@ -353,6 +425,11 @@ int main(int argc, char **argv)
 		case 'z':
 			mode |= FALLOC_FL_ZERO_RANGE;
 			break;
+		case 't':
+			nthreads = strtou32_or_err(optarg, _("invalid threads argument"));
+			if (nthreads < 1)
+				errx(EXIT_FAILURE, _("invalid threads argument"));
+			break;
 		case 'x':
 #ifdef HAVE_POSIX_FALLOCATE
 			posix = 1;
@@ -396,6 +473,8 @@ int main(int argc, char **argv)
 	}
 	if (offset < 0)
 		errx(EXIT_FAILURE, _("invalid offset value specified"));
+	if (nthreads && !dig)
+		errx(EXIT_FAILURE, _("--threads requires --dig-holes"));
 
 	/* O_CREAT makes sense only for the default fallocate(2) behavior
 	 * when mode is no specified and new space is allocated */
@@ -405,7 +484,7 @@ int main(int argc, char **argv)
 		err(EXIT_FAILURE, _("cannot open %s"), filename);
 
 	if (dig)
-		dig_holes(fd, offset, length);
+		dig_holes(fd, offset, length, nthreads);
 	else {
 #ifdef HAVE_POSIX_FALLOCATE
 		if (posix)
@@ -32,6 +32,7 @@
 #include <fcntl.h>
 #include <limits.h>
 #include <getopt.h>
+#include <pthread.h>
 
 #include <sys/ioctl.h>
 #include <sys/stat.h>
@@ -47,6 +48,9 @@
 #include "sysfs.h"
 #include "optutils.h"
 #include "statfs_magic.h"
+#include "monotonic.h"
+#include "jsonwrt.h"
+#include "fileutils.h"
 
 #include <libmount.h>
 
@@ -60,14 +64,52 @@ struct fstrim_range {
 #define FITRIM		_IOWR('X', 121, struct fstrim_range)
 #endif
 
+/* --state-file entry */
+struct fstrim_state {
+	char		*path;		/* mountpoint */
+	uint64_t	offset;		/* where to continue */
+	unsigned int	updated : 1;	/* set by this run */
+};
+
 struct fstrim_control {
 	struct fstrim_range range;
 
+	uint64_t	chunk;		/* --chunk size or 0 */
+	unsigned int	time_budget;	/* --time-budget seconds per filesystem */
+	unsigned int	max_latency;	/* --max-latency msecs */
+
+	const char	*state_file;
+	struct fstrim_state *states;
+	size_t		nstates;
+
+	pthread_mutex_t lock;		/* serializes output for --parallel */
+
 	unsigned int verbose : 1,
 		     quiet_unsupp : 1,
+		     parallel : 1,
+		     json : 1,
 		     dryrun : 1;
 };
 
+/* filesystem to trim */
+struct fstrim_fs {
+	const char	*path;
+	const char	*devname;	/* source device or NULL */
+	dev_t		disk;		/* whole-disk, for --parallel */
+
+	int		rc;		/* 0 = success, 1 = unsupported, < 0 = error */
+	uint64_t	trimmed;	/* bytes */
+	double		time;		/* seconds */
+
+	uint64_t	offset;		/* --chunk: where to start (or continue) */
+	unsigned int	interrupted : 1; /* --chunk: time budget exhausted */
+};
+
+static double time_diff(struct timeval *a, struct timeval *b)
+{
+	return (a->tv_sec - b->tv_sec) + (a->tv_usec - b->tv_usec) / 1E6;
+}
+
 static int is_directory(const char *path, int silent)
 {
 	struct stat sb;
@@ -85,15 +127,239 @@ static int is_directory(const char *path, int silent)
 	return 1;
 }
 
+/*
+ * The state file contains "<offset> <mountpoint>" lines.
+ */
+static void state_load(struct fstrim_control *ctl)
+{
+	FILE *f = fopen(ctl->state_file, "r" UL_CLOEXECSTR);
+	char *line = NULL;
+	size_t sz = 0;
+
+	if (!f) {
+		if (errno != ENOENT)
+			warn(_("cannot open %s"), ctl->state_file);
+		return;
+	}
+
+	while (getline(&line, &sz, f) >= 0) {
+		struct fstrim_state *st;
+		unsigned long long offset;
+		int n = 0;
+
+		if (sscanf(line, "%llu %n", &offset, &n) != 1 || !n)
+			continue;
+		rtrim_whitespace((unsigned char *) line + n);
+		if (!line[n])
+			continue;
+
+		ctl->states = xrealloc(ctl->states,
+				(ctl->nstates + 1) * sizeof(*ctl->states));
+		st = &ctl->states[ctl->nstates++];
+		st->path = xstrdup(line + n);
+		st->offset = offset;
+	}
+	free(line);
+	fclose(f);
+}
+
+static struct fstrim_state *state_get(struct fstrim_control *ctl, const char *path)
+{
+	size_t i;
+
+	for (i = 0; i < ctl->nstates; i++) {
+		if (strcmp(ctl->states[i].path, path) == 0)
+			return &ctl->states[i];
+	}
+	return NULL;
+}
+
+static void state_set(struct fstrim_control *ctl, const char *path, uint64_t offset)
+{
+	struct fstrim_state *st = state_get(ctl, path);
+
+	if (!st) {
+		ctl->states = xrealloc(ctl->states,
+				(ctl->nstates + 1) * sizeof(*ctl->states));
+		st = &ctl->states[ctl->nstates++];
+		st->path = xstrdup(path);
+	}
+	st->offset = offset;
+	st->updated = 1;
+}
+
+/* returns 1 if @path is an accessible mountpoint */
+static int is_mountpoint(const char *path)
+{
+	char *mnt = mnt_get_mountpoint(path);
+	int rc = mnt && streq_paths(mnt, path);
+
+	free(mnt);
+	return rc;
+}
+
+/*
+ * Write to temporary file and rename to keep the old state on error. The
+ * entries not updated by this run are dropped if the filesystem is no more
+ * mounted.
+ */
+static int state_save(struct fstrim_control *ctl)
+{
+	char *tmp = NULL;
+	FILE *f = NULL;
+	size_t i;
+	int fd, rc = 0;
+
+	xasprintf(&tmp, "%s-XXXXXX", ctl->state_file);
+	fd = mkstemp_cloexec(tmp);
+	if (fd < 0 || !(f = fdopen(fd, "w" UL_CLOEXECSTR))) {
+		rc = -errno;
+		warn(_("cannot create temporary file for %s"), ctl->state_file);
+		if (fd >= 0) {
+			close(fd);
+			unlink(tmp);
+		}
+		free(tmp);
+		return rc;
+	}
+	for (i = 0; i < ctl->nstates; i++) {
+		if (ctl->states[i].updated || is_mountpoint(ctl->states[i].path))
+			fprintf(f, "%" PRIu64 " %s\n", ctl->states[i].offset,
+					ctl->states[i].path);
+	}
+
+	if (fflush(f) != 0 || fsync(fd) != 0)
+		rc = -errno;
+	if (close_stream(f) != 0 && !rc)
+		rc = -errno;
+	if (!rc && rename(tmp, ctl->state_file) != 0)
+		rc = -errno;
+	if (rc) {
+		errno = -rc;
+		warn(_("cannot write %s"), ctl->state_file);
+		unlink(tmp);
+	}
+	free(tmp);
+	return rc;
+}
+
+static void state_free(struct fstrim_control *ctl)
+{
+	size_t i;
+
+	for (i = 0; i < ctl->nstates; i++)
+		free(ctl->states[i].path);
+	free(ctl->states);
+}
+
+/* returns: 0 = success, 1 = unsupported, < 0 = error (-errno), the errors
+ * are reported by the callers */
+static int fstrim_ioctl(int fd, struct fstrim_range *range)
+{
+	int rc;
+
+	errno = 0;
+	if (ioctl(fd, FITRIM, range) == 0)
+		return 0;
+
+	switch (errno) {
+	case EBADF:
+	case ENOTTY:
+	case EOPNOTSUPP:
+		rc = 1;
+		break;
+	default:
+		rc = -errno;
+	}
+	return rc;
+}
+
+/*
+ * Trims the filesystem by --chunk sized ranges from fs->offset. The chunks
+ * are used up to the filesystem size (as reported by statfs), the rest of
+ * the range is trimmed by one ioctl. On return fs->offset is where to continue
+ * the next time.
+ *
+ * returns: 0 = success, 1 = unsupported, < 0 = error
+ */
+static int fstrim_chunks(struct fstrim_control *ctl, struct fstrim_fs *fs, int fd)
+{
+	uint64_t start, end, fssize = ULLONG_MAX;
+	struct timeval begin, now, last;
+	struct statfs vfs;
+	int rc = 0;
+
+	end = ctl->range.start + ctl->range.len;
+	if (end < ctl->range.start)
+		end = ULLONG_MAX;
+
+	if (fstatfs(fd, &vfs) == 0)
+		fssize = (uint64_t) vfs.f_blocks *
+			 (vfs.f_frsize ? vfs.f_frsize : vfs.f_bsize);
+
+	start = fs->offset;
+	if (start < ctl->range.start || start >= end)
+		start = ctl->range.start;
+
+	gettime_monotonic(&begin);
+
+	while (start < end) {
+		struct fstrim_range range = { .start = start, .minlen = ctl->range.minlen };
+		uint64_t len = start >= fssize ? end - start : min(ctl->chunk, end - start);
+
+		if (ctl->time_budget) {
+			gettime_monotonic(&now);
+			if (time_diff(&now, &begin) >= ctl->time_budget) {
+				fs->interrupted = 1;
+				break;
+			}
+		}
+
+		range.len = len;
+		gettime_monotonic(&last);
+
+		rc = fstrim_ioctl(fd, &range);
+		if (rc == -EINVAL && start > ctl->range.start) {
+			rc = 0;		/* behind end of the filesystem */
+			break;
+		}
+		if (rc < 0) {
+			errno = -rc;
+			warn(_("%s: FITRIM ioctl failed"), fs->path);
+		}
+		if (rc)
+			break;
+
+		fs->trimmed += range.len;	/* kernel returns trimmed bytes */
+		start += len;
+
+		/* the device is busy, let other I/O to continue */
+		if (ctl->max_latency && start < end) {
+			double lat;
+
+			gettime_monotonic(&now);
+			lat = time_diff(&now, &last);
+			if (lat * 1000 > ctl->max_latency)
+				xusleep(lat * 1E6);
+		}
+	}
+
+	fs->offset = fs->interrupted ? start : ctl->range.start;
+	return rc;
+}
+
 /* returns: 0 = success, 1 = unsupported, < 0 = error */
-static int fstrim_filesystem(struct fstrim_control *ctl, const char *path, const char *devname)
+static int fstrim_do(struct fstrim_control *ctl, struct fstrim_fs *fs)
 {
 	int fd = -1, rc;
 	struct fstrim_range range;
-	char *rpath = realpath(path, NULL);
+	struct timeval start, end;
+	char *rpath = realpath(fs->path, NULL);
+
+	gettime_monotonic(&start);
 
 	if (!rpath) {
-		warn(_("cannot get realpath: %s"), path);
+		warn(_("cannot get realpath: %s"), fs->path);
 		rc = -errno;
 		goto done;
 	}
@@ -102,57 +368,138 @@ static int fstrim_filesystem(struct fstrim_control *ctl, const char *path, const
 
 	fd = open(rpath, O_RDONLY);
 	if (fd < 0) {
-		warn(_("cannot open %s"), path);
+		warn(_("cannot open %s"), fs->path);
 		rc = -errno;
 		goto done;
 	}
 
 	if (ctl->dryrun) {
-		if (devname)
-			printf(_("%s: 0 B (dry run) trimmed on %s\n"), path, devname);
-		else
-			printf(_("%s: 0 B (dry run) trimmed\n"), path);
 		rc = 0;
 		goto done;
 	}
 
-	errno = 0;
-	if (ioctl(fd, FITRIM, &range)) {
-		switch (errno) {
-		case EBADF:
-		case ENOTTY:
-		case EOPNOTSUPP:
-			rc = 1;
-			break;
-		default:
-			rc = -errno;
+	if (ctl->chunk)
+		rc = fstrim_chunks(ctl, fs, fd);
+	else {
+		rc = fstrim_ioctl(fd, &range);
+		if (rc == 0)
+			fs->trimmed = range.len;
+		else if (rc < 0) {
+			errno = -rc;
+			warn(_("%s: FITRIM ioctl failed"), fs->path);
 		}
-		if (rc < 0)
-			warn(_("%s: FITRIM ioctl failed"), path);
-		goto done;
 	}
+done:
+	if (fd >= 0)
+		close(fd);
+	free(rpath);
+
+	gettime_monotonic(&end);
+	fs->time = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1E6;
+	fs->rc = rc;
+	return rc;
+}
+
+static void print_fs(struct fstrim_control *ctl, struct fstrim_fs *fs)
+{
+	const char *path = fs->path, *devname = fs->devname;
 
-	if (ctl->verbose) {
+	if (fs->rc != 0)
+		return;
+
+	if (ctl->dryrun) {
+		if (devname)
+			printf(_("%s: 0 B (dry run) trimmed on %s\n"), path, devname);
+		else
+			printf(_("%s: 0 B (dry run) trimmed\n"), path);
+
+	} else if (ctl->verbose) {
 		char *str = size_to_human_string(
 				SIZE_SUFFIX_3LETTER | SIZE_SUFFIX_SPACE,
-				(uint64_t) range.len);
+				fs->trimmed);
 		if (devname)
 			/* TRANSLATORS: The standard value here is a very large number. */
 			printf(_("%s: %s (%" PRIu64 " bytes) trimmed on %s\n"),
-				path, str, (uint64_t) range.len, devname);
+				path, str, fs->trimmed, devname);
 		else
 			/* TRANSLATORS: The standard value here is a very large number. */
 			printf(_("%s: %s (%" PRIu64 " bytes) trimmed\n"),
-				path, str, (uint64_t) range.len);
+				path, str, fs->trimmed);
 
 		free(str);
+
+		if (fs->interrupted)
+			printf(_("%s: time budget exhausted, next offset %" PRIu64 "\n"),
+				path, fs->offset);
 	}
+}
 
-	rc = 0;
-done:
-	if (fd >= 0)
-		close(fd);
-	free(rpath);
+static void print_fs_json(struct fstrim_control *ctl, struct ul_jsonwrt *json,
+			  struct fstrim_fs *fs)
+{
+	ul_jsonwrt_object_open(json, NULL);
+	ul_jsonwrt_value_s(json, "target", fs->path);
+	if (fs->devname)
+		ul_jsonwrt_value_s(json, "source", fs->devname);
+	else
+		ul_jsonwrt_value_null(json, "source");
+	ul_jsonwrt_value_s(json, "status", fs->rc == 0 ? "ok" :
+				fs->rc == 1 ? "unsupported" : "failed");
+	ul_jsonwrt_value_u64(json, "trimmed", fs->trimmed);
+	/* milliseconds, the decimal point depends on locale */
+	ul_jsonwrt_value_u64(json, "time", (uint64_t) (fs->time * 1000));
+	if (ctl->chunk) {
+		ul_jsonwrt_value_boolean(json, "interrupted", fs->interrupted);
+		ul_jsonwrt_value_u64(json, "offset", fs->offset);
+	}
+	ul_jsonwrt_object_close(json);
+}
+
+static void print_fs_list_json(struct fstrim_control *ctl,
+			       struct fstrim_fs *fss, size_t nfss)
+{
+	struct ul_jsonwrt json;
+	size_t i;
+
+	ul_jsonwrt_init(&json, stdout, 0);
+	ul_jsonwrt_root_open(&json);
+	ul_jsonwrt_array_open(&json, "filesystems");
+	for (i = 0; i < nfss; i++)
+		print_fs_json(ctl, &json, &fss[i]);
+	ul_jsonwrt_array_close(&json);
+	ul_jsonwrt_root_close(&json);
+}
+
+/* returns: 0 = success, 1 = unsupported, < 0 = error */
+static int fstrim_filesystem(struct fstrim_control *ctl, struct fstrim_fs *fs)
+{
+	int rc;
+
+	fs->offset = ctl->range.start;
+	if (ctl->chunk && ctl->states) {
+		struct fstrim_state *st;
+
+		if (ctl->parallel)
+			pthread_mutex_lock(&ctl->lock);
+		st = state_get(ctl, fs->path);
+		if (st)
+			fs->offset = st->offset;
+		if (ctl->parallel)
+			pthread_mutex_unlock(&ctl->lock);
+	}
+
+	rc = fstrim_do(ctl, fs);
+
+	if (ctl->parallel)
+		pthread_mutex_lock(&ctl->lock);
+	if (ctl->chunk && ctl->state_file && rc == 0 && !ctl->dryrun)
+		state_set(ctl, fs->path, fs->offset);
+	if (!ctl->json)
+		print_fs(ctl, fs);
+	if (rc == 1 && !ctl->quiet_unsupp)
+		warnx(_("%s: the discard operation is not supported"), fs->path);
+	if (ctl->parallel)
+		pthread_mutex_unlock(&ctl->lock);
 	return rc;
 }
 
@@ -256,6 +603,66 @@ static int uniq_fs_source_cmp(
 	return !mnt_fs_streq_srcpath(a, mnt_fs_get_srcpath(b));
 }
 
+/*
+ * --parallel: filesystems on the same whole-disk are trimmed one by one,
+ * different disks are trimmed concurrently.
+ */
+struct fstrim_disk {
+	struct fstrim_control	*ctl;
+	struct fstrim_fs	*fss;
+	size_t			nfss;
+	dev_t			disk;
+	pthread_t		thread;
+};
+
+static void *fstrim_disk_thread(void *data)
+{
+	struct fstrim_disk *dk = data;
+	size_t i;
+
+	for (i = 0; i < dk->nfss; i++) {
+		if (dk->fss[i].disk == dk->disk)
+			fstrim_filesystem(dk->ctl, &dk->fss[i]);
+	}
+	return NULL;
+}
+
+static void fstrim_parallel(struct fstrim_control *ctl,
+			    struct fstrim_fs *fss, size_t nfss)
+{
+	struct fstrim_disk *dks = xcalloc(nfss, sizeof(*dks));
+	size_t i, j, ndks = 0;
+
+	for (i = 0; i < nfss; i++) {
+		for (j = 0; j < ndks; j++) {
+			if (dks[j].disk == fss[i].disk)
+				break;
+		}
+		if (j < ndks)
+			continue;
+		dks[ndks].ctl = ctl;
+		dks[ndks].fss = fss;
+		dks[ndks].nfss = nfss;
+		dks[ndks].disk = fss[i].disk;
+		ndks++;
+	}
+
+	pthread_mutex_init(&ctl->lock, NULL);
+	for (i = 0; i < ndks; i++) {
+		int rc = pthread_create(&dks[i].thread, NULL,
+					fstrim_disk_thread, &dks[i]);
+		if (rc) {
+			errno = rc;
+			err(MNT_EX_FAIL, _("failed to create thread"));
+		}
+	}
+	for (i = 0; i < ndks; i++)
+		pthread_join(dks[i].thread, NULL);
+	pthread_mutex_destroy(&ctl->lock);
+
+	free(dks);
+}
+
 /*
  * -1 = tab empty
  *  0 = all success
@@ -269,6 +676,8 @@ static int fstrim_all_from_file(struct fstrim_control *ctl, const char *filename
 	struct libmnt_table *tab;
 	struct libmnt_cache *cache = NULL;
 	struct path_cxt *wholedisk = NULL;
+	struct fstrim_fs *fss = NULL;
+	size_t i, nfss = 0;
 	int cnt = 0, cnt_err = 0;
 	int fstab = 0;
 
@@ -352,16 +761,10 @@ static int fstrim_all_from_file(struct fstrim_control *ctl, const char *filename
 	while (mnt_table_next_fs(tab, itr, &fs) == 0) {
 		const char *src = mnt_fs_get_srcpath(fs),
 			   *tgt = mnt_fs_get_target(fs);
-		char *path;
-		int rc = 1;
 
 		/* Is it really accessible mountpoint? Not all mountpoints are
 		 * accessible (maybe over mounted by another filesystem) */
-		path = mnt_get_mountpoint(tgt);
-		if (path && streq_paths(path, tgt))
-			rc = 0;
-		free(path);
-		if (rc)
+		if (!is_mountpoint(tgt))
 			continue;	/* overlaying mount */
 
 		/* FITRIM on read-only filesystem can fail, and it can fail */
@@ -375,22 +778,45 @@ static int fstrim_all_from_file(struct fstrim_control *ctl, const char *filename
 		if (!is_directory(tgt, 1) ||
 		    !has_discard(src, &wholedisk))
 			continue;
-		cnt++;
 
-		/*
-		 * We're able to detect that the device supports discard, but
-		 * things also depend on filesystem or device mapping, for
-		 * example LUKS (by default) does not support FSTRIM.
-		 *
-		 * This is reason why we ignore EOPNOTSUPP and ENOTTY errors
-		 * from discard ioctl.
-		 */
-		rc = fstrim_filesystem(ctl, tgt, src);
-		if (rc < 0)
-		       cnt_err++;
-		else if (rc == 1 && !ctl->quiet_unsupp)
-			warnx(_("%s: the discard operation is not supported"), tgt);
+		fss = xrealloc(fss, (nfss + 1) * sizeof(*fss));
+		memset(&fss[nfss], 0, sizeof(*fss));
+		fss[nfss].path = tgt;
+		fss[nfss].devname = src;
+		if (ctl->parallel) {
+			dev_t dev = sysfs_devname_to_devno(src);
+
+			if (!dev || sysfs_devno_to_wholedisk(dev, NULL, 0,
+						&fss[nfss].disk) != 0)
+				fss[nfss].disk = dev;
+		}
+		nfss++;
+	}
+
+	/*
+	 * We're able to detect that the device supports discard, but
+	 * things also depend on filesystem or device mapping, for
+	 * example LUKS (by default) does not support FSTRIM.
+	 *
+	 * This is reason why we ignore EOPNOTSUPP and ENOTTY errors
+	 * from discard ioctl.
+	 */
+	if (ctl->parallel)
+		fstrim_parallel(ctl, fss, nfss);
+	else {
+		for (i = 0; i < nfss; i++)
+			fstrim_filesystem(ctl, &fss[i]);
+	}
+
+	for (i = 0; i < nfss; i++) {
+		cnt++;
+		if (fss[i].rc < 0)
+			cnt_err++;
 	}
+
+	if (ctl->json)
+		print_fs_list_json(ctl, fss, nfss);
+	free(fss);
 	mnt_free_iter(itr);
 
 	ul_unref_path(wholedisk);
@@ -455,6 +881,12 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -v, --verbose            print number of discarded bytes\n"), out);
 	fputs(_("     --quiet-unsupported  suppress error messages if trim unsupported\n"), out);
 	fputs(_(" -n, --dry-run            does everything, but trim\n"), out);
+	fputs(_(" -J, --json               use JSON output format\n"), out);
+	fputs(_("     --parallel           trim filesystems on different disks concurrently\n"), out);
+	fputs(_("     --chunk <num>        trim by chunks of <num> bytes\n"), out);
+	fputs(_("     --time-budget <sec>  stop trimming a filesystem after <sec> seconds\n"), out);
+	fputs(_("     --max-latency <ms>   pause when a chunk takes longer than <ms>\n"), out);
+	fputs(_("     --state-file <file>  continue where the previous run stopped\n"), out);
 
 	fputs(USAGE_SEPARATOR, out);
 	printf(USAGE_HELP_OPTIONS(21));
@@ -474,8 +906,14 @@ int main(int argc, char **argv)
 	struct fstrim_control ctl = {
 			.range = { .len = ULLONG_MAX }
 	};
+	struct fstrim_fs fs = { .path = NULL };
 	enum {
-		OPT_QUIET_UNSUPP = CHAR_MAX + 1
+		OPT_QUIET_UNSUPP = CHAR_MAX + 1,
+		OPT_PARALLEL,
+		OPT_CHUNK,
+		OPT_TIME_BUDGET,
+		OPT_MAX_LATENCY,
+		OPT_STATE_FILE
 	};
 
 	static const struct option longopts[] = {
@@ -490,6 +928,12 @@ int main(int argc, char **argv)
 	    { "verbose",   no_argument,       NULL, 'v' },
 	    { "quiet-unsupported", no_argument,       NULL, OPT_QUIET_UNSUPP },
 	    { "dry-run",   no_argument,       NULL, 'n' },
+	    { "json",      no_argument,       NULL, 'J' },
+	    { "parallel",  no_argument,       NULL, OPT_PARALLEL },
+	    { "chunk",     required_argument, NULL, OPT_CHUNK },
+	    { "time-budget", required_argument, NULL, OPT_TIME_BUDGET },
+	    { "max-latency", required_argument, NULL, OPT_MAX_LATENCY },
+	    { "state-file", required_argument, NULL, OPT_STATE_FILE },
 	    { NULL, 0, NULL, 0 }
 	};
 
@@ -504,7 +948,7 @@ int main(int argc, char **argv)
 	textdomain(PACKAGE);
 	close_stdout_atexit();
 
-	while ((c = getopt_long(argc, argv, "AahI:l:m:no:Vv", longopts, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "AahI:Jl:m:no:Vv", longopts, NULL)) != -1) {
 
 		err_exclusive_options(c, longopts, excl, excl_st);
 
@@ -542,6 +986,29 @@ int main(int argc, char **argv)
 		case OPT_QUIET_UNSUPP:
 			ctl.quiet_unsupp = 1;
 			break;
+		case 'J':
+			ctl.json = 1;
+			break;
+		case OPT_PARALLEL:
+			ctl.parallel = 1;
+			break;
+		case OPT_CHUNK:
+			ctl.chunk = strtosize_or_err(optarg,
+					_("failed to parse chunk size"));
+			if (!ctl.chunk)
+				errx(EXIT_FAILURE, _("invalid chunk size"));
+			break;
+		case OPT_TIME_BUDGET:
+			ctl.time_budget = strtou32_or_err(optarg,
+					_("failed to parse time budget"));
+			break;
+		case OPT_MAX_LATENCY:
+			ctl.max_latency = strtou32_or_err(optarg,
+					_("failed to parse max latency"));
+			break;
+		case OPT_STATE_FILE:
+			ctl.state_file = optarg;
+			break;
 		case 'h':
 			usage();
 		case 'V':
@@ -562,17 +1029,33 @@ int main(int argc, char **argv)
 		errtryhelp(EXIT_FAILURE);
 	}
 
-	if (all)
-		return fstrim_all(&ctl, tabs);	/* MNT_EX_* codes */
+	if (ctl.parallel && !all)
+		errx(EXIT_FAILURE, _("--parallel requires --all, --fstab or --listed-in"));
 
-	if (!is_directory(path, 0))
-		return EXIT_FAILURE;
+	if (!ctl.chunk && (ctl.time_budget || ctl.max_latency || ctl.state_file))
+		errx(EXIT_FAILURE, _("--time-budget, --max-latency and --state-file require --chunk"));
 
-	rc = fstrim_filesystem(&ctl, path, NULL);
-	if (rc == 1 && ctl.quiet_unsupp)
-		rc = 0;
-	if (rc == 1)
-		warnx(_("%s: the discard operation is not supported"), path);
+	if (ctl.state_file)
+		state_load(&ctl);
 
-	return rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	if (all)
+		rc = fstrim_all(&ctl, tabs);	/* MNT_EX_* codes */
+	else {
+		if (!is_directory(path, 0))
+			return EXIT_FAILURE;
+
+		fs.path = path;
+		rc = fstrim_filesystem(&ctl, &fs);
+		if (ctl.json)
+			print_fs_list_json(&ctl, &fs, 1);
+		if (rc == 1 && ctl.quiet_unsupp)
+			rc = 0;
+		rc = rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if (ctl.state_file && !ctl.dryrun)
+		state_save(&ctl);
+	state_free(&ctl);
+
+	return rc;
 }
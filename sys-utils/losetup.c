@@ -26,6 +26,7 @@
 #include "xalloc.h"
 #include "canonicalize.h"
 #include "pathnames.h"
+#include "mangle.h"
 
 enum {
 	A_CREATE = 1,		/* setup a new device */
@@ -37,6 +38,7 @@ enum {
 	A_SET_CAPACITY,		/* set device capacity */
 	A_SET_DIRECT_IO,	/* set accessing backing file by direct io */
 	A_SET_BLOCKSIZE,	/* set logical block size of the loop device */
+	A_CREATE_BATCH,		/* setup devices described in a file */
 };
 
 enum {
@@ -308,15 +310,9 @@ static int set_scols_data(struct loopdev_cxt *lc, struct libscols_line *ln)
 	return 0;
 }
 
-static int show_table(struct loopdev_cxt *lc,
-		      const char *file,
-		      uint64_t offset,
-		      int flags)
+static struct libscols_table *new_table(void)
 {
-	struct stat sbuf, *st = &sbuf;
 	struct libscols_table *tb;
-	struct libscols_line *ln;
-	int rc = 0;
 	size_t i;
 
 	scols_init_debug(0);
@@ -341,12 +337,30 @@ static int show_table(struct loopdev_cxt *lc,
 			scols_column_set_json_type(cl, ci->json_type);
 	}
 
+	return tb;
+}
+
+static int add_table_line(struct libscols_table *tb, struct loopdev_cxt *lc)
+{
+	struct libscols_line *ln = scols_table_new_line(tb, NULL);
+
+	if (!ln)
+		err(EXIT_FAILURE, _("failed to allocate output line"));
+	return set_scols_data(lc, ln);
+}
+
+static int show_table(struct loopdev_cxt *lc,
+		      const char *file,
+		      uint64_t offset,
+		      int flags)
+{
+	struct stat sbuf, *st = &sbuf;
+	struct libscols_table *tb = new_table();
+	int rc = 0;
+
 	/* only one loopdev requested (already assigned to loopdev_cxt) */
 	if (loopcxt_get_device(lc)) {
-		ln = scols_table_new_line(tb, NULL);
-		if (!ln)
-			err(EXIT_FAILURE, _("failed to allocate output line"));
-		rc = set_scols_data(lc, ln);
+		rc = add_table_line(tb, lc);
 
 	/* list all loopdevs */
 	} else {
@@ -372,10 +386,7 @@ static int show_table(struct loopdev_cxt *lc,
 					continue;
 			}
 
-			ln = scols_table_new_line(tb, NULL);
-			if (!ln)
-				err(EXIT_FAILURE, _("failed to allocate output line"));
-			rc = set_scols_data(lc, ln);
+			rc = add_table_line(tb, lc);
 			if (rc)
 				break;
 		}
@@ -399,7 +410,8 @@ static void __attribute__((__noreturn__)) usage(void)
 
 	fprintf(out,
 	      _(" %1$s [options] [<loopdev>]\n"
-		" %1$s [options] -f | <loopdev> <file>\n"),
+		" %1$s [options] -f | <loopdev> <file>\n"
+		" %1$s [options] --batch <file>\n"),
 		program_invocation_short_name);
 
 	fputs(USAGE_SEPARATOR, out);
@@ -414,6 +426,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -c, --set-capacity <loopdev>  resize the device\n"), out);
 	fputs(_(" -j, --associated <file>       list all devices associated with <file>\n"), out);
 	fputs(_(" -L, --nooverlap               avoid possible conflict between devices\n"), out);
+	fputs(_("     --batch <file>            set up devices described in <file>\n"), out);
 
 	/* commands options */
 	fputs(USAGE_SEPARATOR, out);
@@ -423,7 +436,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -P, --partscan                create a partitioned loop device\n"), out);
 	fputs(_(" -r, --read-only               set up a read-only loop device\n"), out);
 	fputs(_("     --direct-io[=<on|off>]    open backing file with O_DIRECT\n"), out);
-	fputs(_("     --show                    print device name after setup (with -f)\n"), out);
+	fputs(_("     --show                    print device name after setup (with -f or --batch)\n"), out);
 	fputs(_(" -v, --verbose                 verbose mode\n"), out);
 
 	/* output options */
@@ -486,8 +499,8 @@ static int create_loop(struct loopdev_cxt *lc,
 			break;
 
 		case 1:	/* overlap */
-			loopcxt_deinit(lc);
-			errx(EXIT_FAILURE, _("%s: overlapping loop device exists"), file);
+			warnx(_("%s: overlapping loop device exists"), file);
+			return -1;
 
 		case 2: /* overlap -- full size and offset match (reuse) */
 		{
@@ -497,28 +510,27 @@ static int create_loop(struct loopdev_cxt *lc,
 			 * way to change its parameters. */
 			if (loopcxt_is_readonly(lc)
 			    && !(lo_flags & LO_FLAGS_READ_ONLY)) {
-				loopcxt_deinit(lc);
-				errx(EXIT_FAILURE, _("%s: overlapping read-only loop device exists"), file);
+				warnx(_("%s: overlapping read-only loop device exists"), file);
+				return -1;
 			}
 
 			/* This is no more supported, but check to be safe. */
 			if (loopcxt_get_encrypt_type(lc, &lc_encrypt_type) == 0
 			    && lc_encrypt_type != LO_CRYPT_NONE) {
-				loopcxt_deinit(lc);
-				errx(EXIT_FAILURE, _("%s: overlapping encrypted loop device exists"), file);
+				warnx(_("%s: overlapping encrypted loop device exists"), file);
+				return -1;
 			}
 
 			lc->config.info.lo_flags &= ~LO_FLAGS_AUTOCLEAR;
 			if (loopcxt_ioctl_status(lc)) {
-				loopcxt_deinit(lc);
-				errx(EXIT_FAILURE, _("%s: failed to re-use loop device"), file);
+				warnx(_("%s: failed to re-use loop device"), file);
+				return -1;
 			}
 			return 0;	/* success, re-use */
 		}
 		default: /* error */
-			loopcxt_deinit(lc);
-			errx(EXIT_FAILURE, _("failed to inspect loop devices"));
-			return -errno;
+			warnx(_("failed to inspect loop devices"));
+			return -1;
 		}
 	}
 
@@ -530,17 +542,18 @@ static int create_loop(struct loopdev_cxt *lc,
 		struct loopdev_cxt lc2;
 
 		if (loopcxt_init(&lc2, 0)) {
-			loopcxt_deinit(lc);
-			err(EXIT_FAILURE, _("failed to initialize loopcxt"));
+			warn(_("failed to initialize loopcxt"));
+			return -1;
 		}
 		rc = loopcxt_find_overlap(&lc2, file, offset, sizelimit);
 		loopcxt_deinit(&lc2);
 
 		if (rc) {
-			loopcxt_deinit(lc);
 			if (rc > 0)
-				errx(EXIT_FAILURE, _("%s: overlapping loop device exists"), file);
-			err(EXIT_FAILURE, _("%s: failed to check for conflicting loop devices"), file);
+				warnx(_("%s: overlapping loop device exists"), file);
+			else
+				warn(_("%s: failed to check for conflicting loop devices"), file);
+			return -1;
 		}
 	}
 
@@ -589,11 +602,126 @@ static int create_loop(struct loopdev_cxt *lc,
 	return rc;
 }
 
+/*
+ * losetup --batch <file>
+ *
+ * Sets up a loop device for each line of the file ("-" for stdin). The line
+ * format is "<file> [<option>...]", the supported options are offset=<num>,
+ * sizelimit=<num>, sector-size=<num>, device=<loopdev>, read-only, partscan
+ * and direct-io[=on|off]. The command line options are used as defaults for
+ * all lines. Empty lines and lines starting with '#' are ignored.
+ *
+ * All devices are set up by the same loop context, so /dev/loop-control is
+ * opened only once. The errors are reported and the next line is processed.
+ *
+ * Returns number of failed lines.
+ */
+static int create_loops_batch(struct loopdev_cxt *lc, const char *batchfile,
+			      int nooverlap, int lo_flags, int flags,
+			      uint64_t offset, uint64_t sizelimit,
+			      uint64_t blocksize, int showdev, int list)
+{
+	struct libscols_table *tb = NULL;
+	char *line = NULL;
+	size_t len = 0, lineno = 0;
+	int nfails = 0;
+	FILE *f;
+
+	if (strcmp(batchfile, "-") == 0)
+		f = stdin;
+	else if (!(f = fopen(batchfile, "r" UL_CLOEXECSTR)))
+		err(EXIT_FAILURE, _("cannot open %s"), batchfile);
+
+	if (list)
+		tb = new_table();
+
+	while (getline(&line, &len, f) != -1) {
+		int l_lo_flags = lo_flags, l_flags = flags;
+		uint64_t l_offset = offset, l_sizelimit = sizelimit,
+			 l_blocksize = blocksize;
+		char *tok, *save = NULL, *file, *device = NULL;
+		int rc = 0;
+
+		lineno++;
+
+		tok = strtok_r(line, " \t\n", &save);
+		if (!tok || *tok == '#')
+			continue;
+		file = unmangle(tok, NULL);
+
+		while (rc == 0 && (tok = strtok_r(NULL, " \t\n", &save))) {
+			char *val = strchr(tok, '=');
+			uintmax_t x = 0;
+
+			if (val)
+				*val++ = '\0';
+
+			if (strcmp(tok, "read-only") == 0 && !val)
+				l_lo_flags |= LO_FLAGS_READ_ONLY;
+			else if (strcmp(tok, "partscan") == 0 && !val)
+				l_lo_flags |= LO_FLAGS_PARTSCAN;
+			else if (strcmp(tok, "direct-io") == 0
+				 && (!val || strcmp(val, "on") == 0))
+				l_lo_flags |= LO_FLAGS_DIRECT_IO;
+			else if (strcmp(tok, "direct-io") == 0
+				 && strcmp(val, "off") == 0)
+				l_lo_flags &= ~LO_FLAGS_DIRECT_IO;
+			else if (strcmp(tok, "device") == 0 && val && *val)
+				device = val;
+			else if (val && strtosize(val, &x) == 0
+				 && strcmp(tok, "offset") == 0) {
+				l_offset = x;
+				l_flags |= LOOPDEV_FL_OFFSET;
+			} else if (val && strtosize(val, &x) == 0
+				   && strcmp(tok, "sizelimit") == 0) {
+				l_sizelimit = x;
+				l_flags |= LOOPDEV_FL_SIZELIMIT;
+			} else if (val && strtosize(val, &x) == 0
+				   && strcmp(tok, "sector-size") == 0)
+				l_blocksize = x;
+			else {
+				warnx(_("%s:%zu: failed to parse '%s'"),
+						batchfile, lineno, tok);
+				rc = -EINVAL;
+			}
+		}
+
+		/* NULL device resets the context, see loopcxt_find_unused() */
+		if (rc == 0 && loopcxt_set_device(lc, device)) {
+			warn(_("%s:%zu: failed to use device"), batchfile, lineno);
+			rc = -EINVAL;
+		}
+		if (rc == 0)
+			rc = create_loop(lc, nooverlap, l_lo_flags, l_flags, file,
+					 l_offset, l_sizelimit, l_blocksize);
+		if (rc == 0) {
+			if (showdev)
+				printf("%s\n", loopcxt_get_device(lc));
+			if (tb)
+				add_table_line(tb, lc);
+			warn_size(file, l_sizelimit, l_offset, l_flags);
+		} else
+			nfails++;
+
+		free(file);
+	}
+
+	free(line);
+	if (f != stdin)
+		fclose(f);
+
+	if (tb) {
+		scols_print_table(tb);
+		scols_unref_table(tb);
+	}
+	return nfails;
+}
+
 int main(int argc, char **argv)
 {
 	struct loopdev_cxt lc;
 	int act = 0, flags = 0, no_overlap = 0, c;
-	char *file = NULL;
+	char *file = NULL, *batchfile = NULL;
 	uint64_t offset = 0, sizelimit = 0, blocksize = 0;
 	int res = 0, showdev = 0, lo_flags = 0;
 	char *outarg = NULL;
@@ -605,10 +733,12 @@ int main(int argc, char **argv)
 		OPT_SHOW,
 		OPT_RAW,
 		OPT_DIO,
-		OPT_OUTPUT_ALL
+		OPT_OUTPUT_ALL,
+		OPT_BATCH
 	};
 	static const struct option longopts[] = {
 		{ "all",          no_argument,       NULL, 'a'           },
+		{ "batch",        required_argument, NULL, OPT_BATCH     },
 		{ "set-capacity", required_argument, NULL, 'c'           },
 		{ "detach",       required_argument, NULL, 'd'           },
 		{ "detach-all",   no_argument,       NULL, 'D'           },
@@ -635,7 +765,7 @@ int main(int argc, char **argv)
 	};
 
 	static const ul_excl_t excl[] = {	/* rows and cols in ASCII order */
-		{ 'D','a','c','d','f','j' },
+		{ 'D','a','c','d','f','j',OPT_BATCH },
 		{ 'D','c','d','f','l' },
 		{ 'D','c','d','f','O' },
 		{ 'J',OPT_RAW },
@@ -724,6 +854,10 @@ int main(int argc, char **argv)
 		case OPT_SHOW:
 			showdev = 1;
 			break;
+		case OPT_BATCH:
+			act = A_CREATE_BATCH;
+			batchfile = optarg;
+			break;
 		case OPT_DIO:
 			use_dio = set_dio = 1;
 			if (optarg)
@@ -773,6 +907,9 @@ int main(int argc, char **argv)
 		columns[ncolumns++] = COL_LOGSEC;
 	}
 
+	if (act == A_CREATE_BATCH && optind < argc)
+		errx(EXIT_FAILURE, _("unexpected arguments"));
+
 	if (act == A_FIND_FREE && optind < argc) {
 		/*
 		 * losetup -f <backing_file>
@@ -829,14 +966,15 @@ int main(int argc, char **argv)
 		file = argv[optind++];
 	}
 
-	if (act != A_CREATE &&
+	if (act != A_CREATE && act != A_CREATE_BATCH &&
 	    (sizelimit || lo_flags || showdev))
 		errx(EXIT_FAILURE,
 			_("the options %s are allowed during loop device setup only"),
 			"--{sizelimit,partscan,read-only,show}");
 
 	if ((flags & LOOPDEV_FL_OFFSET) &&
-	    act != A_CREATE && (act != A_SHOW || !file))
+	    act != A_CREATE && act != A_CREATE_BATCH &&
+	    (act != A_SHOW || !file))
 		errx(EXIT_FAILURE, _("the option --offset is not allowed in this context"));
 
 	if (outarg && string_add_to_idarray(outarg, columns, ARRAY_SIZE(columns),
@@ -853,6 +991,11 @@ int main(int argc, char **argv)
 			warn_size(file, sizelimit, offset, flags);
 		}
 		break;
+	case A_CREATE_BATCH:
+		res = create_loops_batch(&lc, batchfile, no_overlap, lo_flags,
+					 flags, offset, sizelimit, blocksize,
+					 showdev, list);
+		break;
 	case A_DELETE:
 		res = delete_loop(&lc);
 		while (optind < argc) {
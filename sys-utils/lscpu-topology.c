@@ -9,25 +9,45 @@
 
 #include "lscpu.h"
 
-/* add @set to the @ary, unnecessary set is deallocated. */
-static int add_cpuset_to_array(cpu_set_t **ary, size_t *items, cpu_set_t *set, size_t setsize)
+/*
+ * Returns the topology map @name (e.g. "thread_siblings") of the CPU @num. The
+ * map is the same for all CPUs in the map, so it is read from sysfs only if
+ * the CPU is not in any map from @ary yet. The new map is added to the @ary.
+ */
+static cpu_set_t *read_topology_map(struct lscpu_cxt *cxt,
+				    cpu_set_t ***ary, size_t *items,
+				    int num, const char *name)
 {
+	cpu_set_t *set = NULL;
 	size_t i;
 
-	if (!ary)
-		return -EINVAL;
+	for (i = 0; *ary && i < *items; i++) {
+		if (CPU_ISSET_S(num, cxt->setsize, (*ary)[i]))
+			return (*ary)[i];
+	}
+
+	if (ul_path_readf_cpuset(cxt->syscpu, &set, cxt->maxcpus,
+				 "cpu%d/topology/%s", num, name) != 0 || !set)
+		return NULL;
 
+	/* For each map we make sure that it can have up to ncpuspos
+	 * entries. This is because we cannot reliably calculate the
+	 * number of cores, sockets and books on all architectures.
+	 * E.g. completely virtualized architectures like s390 may
+	 * have multiple sockets of different sizes.
+	 */
+	if (!*ary)
+		*ary = xcalloc(cxt->npossibles, sizeof(cpu_set_t *));
+
+	/* broken map (does not contain the CPU); keep the old behavior */
 	for (i = 0; i < *items; i++) {
-		if (CPU_EQUAL_S(setsize, set, ary[i]))
-			break;
-	}
-	if (i == *items) {
-		ary[*items] = set;
-		++*items;
-		return 0;
+		if (CPU_EQUAL_S(cxt->setsize, set, (*ary)[i])) {
+			CPU_FREE(set);
+			return (*ary)[i];
+		}
 	}
-	CPU_FREE(set);
-	return 1;
+	(*ary)[(*items)++] = set;
+	return set;
 }
 
 static void free_cpuset_array(cpu_set_t **ary, int items)
@@ -91,21 +111,19 @@ void lscpu_sort_caches(struct lscpu_cache *caches, size_t n)
 /* Read topology for specified type */
 static int cputype_read_topology(struct lscpu_cxt *cxt, struct lscpu_cputype *ct)
 {
-	size_t i, npos;
+	size_t i;
 	struct path_cxt *sys;
 	int nthreads = 0, sw_topo = 0;
 	FILE *fd;
 
 	sys = cxt->syscpu;				/* /sys/devices/system/cpu/ */
-	npos = cxt->npossibles;				/* possible CPUs */
 
 	DBG(TYPE, ul_debugobj(ct, "reading %s/%s/%s topology",
 				ct->vendor ?: "", ct->model ?: "", ct->modelname ?:""));
 
 	for (i = 0; i < cxt->npossibles; i++) {
 		struct lscpu_cpu *cpu = cxt->cpus[i];
-		cpu_set_t *thread_siblings = NULL, *core_siblings = NULL;
-		cpu_set_t *book_siblings = NULL, *drawer_siblings = NULL;
+		cpu_set_t *thread_siblings;
 		int num, n;
 
 		if (!cpu || cpu->type != ct)
@@ -117,47 +135,20 @@ static int cputype_read_topology(struct lscpu_cxt *cxt, struct lscpu_cputype *ct
 			continue;
 
 		/* read topology maps */
-		ul_path_readf_cpuset(sys, &thread_siblings, cxt->maxcpus,
-					"cpu%d/topology/thread_siblings", num);
-		ul_path_readf_cpuset(sys, &core_siblings, cxt->maxcpus,
-					"cpu%d/topology/core_siblings", num);
-		ul_path_readf_cpuset(sys, &book_siblings, cxt->maxcpus,
-					"cpu%d/topology/book_siblings", num);
-		ul_path_readf_cpuset(sys, &drawer_siblings, cxt->maxcpus,
-					"cpu%d/topology/drawer_siblings", num);
-
-		n = CPU_COUNT_S(cxt->setsize, thread_siblings);
+		thread_siblings = read_topology_map(cxt, &ct->coremaps, &ct->ncores,
+					num, "thread_siblings");
+		read_topology_map(cxt, &ct->socketmaps, &ct->nsockets,
+					num, "core_siblings");
+		read_topology_map(cxt, &ct->bookmaps, &ct->nbooks,
+					num, "book_siblings");
+		read_topology_map(cxt, &ct->drawermaps, &ct->ndrawers,
+					num, "drawer_siblings");
+
+		n = thread_siblings ? CPU_COUNT_S(cxt->setsize, thread_siblings) : 0;
 		if (!n)
 			n = 1;
 		if (n > nthreads)
 			nthreads = n;
-
-		/* Allocate arrays for topology maps.
-		 *
-		 * For each map we make sure that it can have up to ncpuspos
-		 * entries. This is because we cannot reliably calculate the
-		 * number of cores, sockets and books on all architectures.
-		 * E.g. completely virtualized architectures like s390 may
-		 * have multiple sockets of different sizes.
-		 */
-		if (!ct->coremaps)
-			ct->coremaps = xcalloc(npos, sizeof(cpu_set_t *));
-		if (!ct->socketmaps)
-			ct->socketmaps = xcalloc(npos, sizeof(cpu_set_t *));
-		if (!ct->bookmaps && book_siblings)
-			ct->bookmaps = xcalloc(npos, sizeof(cpu_set_t *));
-		if (!ct->drawermaps && drawer_siblings)
-			ct->drawermaps = xcalloc(npos, sizeof(cpu_set_t *));
-
-		/* add to topology maps */
-		add_cpuset_to_array(ct->coremaps, &ct->ncores, thread_siblings, cxt->setsize);
-		add_cpuset_to_array(ct->socketmaps, &ct->nsockets, core_siblings, cxt->setsize);
-
-		if (book_siblings)
-			add_cpuset_to_array(ct->bookmaps, &ct->nbooks, book_siblings, cxt->setsize);
-		if (drawer_siblings)
-			add_cpuset_to_array(ct->drawermaps, &ct->ndrawers, drawer_siblings, cxt->setsize);
-
 	}
 
 	/* s390 detects its cpu topology via /proc/sysinfo, if present.
@@ -281,6 +272,7 @@ static struct lscpu_cache *add_cache(struct lscpu_cxt *cxt,
 	ca->id = id;
 	ca->level = level;
 	ca->type = xstrdup(type);
+	ca->index = -1;
 
 	DBG(GATHER, ul_debugobj(cxt, "add cache %s%d::%d", type, level, id));
 	return ca;
@@ -370,28 +362,47 @@ static int read_sparc_caches(struct lscpu_cxt *cxt, struct lscpu_cpu *cpu)
 	return 0;
 }
 
+/*
+ * Returns the already known cache for cpu<num>/cache/index<idx>. The kernel
+ * lists a shared cache at the same index for all the CPUs in the shared_cpu_map,
+ * so it's unnecessary to read the attributes again.
+ */
+static struct lscpu_cache *get_shared_cache(struct lscpu_cxt *cxt, int num, size_t idx)
+{
+	size_t i;
+
+	for (i = 0; i < cxt->ncaches; i++) {
+		struct lscpu_cache *ca = &cxt->caches[i];
+
+		if (ca->index == (int) idx && ca->sharedmap &&
+		    CPU_ISSET_S(num, cxt->setsize, ca->sharedmap))
+			return ca;
+	}
+	return NULL;
+}
+
 static int read_caches(struct lscpu_cxt *cxt, struct lscpu_cpu *cpu)
 {
 	char buf[256];
 	struct path_cxt *sys = cxt->syscpu;
 	int num = cpu->logical_id;
-	size_t i, ncaches = 0;
-
-	while (ul_path_accessf(sys, F_OK,
-				"cpu%d/cache/index%zu",
-				num, ncaches) == 0)
-		ncaches++;
-
-	if (ncaches == 0 && ul_path_accessf(sys, F_OK,
-				"cpu%d/l1_icache_size", num) == 0)
-		return read_sparc_caches(cxt, cpu);
+	size_t i;
 
-	DBG(CPU, ul_debugobj(cpu, "#%d reading %zd caches", num, ncaches));
+	DBG(CPU, ul_debugobj(cpu, "#%d reading caches", num));
 
-	for (i = 0; i < ncaches; i++) {
+	for (i = 0; ; i++) {
 		struct lscpu_cache *ca;
 		int id, level;
 
+		if (get_shared_cache(cxt, num, i))
+			continue;
+		if (ul_path_accessf(sys, F_OK, "cpu%d/cache/index%zu", num, i) != 0) {
+			if (i == 0 && ul_path_accessf(sys, F_OK,
+						"cpu%d/l1_icache_size", num) == 0)
+				return read_sparc_caches(cxt, cpu);
+			break;
+		}
+
 		if (ul_path_readf_s32(sys, &id, "cpu%d/cache/index%zu/id", num, i) != 0)
 			id = -1;
 		if (ul_path_readf_s32(sys, &level, "cpu%d/cache/index%zu/level", num, i) != 0)
@@ -446,10 +457,12 @@ static int read_caches(struct lscpu_cxt *cxt, struct lscpu_cpu *cpu)
 				ca->size = 0;
 		}
 
-		if (!ca->sharedmap)
+		if (!ca->sharedmap) {
 			/* information about how CPUs share different caches */
 			ul_path_readf_cpuset(sys, &ca->sharedmap, cxt->maxcpus,
 					  "cpu%d/cache/index%zu/shared_cpu_map", num, i);
+			ca->index = i;
+		}
 	}
 
 	return 0;
@@ -51,6 +51,7 @@ struct lscpu_cache {
 	unsigned int	coherency_line_size;
 
 	cpu_set_t	*sharedmap;
+	int		index;		/* cpu<N>/cache/index<index> in sysfs */
 };
 
 struct lscpu_cputype {
@@ -0,0 +1,146 @@
+/*
+ * Print CRC32 and CRC32C of stdin, cross-check the optimized and portable
+ * implementations against a bitwise reference (--verify) or measure their
+ * throughput (--bench).
+ *
+ * No copyright is claimed.  This code is in the public domain; do with
+ * it what you wish.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "crc32.h"
+#include "crc32c.h"
+
+static uint32_t ref_crc(uint32_t poly, uint32_t crc,
+			const unsigned char *p, size_t len)
+{
+	while (len--) {
+		int i;
+
+		crc ^= *p++;
+		for (i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ ((crc & 1) ? poly : 0);
+	}
+	return crc;
+}
+
+static int verify(void)
+{
+	unsigned char buf[4096 + 16], tmp[sizeof(buf)];
+	size_t i, off, len;
+	int rc = 0;
+
+	srand(42);
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = rand();
+
+	for (off = 0; off < 16; off++) {
+		for (len = 0; len + off <= sizeof(buf); len += (len < 64 ? 1 : 61)) {
+			const unsigned char *p = buf + off;
+			uint32_t seed = rand();
+			uint32_t ref = ref_crc(0xedb88320, seed, p, len);
+			uint32_t refc = ref_crc(0x82f63b78, seed, p, len);
+
+			/* the dispatched (maybe CPU-accelerated) and the
+			 * portable implementations have to match */
+			if (ul_crc32(seed, p, len) != ref) {
+				printf("crc32 mismatch: off=%zu len=%zu\n", off, len);
+				rc = 1;
+			}
+			if (ul_crc32_portable(seed, p, len) != ref) {
+				printf("crc32 portable mismatch: off=%zu len=%zu\n", off, len);
+				rc = 1;
+			}
+			if (crc32c(seed, p, len) != refc) {
+				printf("crc32c mismatch: off=%zu len=%zu\n", off, len);
+				rc = 1;
+			}
+			if (crc32c_portable(seed, p, len) != refc) {
+				printf("crc32c portable mismatch: off=%zu len=%zu\n", off, len);
+				rc = 1;
+			}
+		}
+	}
+
+	for (off = 0; off < 100; off += 7) {
+		for (len = 0; len < 20; len += 3) {
+			memcpy(tmp, buf, 512);
+			memset(tmp + off, 0, len);
+			if (ul_crc32_exclude_offset(~0, buf, 512, off, len) !=
+			    ref_crc(0xedb88320, ~0, tmp, 512)) {
+				printf("crc32 exclude mismatch: off=%zu len=%zu\n", off, len);
+				rc = 1;
+			}
+		}
+	}
+
+	if (!rc)
+		printf("OK\n");
+	return rc;
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int bench(size_t size)
+{
+	unsigned char *buf = malloc(size);
+	size_t i, loops = (256UL << 20) / size;
+	uint32_t crc = 0;
+	double t;
+
+	if (!buf)
+		return 1;
+	if (!loops)
+		loops = 1;
+	for (i = 0; i < size; i++)
+		buf[i] = i;
+
+	t = now();
+	for (i = 0; i < loops; i++)
+		crc ^= ul_crc32(~0, buf, size);
+	t = now() - t;
+	printf("crc32:  %zu bytes x %zu: %.1f MiB/s\n", size, loops,
+			(double) size * loops / (1 << 20) / t);
+
+	t = now();
+	for (i = 0; i < loops; i++)
+		crc ^= crc32c(~0, buf, size);
+	t = now() - t;
+	printf("crc32c: %zu bytes x %zu: %.1f MiB/s\n", size, loops,
+			(double) size * loops / (1 << 20) / t);
+
+	free(buf);
+	return crc == 0xdeadbeef;	/* keep the loops alive */
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned char buf[BUFSIZ];
+	uint32_t crc = ~0, crcc = ~0;
+	size_t ret;
+
+	if (argc > 1 && strcmp(argv[1], "--verify") == 0)
+		return verify();
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+		return bench(argc > 2 ? strtoul(argv[2], NULL, 0) : 4096);
+
+	while (!feof(stdin) && !ferror(stdin)) {
+		ret = fread(buf, 1, sizeof(buf), stdin);
+		if (ret) {
+			crc = ul_crc32(crc, buf, ret);
+			crcc = crc32c(crcc, buf, ret);
+		}
+	}
+
+	printf("%08x %08x\n", crc ^ ~0U, crcc ^ ~0U);
+	return 0;
+}
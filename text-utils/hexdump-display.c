@@ -49,6 +49,9 @@
 static void doskip(const char *, int, struct hexdump *);
 static u_char *get(struct hexdump *);
 
+/* stdio buffers; the default BUFSIZ means a lot of small syscalls */
+#define HEXDUMP_BUFSIZ	(64 * 1024)
+
 enum _vflag vflag = FIRST;
 
 static off_t address;			/* address/offset in stream */
@@ -237,6 +240,188 @@ static void bpad(struct hexdump_pr *pr)
 		;
 }
 
+/*
+ * Specialized display of the built-in layouts (see HEXDUMP_LAYOUT_*). The
+ * output has to be exactly the same as the format units produce, including
+ * blank padding of the last block (see bpad()) and the suppressed trailing
+ * whitespace of the last unit in the line (see pr->nospace).
+ */
+struct hexdump_layout {
+	int		id;
+	const char	*prefix;	/* text before every unit */
+	size_t		prefixsz;
+	unsigned int	base;
+	int		width;		/* number of digits */
+	int		bcnt;		/* unit size in bytes */
+};
+
+static const struct hexdump_layout layouts[] = {
+	{ HEXDUMP_LAYOUT_1B_OCTAL,   "",    0, 8,  3, 1 },
+	{ HEXDUMP_LAYOUT_2B_DECIMAL, "  ",  2, 10, 5, 2 },
+	{ HEXDUMP_LAYOUT_2B_OCTAL,   " ",   1, 8,  6, 2 },
+	{ HEXDUMP_LAYOUT_2B_HEX,     "   ", 3, 16, 4, 2 },
+	{ HEXDUMP_LAYOUT_DEFAULT,    "",    0, 16, 4, 2 }
+};
+
+static const char hexdigits[] = "0123456789abcdef";
+static char hextab[256][2];		/* byte to two hex digits */
+static char printtab[256];		/* byte to %_p */
+
+static void init_tables(void)
+{
+	int i;
+
+	for (i = 0; i < 256; i++) {
+		hextab[i][0] = hexdigits[i >> 4];
+		hextab[i][1] = hexdigits[i & 0xf];
+		printtab[i] = isprint(i) ? i : '.';
+	}
+}
+
+/* zero padded number with at least @width digits */
+static inline char *put_number(char *p, unsigned long long num,
+			       unsigned int base, int width)
+{
+	char tmp[sizeof(num) * 3];
+	int n = 0;
+
+	do {
+		tmp[n++] = hexdigits[num % base];
+		num /= base;
+	} while (num);
+
+	while (n < width)
+		tmp[n++] = '0';
+	while (n)
+		*p++ = tmp[--n];
+	return p;
+}
+
+static inline char *put_address(char *p, int width)
+{
+	unsigned long long num = address;
+
+	if (num < 0x10000000ULL && width <= 8) {
+		int i;
+
+		for (i = width - 1; i >= 0; i--, num >>= 4)
+			p[i] = hexdigits[num & 0xf];
+		return p + width;
+	}
+	return put_number(p, num, 16, width);
+}
+
+static inline int is_padded(off_t addr)
+{
+	return eaddress && addr >= eaddress;
+}
+
+static void display_canonical(unsigned char *bp)
+{
+	char line[128], *p = line;
+	int i;
+
+	p = put_address(p, 8);
+	*p++ = ' ';
+	*p++ = ' ';
+
+	for (i = 0; i < 16; i++) {
+		if (i == 8) {
+			*p++ = ' ';
+			*p++ = ' ';
+		}
+		if (is_padded(address + i)) {
+			*p++ = ' ';
+			*p++ = ' ';
+		} else {
+			*p++ = hextab[bp[i]][0];
+			*p++ = hextab[bp[i]][1];
+		}
+		if (i != 7 && i != 15)
+			*p++ = ' ';
+	}
+
+	*p++ = ' ';
+	*p++ = ' ';
+	*p++ = '|';
+	for (i = 0; i < 16 && !is_padded(address + i); i++)
+		*p++ = printtab[bp[i]];
+	*p++ = '|';
+	*p++ = '\n';
+
+	fwrite(line, 1, p - line, stdout);
+}
+
+static void display_layout(const struct hexdump_layout *ly,
+			   unsigned char *bp, ssize_t blocksize)
+{
+	char line[256], *p = line;
+	ssize_t i;
+
+	p = put_address(p, 7);
+	*p++ = ' ';
+
+	for (i = 0; i < blocksize; i += ly->bcnt) {
+		unsigned int num;
+
+		memcpy(p, ly->prefix, ly->prefixsz);
+		p += ly->prefixsz;
+
+		if (is_padded(address + i)) {
+			memset(p, ' ', ly->width);
+			p += ly->width;
+			goto next;
+		}
+
+		if (ly->bcnt == 2) {
+			unsigned short sval;
+
+			memcpy(&sval, bp + i, sizeof(sval));
+			num = sval;
+		} else
+			num = bp[i];
+
+		switch (ly->base) {
+		case 16:
+			if (ly->bcnt == 2) {
+				/* width is always 4 */
+				*p++ = hextab[num >> 8][0];
+				*p++ = hextab[num >> 8][1];
+			}
+			*p++ = hextab[num & 0xff][0];
+			*p++ = hextab[num & 0xff][1];
+			break;
+		case 10:
+			p = put_number(p, num, 10, ly->width);
+			break;
+		case 8:
+			p = put_number(p, num, 8, ly->width);
+			break;
+		}
+next:
+		if (i + ly->bcnt < blocksize)
+			*p++ = ' ';
+	}
+	*p++ = '\n';
+
+	fwrite(line, 1, p - line, stdout);
+}
+
+static const struct hexdump_layout *get_layout(struct hexdump *hex)
+{
+	size_t i;
+
+	/* the layout units are expected to fill the line */
+	if (hex->blocksize != 16)
+		return NULL;
+
+	for (i = 0; i < ARRAY_SIZE(layouts); i++) {
+		if (layouts[i].id == hex->layout)
+			return &layouts[i];
+	}
+	return NULL;
+}
+
 void display(struct hexdump *hex)
 {
 	register struct list_head *fs;
@@ -248,8 +433,27 @@ void display(struct hexdump *hex)
 	off_t saveaddress;
 	unsigned char savech = 0, *savebp;
 	struct list_head *p, *q, *r;
+	const struct hexdump_layout *ly = NULL;
+
+	if (hex->layout != HEXDUMP_LAYOUT_GENERIC) {
+		init_tables();
+		ly = get_layout(hex);
+		if (!ly && hex->layout != HEXDUMP_LAYOUT_CANONICAL)
+			hex->layout = HEXDUMP_LAYOUT_GENERIC;
+	}
+	if (!isatty(STDOUT_FILENO))
+		setvbuf(stdout, NULL, _IOFBF, HEXDUMP_BUFSIZ);
 
 	while ((bp = get(hex)) != NULL) {
+		if (ly) {
+			display_layout(ly, bp, hex->blocksize);
+			continue;
+		}
+		if (hex->layout == HEXDUMP_LAYOUT_CANONICAL) {
+			display_canonical(bp);
+			continue;
+		}
+
 		fs = &hex->fshead; savebp = bp; saveaddress = address;
 
 		list_for_each(p, fs) {
@@ -402,6 +606,7 @@ retnul:
 
 int next(char **argv, struct hexdump *hex)
 {
+	static char inbuf[HEXDUMP_BUFSIZ];
 	static int done;
 	int statok;
 
@@ -423,6 +628,7 @@ int next(char **argv, struct hexdump *hex)
 				return(0);
 			statok = 0;
 		}
+		setvbuf(stdin, inbuf, _IOFBF, sizeof(inbuf));
 		if (hex->skip)
 			doskip(statok ? *_argv : "stdin", statok, hex);
 		if (*_argv)
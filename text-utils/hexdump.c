@@ -61,6 +61,7 @@ parse_args(int argc, char **argv, struct hexdump *hex)
 {
 	int ch;
 	int colormode = UL_COLORMODE_UNDEF;
+	int layout = HEXDUMP_LAYOUT_GENERIC, nlayouts = 0;
 	char *hex_offt = "\"%07.7_Ax\n\"";
 
 
@@ -87,6 +88,8 @@ parse_args(int argc, char **argv, struct hexdump *hex)
 		add_fmt("\"%08.8_Ax\n\"", hex);
 		add_fmt("\"%08.8_ax  \" 8/1 \"%02x \" \"  \" 8/1 \"%02x \" ", hex);
 		add_fmt("\"  |\" 16/1 \"%_p\" \"|\\n\"", hex);
+		layout = HEXDUMP_LAYOUT_CANONICAL;
+		nlayouts++;
 	}
 
 	while ((ch = getopt_long(argc, argv, "bcCde:f:L::n:os:vxhV", longopts, NULL)) != -1) {
@@ -94,25 +97,34 @@ parse_args(int argc, char **argv, struct hexdump *hex)
 		case 'b':
 			add_fmt(hex_offt, hex);
 			add_fmt("\"%07.7_ax \" 16/1 \"%03o \" \"\\n\"", hex);
+			layout = HEXDUMP_LAYOUT_1B_OCTAL;
+			nlayouts++;
 			break;
 		case 'c':
 			add_fmt(hex_offt, hex);
 			add_fmt("\"%07.7_ax \" 16/1 \"%3_c \" \"\\n\"", hex);
+			nlayouts++;
 			break;
 		case 'C':
 			add_fmt("\"%08.8_Ax\n\"", hex);
 			add_fmt("\"%08.8_ax  \" 8/1 \"%02x \" \"  \" 8/1 \"%02x \" ", hex);
 			add_fmt("\"  |\" 16/1 \"%_p\" \"|\\n\"", hex);
+			layout = HEXDUMP_LAYOUT_CANONICAL;
+			nlayouts++;
 			break;
 		case 'd':
 			add_fmt(hex_offt, hex);
 			add_fmt("\"%07.7_ax \" 8/2 \"  %05u \" \"\\n\"", hex);
+			layout = HEXDUMP_LAYOUT_2B_DECIMAL;
+			nlayouts++;
 			break;
 		case 'e':
 			add_fmt(optarg, hex);
+			nlayouts++;
 			break;
 		case 'f':
 			addfile(optarg, hex);
+			nlayouts++;
 			break;
 		case 'L':
 			colormode = UL_COLORMODE_AUTO;
@@ -126,6 +138,8 @@ parse_args(int argc, char **argv, struct hexdump *hex)
 		case 'o':
 			add_fmt(hex_offt, hex);
 			add_fmt("\"%07.7_ax \" 8/2 \" %06o \" \"\\n\"", hex);
+			layout = HEXDUMP_LAYOUT_2B_OCTAL;
+			nlayouts++;
 			break;
 		case 's':
 			hex->skip = strtosize_or_err(optarg, _("failed to parse offset"));
@@ -136,6 +150,8 @@ parse_args(int argc, char **argv, struct hexdump *hex)
 		case 'x':
 			add_fmt(hex_offt, hex);
 			add_fmt("\"%07.7_ax \" 8/2 \"   %04x \" \"\\n\"", hex);
+			layout = HEXDUMP_LAYOUT_2B_HEX;
+			nlayouts++;
 			break;
 
 		case 'h':
@@ -150,7 +166,13 @@ parse_args(int argc, char **argv, struct hexdump *hex)
 	if (list_empty(&hex->fshead)) {
 		add_fmt(hex_offt, hex);
 		add_fmt("\"%07.7_ax \" 8/2 \"%04x \" \"\\n\"", hex);
+		layout = HEXDUMP_LAYOUT_DEFAULT;
+		nlayouts++;
 	}
+	/* the built-in layouts have fast display, but not when combined */
+	if (nlayouts == 1)
+		hex->layout = layout;
+
 	colors_init (colormode, "hexdump");
 	return optind;
 }
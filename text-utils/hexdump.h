@@ -86,12 +86,24 @@ struct hexdump_fs {			/* format strings */
 	int bcnt;
 };
 
+/* built-in layouts displayed without the format interpreter */
+enum {
+	HEXDUMP_LAYOUT_GENERIC = 0,	/* use format units */
+	HEXDUMP_LAYOUT_CANONICAL,	/* -C */
+	HEXDUMP_LAYOUT_1B_OCTAL,	/* -b */
+	HEXDUMP_LAYOUT_2B_DECIMAL,	/* -d */
+	HEXDUMP_LAYOUT_2B_OCTAL,	/* -o */
+	HEXDUMP_LAYOUT_2B_HEX,		/* -x */
+	HEXDUMP_LAYOUT_DEFAULT		/* no format specified */
+};
+
 struct hexdump {
   struct list_head fshead;				/* head of format strings */
   ssize_t blocksize;			/* data block size */
   int exitval;				/* final exit value */
   ssize_t length;			/* max bytes to read */
   off_t skip;				/* bytes to skip */
+  int layout;				/* HEXDUMP_LAYOUT_* */
 };
 
 extern struct hexdump_fu *endfu;